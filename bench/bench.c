@@ -0,0 +1,329 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <libusb.h>
+#include "croco.h"
+#include "response.h"
+#include "romheader.h"
+#include "savesync.h"
+#include "sim.h"
+#include "transport.h"
+
+// Throughput benchmark for the ROM flash and SRAM transfer paths.
+//
+// Runs upload_rom over a range of ROM sizes and download_save/upload_save
+// over a range of RAM bank counts, then prints one JSON object per run on
+// stdout. Uses a real cartridge when one is attached, the simulator otherwise.
+// Every ROM written by the benchmark is deleted again afterwards. Its ROM table
+// cache lives in BENCH_CACHE_DIR, and no save shadow or timeline point is kept,
+// so the timings hold no history fsyncs and the user's cache is left alone.
+
+#ifndef CROCO_GIT_REV
+#define CROCO_GIT_REV "unknown"
+#endif
+
+#define BENCH_ROM_PATH "build/bench_rom.gb"
+#define BENCH_SAV_PATH "build/bench.sav"
+#define BENCH_CACHE_DIR "build/bench_cache"
+
+typedef struct {
+    uint8_t opcode;
+    uint64_t *values;
+    size_t count;
+    size_t cap;
+} Samples;
+
+static FILE *results;
+static int saved_stdout = -1;
+static const char *transport_name = "usb";
+
+static void collect_sample(void *user, uint8_t opcode, uint64_t latency_ns) {
+    Samples *samples = user;
+    if (opcode != samples->opcode) {
+        return;
+    }
+    if (samples->count == samples->cap) {
+        size_t cap = samples->cap ? samples->cap * 2 : 4096;
+        uint64_t *values = realloc(samples->values, cap * sizeof(uint64_t));
+        if (!values) {
+            return;
+        }
+        samples->values = values;
+        samples->cap = cap;
+    }
+    samples->values[samples->count++] = latency_ns;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile_us(Samples *samples, int pct) {
+    if (samples->count == 0) {
+        return 0.0;
+    }
+    return samples->values[(samples->count - 1) * pct / 100] / 1000.0;
+}
+
+// The transfer paths draw progress bars on stdout; keep them out of the results
+static void quiet_begin(void) {
+    fflush(stdout);
+    saved_stdout = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd >= 0) {
+        dup2(null_fd, STDOUT_FILENO);
+        close(null_fd);
+    }
+}
+
+static void quiet_end(void) {
+    fflush(stdout);
+    if (saved_stdout >= 0) {
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdout);
+        saved_stdout = -1;
+    }
+}
+
+static void report(const char *path, uint32_t bytes, int ram_banks, Samples *samples, uint64_t wall_ns, int ok) {
+    qsort(samples->values, samples->count, sizeof(uint64_t), compare_u64);
+
+    double wall_s = wall_ns / 1e9;
+    fprintf(results,
+            "{\"rev\":\"%s\",\"transport\":\"%s\",\"path\":\"%s\",\"bytes\":%u,\"ram_banks\":%d,"
+            "\"chunks\":%zu,\"ok\":%s,\"wall_ms\":%.3f,\"throughput_kib_s\":%.1f,"
+            "\"p50_us\":%.1f,\"p99_us\":%.1f}\n",
+            CROCO_GIT_REV, transport_name, path, bytes, ram_banks,
+            samples->count, ok ? "true" : "false", wall_s * 1000.0,
+            wall_s > 0 ? bytes / 1024.0 / wall_s : 0.0,
+            percentile_us(samples, 50), percentile_us(samples, 99));
+    fflush(results);
+
+    samples->count = 0;
+}
+
+static uint8_t ram_size_code(int ram_banks) {
+    switch (ram_banks) {
+        case 1: return 0x02;
+        case 4: return 0x03;
+        case 8: return 0x05;
+        case 16: return 0x04;
+        default: return 0x00;
+    }
+}
+
+static int write_bench_rom(uint32_t size, int ram_banks) {
+    uint8_t *data = malloc(size);
+    if (!data) {
+        return -1;
+    }
+
+    // Incompressible filler so no path can get away with skipping data
+    uint32_t x = 0x2545F491u ^ size;
+    for (uint32_t i = 0; i < size; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        data[i] = (uint8_t)x;
+    }
+
+    memset(data + 0x134, 0, 16);
+    memcpy(data + 0x134, "CROCOBENCH", 10);
+    data[0x147] = ram_banks ? 0x1B : 0x19;   // MBC5 (+RAM+BATTERY)
+    data[0x149] = ram_size_code(ram_banks);
+
+    // A header that passes the pre-flight check: sizes are 32 KiB << code
+    data[0x148] = 0;
+    while ((32u << 10 << data[0x148]) < size) {
+        data[0x148]++;
+    }
+    uint8_t check = 0;
+    for (int i = 0x134; i <= 0x14C; i++) {
+        check = check - data[i] - 1;
+    }
+    data[0x14D] = check;
+    uint16_t sum = romheader_byte_sum(data, size) - data[0x14E] - data[0x14F];
+    data[0x14E] = sum >> 8;
+    data[0x14F] = sum & 0xFF;
+
+    FILE *f = fopen(BENCH_ROM_PATH, "wb");
+    if (!f) {
+        free(data);
+        return -1;
+    }
+    size_t written = fwrite(data, 1, size, f);
+    fclose(f);
+    free(data);
+    return written == size ? 0 : -1;
+}
+
+static int last_rom_id(CrocoDevice *device) {
+    uint8_t response[10];
+    if (execute_command(device, 0x01, NULL, 0, response, sizeof(response)) < 5 || response[0] == 0) {
+        return -1;
+    }
+    return response[0] - 1;
+}
+
+static int bench_upload_rom(CrocoDevice *device, Samples *samples, uint32_t size, int ram_banks) {
+    if (write_bench_rom(size, ram_banks) != 0) {
+        fprintf(stderr, "Could not write %s\n", BENCH_ROM_PATH);
+        return -1;
+    }
+
+    samples->opcode = 0x03;
+    samples->count = 0;
+
+    quiet_begin();
+    uint64_t start = monotonic_ns();
+    int ret = upload_rom(device, BENCH_ROM_PATH, "CrocoBench");
+    uint64_t wall = monotonic_ns() - start;
+    quiet_end();
+
+    if (ram_banks == 0) {
+        report("upload_rom", size, 0, samples, wall, ret == 0);
+    }
+    return ret == 0 ? last_rom_id(device) : -1;
+}
+
+static void bench_delete(CrocoDevice *device, int rom_id) {
+    if (rom_id < 0) {
+        return;
+    }
+    quiet_begin();
+    delete_rom(device, (uint8_t)rom_id);
+    quiet_end();
+}
+
+static void bench_saves(CrocoDevice *device, Samples *samples, int ram_banks) {
+    uint32_t bytes = (uint32_t)ram_banks * 8192;
+
+    int rom_id = bench_upload_rom(device, samples, 2 * ROM_BANK_SIZE, ram_banks);
+    if (rom_id < 0) {
+        fprintf(stderr, "Could not prepare a ROM with %d RAM banks\n", ram_banks);
+        return;
+    }
+
+    samples->opcode = 0x07;
+    samples->count = 0;
+    quiet_begin();
+    uint64_t start = monotonic_ns();
+    int ret = download_save(device, (uint8_t)rom_id, BENCH_SAV_PATH, (uint8_t)ram_banks);
+    uint64_t wall = monotonic_ns() - start;
+    quiet_end();
+    report("download_save", bytes, ram_banks, samples, wall, ret == 0);
+
+    samples->opcode = 0x09;
+    samples->count = 0;
+    quiet_begin();
+    start = monotonic_ns();
+    ret = upload_save(device, (uint8_t)rom_id, BENCH_SAV_PATH, (uint8_t)ram_banks);
+    wall = monotonic_ns() - start;
+    quiet_end();
+    report("upload_save", bytes, ram_banks, samples, wall, ret == 0);
+
+    bench_delete(device, rom_id);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--quick] [--sim[=SPEC]] [-o FILE]\n", prog);
+    fprintf(stderr, "  --quick      ROM sizes up to 512 KiB and at most 4 RAM banks\n");
+    fprintf(stderr, "  --sim[=SPEC] always use the simulator (SPEC as for CROCO_SIM)\n");
+    fprintf(stderr, "  -o FILE      write results to FILE instead of stdout\n");
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t max_rom = 8u << 20;
+    int max_ram_banks = 16;
+    const char *sim_spec = getenv("CROCO_SIM");
+    const char *out_path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            max_rom = 512u << 10;
+            max_ram_banks = 4;
+        } else if (strcmp(argv[i], "--sim") == 0) {
+            sim_spec = "1";
+        } else if (strncmp(argv[i], "--sim=", 6) == 0) {
+            sim_spec = argv[i] + 6;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    savesync_keep_history = 0;
+    setenv("CROCO_CACHE_DIR", BENCH_CACHE_DIR, 1);
+
+    results = stdout;
+    if (out_path) {
+        results = fopen(out_path, "w");
+        if (!results) {
+            fprintf(stderr, "Could not open %s\n", out_path);
+            return 1;
+        }
+    } else {
+        // stdout gets redirected while the transfer paths run
+        results = fdopen(dup(STDOUT_FILENO), "w");
+    }
+
+    CrocoDevice device = {0};
+    if (libusb_init(NULL) != 0) {
+        fprintf(stderr, "Failed to initialize libusb\n");
+        return 1;
+    }
+
+    int have_cart = 0;
+    if (!sim_spec) {
+        quiet_begin();
+        have_cart = find_croco_device(&device) == 0 &&
+                    get_endpoints(&device) == 0 && configure_device(&device) == 0;
+        quiet_end();
+        if (!have_cart) {
+            cleanup(&device);
+            memset(&device, 0, sizeof(device));
+            fprintf(stderr, "No cartridge attached, benchmarking against the simulator\n");
+        }
+    }
+
+    if (!have_cart) {
+        SimConfig config;
+        sim_config_default(&config);
+        if (sim_spec && sim_config_parse(&config, sim_spec) != 0) {
+            return 1;
+        }
+        quiet_begin();
+        int ret = sim_open(&device, &config);
+        quiet_end();
+        if (ret != 0) {
+            return 1;
+        }
+        transport_name = "sim";
+    }
+
+    Samples samples = {0};
+    latency_set_hook(collect_sample, &samples);
+
+    for (uint32_t size = 32u << 10; size <= max_rom; size *= 2) {
+        bench_delete(&device, bench_upload_rom(&device, &samples, size, 0));
+    }
+    for (int banks = 1; banks <= max_ram_banks; banks = (banks == 1) ? 4 : banks * 2) {
+        bench_saves(&device, &samples, banks);
+    }
+
+    latency_set_hook(NULL, NULL);
+    free(samples.values);
+    remove(BENCH_ROM_PATH);
+    remove(BENCH_SAV_PATH);
+
+    cleanup(&device);
+    libusb_exit(NULL);
+    fclose(results);
+    return 0;
+}
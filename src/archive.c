@@ -0,0 +1,401 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "archive.h"
+#include "backup.h"
+#include "hash.h"
+#include "romcache.h"
+#include "savesync.h"
+
+#define ARCHIVE_STAMP_LEN 16        // 20261016T120000Z
+
+typedef struct {
+    int saves;
+    int unchanged;
+    int blocks_new;
+    int blocks_seen;
+} ArchiveStats;
+
+static int archive_root(char *buf, size_t len) {
+    char dir[200];
+    if (romcache_dir(dir, sizeof(dir)) != 0) {
+        return -1;
+    }
+    snprintf(buf, len, "%s/archive", dir);
+    return 0;
+}
+
+static int make_dir(const char *path) {
+    return (mkdir(path, 0755) == 0 || errno == EEXIST) ? 0 : -1;
+}
+
+static void serial_dir(const char *root, const uint8_t *serial, char *buf, size_t len) {
+    snprintf(buf, len, "%s/%02X%02X%02X%02X%02X%02X%02X%02X", root,
+             serial[0], serial[1], serial[2], serial[3], serial[4], serial[5], serial[6], serial[7]);
+}
+
+static void block_path(const char *root, const uint8_t *hash, char *buf, size_t len) {
+    char hex[41];
+    for (int i = 0; i < 20; i++) {
+        snprintf(hex + i * 2, 3, "%02x", hash[i]);
+    }
+    snprintf(buf, len, "%s/blocks/%.2s/%s", root, hex, hex + 2);
+}
+
+// Blocks are immutable, so one that exists is never written again
+static int store_block(const char *root, const uint8_t *data, const uint8_t *hash, ArchiveStats *stats) {
+    char path[512];
+    struct stat st;
+    block_path(root, hash, path, sizeof(path));
+    stats->blocks_seen++;
+    if (stat(path, &st) == 0 && st.st_size == ARCHIVE_BLOCK_SIZE) {
+        return 0;
+    }
+
+    char dir[512];
+    snprintf(dir, sizeof(dir), "%s/blocks", root);
+    make_dir(dir);
+    snprintf(dir, sizeof(dir), "%.*s", (int)(strrchr(path, '/') - path), path);
+    if (make_dir(dir) != 0 || write_durable(path, data, ARCHIVE_BLOCK_SIZE) != 0) {
+        fprintf(stderr, "\x1b[1;31m[!] DISK ERROR: Failed to write %s\x1b[0m\n", path);
+        return -1;
+    }
+    stats->blocks_new++;
+    return 0;
+}
+
+static int snapshot_write(const char *path, const ArchiveSnapshot *snap) {
+    size_t size = ARCHIVE_HEADER_SIZE + (size_t)snap->ram_banks * 20;
+    uint8_t *buf = calloc(1, size);
+    if (!buf) {
+        return -1;
+    }
+    memcpy(buf, ARCHIVE_MAGIC, 4);
+    buf[4] = ARCHIVE_VERSION;
+    buf[5] = snap->rom_id;
+    buf[6] = snap->ram_banks;
+    for (int i = 0; i < 8; i++) {
+        buf[8 + i] = (uint8_t)((uint64_t)snap->time >> (i * 8));
+    }
+    memcpy(buf + 16, snap->name, 17);
+    memcpy(buf + ARCHIVE_HEADER_SIZE, snap->hashes, (size_t)snap->ram_banks * 20);
+
+    int ret = write_durable(path, buf, size);
+    free(buf);
+    return ret;
+}
+
+static int snapshot_read(const char *path, ArchiveSnapshot *snap) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return -1;
+    }
+    uint8_t header[ARCHIVE_HEADER_SIZE];
+    memset(snap, 0, sizeof(*snap));
+    int ok = fread(header, 1, sizeof(header), f) == sizeof(header) &&
+             memcmp(header, ARCHIVE_MAGIC, 4) == 0 && header[4] == ARCHIVE_VERSION;
+    if (ok) {
+        snap->rom_id = header[5];
+        snap->ram_banks = header[6];
+        uint64_t time = 0;
+        for (int i = 0; i < 8; i++) {
+            time |= (uint64_t)header[8 + i] << (i * 8);
+        }
+        snap->time = (int64_t)time;
+        memcpy(snap->name, header + 16, 17);
+        ok = fread(snap->hashes, 20, snap->ram_banks, f) == snap->ram_banks;
+    }
+    fclose(f);
+    return ok ? 0 : -1;
+}
+
+static int stamp_compare(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Snapshot names (<id>_<stamp>) of one slot, or of every slot with rom_id < 0, oldest first
+static int list_snapshots(const char *dir, int rom_id, char ***names) {
+    *names = NULL;
+    DIR *d = opendir(dir);
+    if (!d) {
+        return 0;
+    }
+
+    char prefix[8];
+    snprintf(prefix, sizeof(prefix), "%03d_", rom_id);
+    int count = 0, cap = 0;
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        size_t len = strlen(ent->d_name);
+        if (len < 5 || strcmp(ent->d_name + len - 5, ".snap") != 0 ||
+            (rom_id >= 0 && strncmp(ent->d_name, prefix, 4) != 0)) {
+            continue;
+        }
+        if (count == cap) {
+            cap = cap ? cap * 2 : 16;
+            char **grown = realloc(*names, cap * sizeof(char *));
+            if (!grown) {
+                break;
+            }
+            *names = grown;
+        }
+        // Without the extension, so "..Z" sorts before "..Z-2"
+        (*names)[count++] = strndup(ent->d_name, len - 5);
+    }
+    closedir(d);
+    qsort(*names, count, sizeof(char *), stamp_compare);
+    return count;
+}
+
+static void free_names(char **names, int count) {
+    for (int i = 0; i < count; i++) {
+        free(names[i]);
+    }
+    free(names);
+}
+
+int archive_find(const uint8_t *serial, uint8_t rom_id, const char *when, ArchiveSnapshot *snap, char *stamp, size_t len) {
+    char root[256], dir[300];
+    if (archive_root(root, sizeof(root)) != 0) {
+        return -1;
+    }
+    serial_dir(root, serial, dir, sizeof(dir));
+
+    char **names;
+    int count = list_snapshots(dir, rom_id, &names);
+    // A full stamp selects exactly that snapshot, not a later "-2" of the same second
+    int found = -1;
+    for (int i = count - 1; i >= 0; i--) {
+        if (strcmp(names[i] + 4, when) == 0) {
+            found = i;
+            break;
+        }
+        if (found < 0 && (strcmp(when, "latest") == 0 || strncmp(names[i] + 4, when, strlen(when)) == 0)) {
+            found = i;
+        }
+    }
+
+    int ret = -1;
+    if (found >= 0) {
+        char path[600];
+        snprintf(path, sizeof(path), "%s/%s.snap", dir, names[found]);
+        ret = snapshot_read(path, snap);
+        snprintf(stamp, len, "%s", names[found] + 4);
+    }
+    free_names(names, count);
+    return ret;
+}
+
+int archive_load_image(const ArchiveSnapshot *snap, uint8_t *data) {
+    char root[256];
+    if (archive_root(root, sizeof(root)) != 0) {
+        return -1;
+    }
+    for (int b = 0; b < snap->ram_banks; b++) {
+        char path[512];
+        block_path(root, snap->hashes[b], path, sizeof(path));
+        uint8_t *block = data + (size_t)b * ARCHIVE_BLOCK_SIZE;
+        FILE *f = fopen(path, "rb");
+        size_t got = f ? fread(block, 1, ARCHIVE_BLOCK_SIZE, f) : 0;
+        if (f) {
+            fclose(f);
+        }
+
+        uint8_t digest[20];
+        Sha1 sha;
+        sha1_init(&sha);
+        sha1_update(&sha, block, ARCHIVE_BLOCK_SIZE);
+        sha1_final(&sha, digest);
+        if (got != ARCHIVE_BLOCK_SIZE || memcmp(digest, snap->hashes[b], 20) != 0) {
+            fprintf(stderr, "\x1b[1;31m[!] Archive block for bank %d is missing or damaged: %s\x1b[0m\n", b, path);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int archive_one(CrocoDevice *device, const char *root, const char *dir, const RomInfo *info,
+                       int64_t now, ArchiveStats *stats) {
+    uint32_t size = (uint32_t)info->num_ram_banks * SRAM_BANK_SIZE;
+    uint8_t *data = malloc(size);
+    if (!data) {
+        return -1;
+    }
+    printf("\n       [\x1b[32m%3u\x1b[0m] \x1b[1;36m%-17s\x1b[0m %2u RAM banks\n", info->rom_id, info->name, info->num_ram_banks);
+    if (read_save(device, info->rom_id, info->num_ram_banks, data) != 0) {
+        free(data);
+        return -1;
+    }
+    savesync_record(device, info, data);
+
+    ArchiveSnapshot snap = {0};
+    snap.rom_id = info->rom_id;
+    snap.ram_banks = info->num_ram_banks;
+    snap.time = now;
+    snprintf(snap.name, sizeof(snap.name), "%s", info->name);
+    for (int b = 0; b < snap.ram_banks; b++) {
+        const uint8_t *block = data + (size_t)b * ARCHIVE_BLOCK_SIZE;
+        Sha1 sha;
+        sha1_init(&sha);
+        sha1_update(&sha, block, ARCHIVE_BLOCK_SIZE);
+        sha1_final(&sha, snap.hashes[b]);
+        if (store_block(root, block, snap.hashes[b], stats) != 0) {
+            free(data);
+            return -1;
+        }
+    }
+    free(data);
+    stats->saves++;
+
+    ArchiveSnapshot last;
+    char last_stamp[32];
+    if (archive_find(device->serial, info->rom_id, "latest", &last, last_stamp, sizeof(last_stamp)) == 0 &&
+        last.ram_banks == snap.ram_banks && strcmp(last.name, snap.name) == 0 &&
+        memcmp(last.hashes, snap.hashes, (size_t)snap.ram_banks * 20) == 0) {
+        printf("\r       \x1b[90munchanged since %s\x1b[0m", last_stamp);
+        stats->unchanged++;
+        return 0;
+    }
+
+    char stamp[ARCHIVE_STAMP_LEN + 1];
+    time_t t = (time_t)now;
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(stamp, sizeof(stamp), "%Y%m%dT%H%M%SZ", &tm);
+
+    // Two backups within one second get a numbered suffix, which still sorts after the first
+    char path[600];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/%03u_%s.snap", dir, info->rom_id, stamp);
+    for (int n = 2; stat(path, &st) == 0; n++) {
+        snprintf(path, sizeof(path), "%s/%03u_%s-%d.snap", dir, info->rom_id, stamp, n);
+    }
+    if (snapshot_write(path, &snap) != 0) {
+        fprintf(stderr, "\x1b[1;31m[!] DISK ERROR: Failed to write %s\x1b[0m\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+int archive_saves(CrocoDevice *device) {
+    char root[256], dir[300];
+    if (read_serial(device) != 0) {
+        fprintf(stderr, "\x1b[1;31m[!] Error: The archive needs the cartridge serial ID\x1b[0m\n");
+        return -1;
+    }
+    if (archive_root(root, sizeof(root)) != 0 || romcache_mkdir() != 0 || make_dir(root) != 0) {
+        fprintf(stderr, "\x1b[1;31m[!] ERROR: Could not create the save archive\x1b[0m\n");
+        return -1;
+    }
+    serial_dir(root, device->serial, dir, sizeof(dir));
+    if (make_dir(dir) != 0) {
+        fprintf(stderr, "\x1b[1;31m[!] ERROR: Could not create directory: %s\x1b[0m\n", dir);
+        return -1;
+    }
+
+    RomTable *table;
+    if (romcache_read_table(device, &table) != 0) {
+        fprintf(stderr, "\x1b[1;31m[!] Error: Failed to retrieve ROM utilization\x1b[0m\n");
+        return -1;
+    }
+
+    printf("\n\x1b[1;34m   [>] Archiving every save to %s...\x1b[0m\n", dir);
+    ArchiveStats stats = {0};
+    int failures = 0;
+    int64_t now = (int64_t)time(NULL);
+    for (int i = 0; i < table->num_roms; i++) {
+        if (table->roms[i].num_ram_banks && archive_one(device, root, dir, &table->roms[i], now, &stats) != 0) {
+            failures++;
+        }
+    }
+
+    printf("\n\n   \x1b[1;32m[+] %d save(s) archived, %d unchanged\x1b[0m", stats.saves, stats.unchanged);
+    if (failures) {
+        printf(", \x1b[1;31m%d failed\x1b[0m", failures);
+    }
+    printf("\n       %d of %d bank(s) were new, %d KiB written\n",
+           stats.blocks_new, stats.blocks_seen, stats.blocks_new * ARCHIVE_BLOCK_SIZE / 1024);
+    return failures ? -1 : 0;
+}
+
+int archive_list(CrocoDevice *device) {
+    char root[256], dir[300];
+    if (read_serial(device) != 0 || archive_root(root, sizeof(root)) != 0) {
+        fprintf(stderr, "\x1b[1;31m[!] Error: The archive needs the cartridge serial ID\x1b[0m\n");
+        return -1;
+    }
+    serial_dir(root, device->serial, dir, sizeof(dir));
+
+    char **names;
+    int count = list_snapshots(dir, -1, &names);
+    printf("\n   \x1b[1;34m[>] Archived saves in %s\x1b[0m\n\n", dir);
+    if (count == 0) {
+        printf("     \x1b[90m(No archived saves for this cartridge)\x1b[0m\n");
+        return 0;
+    }
+
+    printf(" \x1b[1;37m  ID   STAMP              | NAME              | BANKS\x1b[0m\n");
+    printf(" \x1b[90m  ---- ------------------ | ----------------- | -----\x1b[0m\n");
+    for (int i = 0; i < count; i++) {
+        char path[600];
+        ArchiveSnapshot snap;
+        snprintf(path, sizeof(path), "%s/%s.snap", dir, names[i]);
+        if (snapshot_read(path, &snap) != 0) {
+            continue;
+        }
+        printf("   [\x1b[32m%3u\x1b[0m] %-18s | \x1b[1;36m%-17s\x1b[0m | %5u\n",
+               snap.rom_id, names[i] + 4, snap.name, snap.ram_banks);
+    }
+    free_names(names, count);
+    return 0;
+}
+
+int archive_restore(CrocoDevice *device, uint8_t rom_id, const char *when) {
+    ArchiveSnapshot snap;
+    char stamp[32];
+    if (read_serial(device) != 0 || archive_find(device->serial, rom_id, when, &snap, stamp, sizeof(stamp)) != 0) {
+        fprintf(stderr, "\x1b[1;31m[!] No archived save of ROM %u matches '%s'\x1b[0m\n", rom_id, when);
+        return -1;
+    }
+
+    RomInfo info;
+    if (romcache_get_info(device, rom_id, &info) != 0) {
+        fprintf(stderr, "\x1b[1;31m   [!] Error: Could not retrieve info for ID %u\x1b[0m\n", rom_id);
+        return -1;
+    }
+    if (info.num_ram_banks != snap.ram_banks) {
+        fprintf(stderr, "\x1b[1;31m[!] ROM %u has %u RAM banks, the snapshot %u\x1b[0m\n", rom_id, info.num_ram_banks, snap.ram_banks);
+        return -1;
+    }
+    if (strcmp(info.name, snap.name) != 0) {
+        if (!device->allow_foreign_saves) {
+            fprintf(stderr, "\x1b[1;31m[!] Snapshot was taken from '%s', slot %u now holds '%s' (--allow-foreign restores it anyway)\x1b[0m\n",
+                    snap.name, rom_id, info.name);
+            return -1;
+        }
+        printf("\x1b[1;33m[!] WARNING: Snapshot was taken from '%s', slot %u now holds '%s'\x1b[0m\n", snap.name, rom_id, info.name);
+    }
+
+    uint32_t size = (uint32_t)snap.ram_banks * ARCHIVE_BLOCK_SIZE;
+    uint8_t *data = malloc(size);
+    if (!data || archive_load_image(&snap, data) != 0) {
+        free(data);
+        return -1;
+    }
+
+    printf("\n\x1b[1;34m   [>] Restoring archived save %s...\x1b[0m\n", stamp);
+    printf("       Target ROM ID: \x1b[1;36m%u\x1b[0m (%s)\n", rom_id, snap.name);
+    int ret = write_save(device, rom_id, snap.ram_banks, data, size);
+    if (ret == 0) {
+        savesync_record_slot(device, rom_id, snap.ram_banks, data, size);
+    }
+    free(data);
+    if (ret == 0) {
+        printf("\n\n   \x1b[1;32m[+] Save restored from the archive\x1b[0m\n");
+    }
+    return ret;
+}
@@ -0,0 +1,37 @@
+#ifndef CROCO_ARCHIVE_H
+#define CROCO_ARCHIVE_H
+
+#include "croco.h"
+
+// Content-addressed save archive in <cache dir>/archive. Each SRAM bank is a
+// block stored once under its SHA-1 in blocks/<2 hex>/<38 hex>; a backup is a
+// snapshot listing the hashes of its banks, stored as
+// <SERIAL>/<id>_<YYYYMMDDTHHMMSSZ>.snap. A save identical to the latest
+// snapshot of its slot writes nothing at all.
+
+#define ARCHIVE_MAGIC "CRSA"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_HEADER_SIZE 36      // magic | version u8 | rom id u8 | banks u8 | reserved u8 | time s64 LE | name[17] | 3 reserved
+#define ARCHIVE_BLOCK_SIZE SRAM_BANK_SIZE
+
+typedef struct {
+    uint8_t rom_id;
+    uint8_t ram_banks;
+    int64_t time;               // Unix seconds
+    char name[18];
+    uint8_t hashes[256][20];    // one SHA-1 per bank
+} ArchiveSnapshot;
+
+// Batch operations
+int archive_saves(CrocoDevice *device);
+int archive_list(CrocoDevice *device);
+// when is "latest", a stamp, or a prefix of one; the newest match wins. A
+// snapshot taken from another ROM name is refused unless allow_foreign_saves is set.
+int archive_restore(CrocoDevice *device, uint8_t rom_id, const char *when);
+
+// Reassembles a snapshot into data (ram_banks * ARCHIVE_BLOCK_SIZE bytes), checking every block hash
+int archive_load_image(const ArchiveSnapshot *snap, uint8_t *data);
+// The snapshot of a slot that when selects; -1 if there is none
+int archive_find(const uint8_t *serial, uint8_t rom_id, const char *when, ArchiveSnapshot *snap, char *stamp, size_t len);
+
+#endif
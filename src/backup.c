@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "backup.h"
+#include "romcache.h"
+#include "savesync.h"
+#include "lzpack.h"
+#include "transport.h"
+
+// Bulk save backup. The USB side reads one save after another over the chunk
+// pipeline and hands each finished image to a writer thread, which packs it,
+// writes it to a temp file, fsyncs and renames, then updates the slot's shadow
+// and timeline. The bounded queue keeps memory
+// flat; the reader only blocks when the disk falls BACKUP_QUEUE_DEPTH saves behind.
+
+typedef struct {
+    char path[512];
+    RomInfo info;
+    uint8_t *data;
+    uint32_t size;
+} BackupItem;
+
+typedef struct {
+    CrocoDevice *device;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    BackupItem items[BACKUP_QUEUE_DEPTH];
+    int head;
+    int count;
+    int closed;
+    int written;
+    int failures;
+    uint64_t raw_bytes;
+    uint64_t packed_bytes;
+} BackupWriter;
+
+// "<dir>/<id>_<name>.sav.crlz" with the display name reduced to filename-safe characters
+static void save_file_name(char *buf, size_t len, const char *dir, const RomInfo *info) {
+    char name[18];
+    int n = 0;
+    for (int i = 0; i < 17 && info->name[i]; i++) {
+        unsigned char c = (unsigned char)info->name[i];
+        name[n++] = (isalnum(c) || c == '-' || c == '.') ? (char)c : '_';
+    }
+    while (n > 0 && name[n - 1] == '_') {
+        n--;
+    }
+    name[n] = '\0';
+
+    snprintf(buf, len, "%s/%03u_%s.sav" LZPACK_SUFFIX, dir, info->rom_id, n ? name : "rom");
+}
+
+int write_durable(const char *path, const uint8_t *data, size_t size) {
+    char tmp[520];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = write(fd, data + done, size - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            close(fd);
+            unlink(tmp);
+            return -1;
+        }
+        done += (size_t)n;
+    }
+
+    if (fsync(fd) != 0 || close(fd) != 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+static void *writer_main(void *arg) {
+    BackupWriter *writer = arg;
+
+    for (;;) {
+        pthread_mutex_lock(&writer->lock);
+        while (writer->count == 0 && !writer->closed) {
+            pthread_cond_wait(&writer->cond, &writer->lock);
+        }
+        if (writer->count == 0) {
+            pthread_mutex_unlock(&writer->lock);
+            return NULL;
+        }
+        BackupItem item = writer->items[writer->head];
+        pthread_mutex_unlock(&writer->lock);
+
+        // The slot stays occupied until the file is on disk so the queue bounds memory
+        long packed_size = lzpack_save(item.path, item.data, item.size);
+        int ok = packed_size >= 0;
+        if (!ok) {
+            fprintf(stderr, "\x1b[1;31m[!] DISK ERROR: Failed to write %s\x1b[0m\n", item.path);
+        }
+        savesync_record(writer->device, &item.info, item.data);
+        free(item.data);
+
+        pthread_mutex_lock(&writer->lock);
+        writer->head = (writer->head + 1) % BACKUP_QUEUE_DEPTH;
+        writer->count--;
+        if (ok) {
+            writer->written++;
+            writer->raw_bytes += item.size;
+            writer->packed_bytes += packed_size;
+        } else {
+            writer->failures++;
+        }
+        pthread_cond_broadcast(&writer->cond);
+        pthread_mutex_unlock(&writer->lock);
+    }
+}
+
+static void writer_push(BackupWriter *writer, const char *path, const RomInfo *info, uint8_t *data, uint32_t size) {
+    pthread_mutex_lock(&writer->lock);
+    while (writer->count == BACKUP_QUEUE_DEPTH) {
+        pthread_cond_wait(&writer->cond, &writer->lock);
+    }
+    BackupItem *item = &writer->items[(writer->head + writer->count) % BACKUP_QUEUE_DEPTH];
+    snprintf(item->path, sizeof(item->path), "%s", path);
+    item->info = *info;
+    item->data = data;
+    item->size = size;
+    writer->count++;
+    pthread_cond_broadcast(&writer->cond);
+    pthread_mutex_unlock(&writer->lock);
+}
+
+static void sync_dir(const char *dir) {
+    int fd = open(dir, O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+int backup_all(CrocoDevice *device, const char *dir) {
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "\x1b[1;31m[!] ERROR: Could not create directory: %s\x1b[0m\n", dir);
+        return -1;
+    }
+
+    RomTable *table;
+    if (romcache_read_table(device, &table) != 0) {
+        fprintf(stderr, "\x1b[1;31m[!] Error: Failed to retrieve ROM utilization\x1b[0m\n");
+        return -1;
+    }
+
+    // The writer files shadows and timelines under the serial and must not ask the cartridge for it
+    read_serial(device);
+
+    BackupWriter writer = {0};
+    writer.device = device;
+    pthread_mutex_init(&writer.lock, NULL);
+    pthread_cond_init(&writer.cond, NULL);
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, writer_main, &writer) != 0) {
+        fprintf(stderr, "\x1b[1;31m[!] Error: Could not start writer thread\x1b[0m\n");
+        return -1;
+    }
+
+    printf("\n\x1b[1;34m   [>] Backing up every save to %s...\x1b[0m\n", dir);
+
+    int read_failures = 0;
+    uint64_t start_ns = monotonic_ns();
+    for (int i = 0; i < table->num_roms; i++) {
+        RomInfo info = table->roms[i];
+        if (info.num_ram_banks == 0) {
+            continue;
+        }
+
+        uint32_t size = info.num_ram_banks * SRAM_BANK_SIZE;
+        uint8_t *data = malloc(size);
+        if (!data) {
+            read_failures++;
+            continue;
+        }
+
+        printf("\n       [\x1b[32m%3u\x1b[0m] \x1b[1;36m%-17s\x1b[0m %2u RAM banks\n", info.rom_id, info.name, info.num_ram_banks);
+        if (read_save(device, info.rom_id, info.num_ram_banks, data) != 0) {
+            free(data);
+            read_failures++;
+            continue;
+        }
+
+        char path[512];
+        save_file_name(path, sizeof(path), dir, &info);
+        writer_push(&writer, path, &info, data, size);
+    }
+    uint64_t usb_ns = monotonic_ns() - start_ns;
+
+    pthread_mutex_lock(&writer.lock);
+    writer.closed = 1;
+    pthread_cond_broadcast(&writer.cond);
+    pthread_mutex_unlock(&writer.lock);
+    pthread_join(thread, NULL);
+    pthread_mutex_destroy(&writer.lock);
+    pthread_cond_destroy(&writer.cond);
+    sync_dir(dir);
+
+    int failures = read_failures + writer.failures;
+    double seconds = usb_ns / 1e9;
+    printf("\n\n   \x1b[1;32m[+] %d save(s) backed up to %s\x1b[0m", writer.written, dir);
+    if (failures) {
+        printf(", \x1b[1;31m%d failed\x1b[0m", failures);
+    }
+    printf("\n       %llu KiB read in %.2f s (%.1f KiB/s), packed to %llu KiB\n",
+           (unsigned long long)(writer.raw_bytes / 1024), seconds,
+           seconds > 0 ? writer.raw_bytes / 1024.0 / seconds : 0.0,
+           (unsigned long long)((writer.packed_bytes + 1023) / 1024));
+    return failures ? -1 : 0;
+}
@@ -0,0 +1,14 @@
+#ifndef CROCO_BACKUP_H
+#define CROCO_BACKUP_H
+
+#include "croco.h"
+
+#define BACKUP_QUEUE_DEPTH 4        // saves read ahead of the writer before USB stalls
+
+// Downloads the save of every ROM with RAM into dir as <id>_<name>.sav.crlz.
+// Packing and fsync run on a writer thread while the next save is read.
+int backup_all(CrocoDevice *device, const char *dir);
+// Temp file, fsync, rename: the file is either complete or absent
+int write_durable(const char *path, const uint8_t *data, size_t size);
+
+#endif
@@ -0,0 +1,405 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "batch.h"
+#include "archive.h"
+#include "backup.h"
+#include "flashqueue.h"
+#include "library.h"
+#include "lzpack.h"
+#include "manifest.h"
+#include "metrics.h"
+#include "planner.h"
+#include "response.h"
+#include "romcache.h"
+#include "savesync.h"
+#include "timeline.h"
+
+// Non-interactive front end. Operations have a fixed arity, so several of
+// them can follow each other on one command line and all run over the same
+// claimed interface:
+//
+//   croco_cli flash snake.gb Snake list backup --all saves/
+
+void batch_usage(FILE *out, const char *prog) {
+    fprintf(out, "Usage: %s [--keep-going] [--force] [--allow-foreign] [--trust-shadow] [--all-carts | --watch] <operation> [<operation> ...]\n\n", prog);
+    fprintf(out, "Operations:\n");
+    fprintf(out, "  list                    List the ROMs on the cartridge\n");
+    fprintf(out, "  info                    Show firmware and hardware details\n");
+    fprintf(out, "  flash <rom> <name>      Flash a ROM under a display name (max 17 chars, - for the header title);\n"
+                 "                          <rom> may be @<query> to pick it from the library\n");
+    fprintf(out, "  flash-all <manifest>    Flash every ROM of a manifest back to back\n");
+    fprintf(out, "  resume <rom>            Continue an interrupted flash of <rom>\n");
+    fprintf(out, "  delete <id>             Delete a ROM and its save\n");
+    fprintf(out, "  plan <manifest>         Show which ROMs of a manifest fit on the cartridge by priority\n");
+    fprintf(out, "  backup <id> <sav>       Download the save of one ROM\n");
+    fprintf(out, "  backup-all <dir>        Download every save into <dir> (also: backup --all)\n");
+    fprintf(out, "  restore <id> <sav>      Upload a save to one ROM\n");
+    fprintf(out, "  sync <id> <sav>         Upload only the parts of a save that differ from the cartridge\n");
+    fprintf(out, "  archive                 Add every save to the deduplicating save archive\n");
+    fprintf(out, "  archive-list            List the archived saves of the cartridge\n");
+    fprintf(out, "  archive-restore <id> <when>  Upload an archived save (latest or a stamp prefix)\n");
+    fprintf(out, "  timeline <id>           List every recorded save of one ROM\n");
+    fprintf(out, "  timeline-restore <id> <when>  Upload the save as of a point in time (latest, @<n>,\n"
+                 "                          or a stamp prefix: the newest point at or before it)\n");
+    fprintf(out, "  timing                  Print per-opcode response latency\n");
+    fprintf(out, "  metrics <file>          Write per-opcode counters so far (.prom: Prometheus, else JSON)\n");
+    fprintf(out, "  scan <dir>              Add every .gb/.gbc below <dir> to the ROM library index\n");
+    fprintf(out, "  find <query>            Search the library: title text, crc:<hex>, sha1:<hex>, mbc:<type>\n");
+    fprintf(out, "  pack <in> <out>         Compress a ROM or save into a .crlz file\n");
+    fprintf(out, "  unpack <in> <out>       Expand a .crlz file back to the raw image\n\n");
+    fprintf(out, "Operations run in order and stop at the first failure unless --keep-going is given.\n");
+    fprintf(out, "Flashes are checked against the free banks before the first one starts.\n");
+    fprintf(out, ".crlz ROMs and saves are accepted wherever a file is read; backup to a .crlz name compresses.\n");
+    fprintf(out, "--force flashes ROMs whose header or checksums do not match the file, or that do not all fit.\n");
+    fprintf(out, "--allow-foreign restores archived saves and timeline points recorded from another ROM name.\n");
+    fprintf(out, "--trust-shadow lets sync send only what differs from the last save read or written here.\n");
+    fprintf(out, "--all-carts runs them on every attached cartridge concurrently; only flash, flash-all,\n");
+    fprintf(out, "resume, delete, backup-all (one subdirectory per serial), restore, sync, archive,\n");
+    fprintf(out, "archive-restore and timeline-restore are allowed there.\n");
+    fprintf(out, "--watch waits for cartridges to be plugged in and runs them on each, until Ctrl-C.\n");
+    fprintf(out, "Without arguments the interactive menu starts.\n");
+}
+
+const char *batch_op_name(BatchKind kind) {
+    switch (kind) {
+        case BATCH_LIST: return "list";
+        case BATCH_INFO: return "info";
+        case BATCH_FLASH: return "flash";
+        case BATCH_FLASH_ALL: return "flash-all";
+        case BATCH_RESUME: return "resume";
+        case BATCH_DELETE: return "delete";
+        case BATCH_BACKUP: return "backup";
+        case BATCH_BACKUP_ALL: return "backup-all";
+        case BATCH_RESTORE: return "restore";
+        case BATCH_SYNC: return "sync";
+        case BATCH_ARCHIVE: return "archive";
+        case BATCH_ARCHIVE_LIST: return "archive-list";
+        case BATCH_ARCHIVE_RESTORE: return "archive-restore";
+        case BATCH_TIMELINE: return "timeline";
+        case BATCH_TIMELINE_RESTORE: return "timeline-restore";
+        case BATCH_TIMING: return "timing";
+        case BATCH_METRICS: return "metrics";
+        case BATCH_SCAN: return "scan";
+        case BATCH_FIND: return "find";
+        case BATCH_PLAN: return "plan";
+        case BATCH_PACK: return "pack";
+        case BATCH_UNPACK: return "unpack";
+    }
+    return "?";
+}
+
+static int parse_rom_id(const char *text) {
+    char *end;
+    errno = 0;
+    long val = strtol(text, &end, 10);
+    if (errno != 0 || *end != '\0' || end == text || val < 0 || val > 255) {
+        return -1;
+    }
+    return (int)val;
+}
+
+int batch_parse(int argc, char *argv[], BatchPlan *plan) {
+    memset(plan, 0, sizeof(*plan));
+    plan->ops = calloc(argc, sizeof(BatchOp));
+    if (!plan->ops) {
+        return -1;
+    }
+
+    int i = 1;
+    while (i < argc) {
+        const char *word = argv[i++];
+        BatchOp *op = &plan->ops[plan->count];
+        int nargs = 0;
+
+        if (strcmp(word, "--keep-going") == 0) {
+            plan->keep_going = 1;
+            continue;
+        } else if (strcmp(word, "--force") == 0) {
+            plan->force = 1;
+            continue;
+        } else if (strcmp(word, "--allow-foreign") == 0) {
+            plan->allow_foreign = 1;
+            continue;
+        } else if (strcmp(word, "--trust-shadow") == 0) {
+            plan->trust_shadow = 1;
+            continue;
+        } else if (strcmp(word, "--all-carts") == 0) {
+            plan->all_carts = 1;
+            continue;
+        } else if (strcmp(word, "--watch") == 0) {
+            plan->watch = 1;
+            continue;
+        } else if (strcmp(word, "list") == 0) {
+            op->kind = BATCH_LIST;
+        } else if (strcmp(word, "info") == 0) {
+            op->kind = BATCH_INFO;
+        } else if (strcmp(word, "timing") == 0) {
+            op->kind = BATCH_TIMING;
+        } else if (strcmp(word, "metrics") == 0) {
+            op->kind = BATCH_METRICS;
+            nargs = 1;
+        } else if (strcmp(word, "scan") == 0) {
+            op->kind = BATCH_SCAN;
+            nargs = 1;
+        } else if (strcmp(word, "find") == 0) {
+            op->kind = BATCH_FIND;
+            nargs = 1;
+        } else if (strcmp(word, "plan") == 0) {
+            op->kind = BATCH_PLAN;
+            nargs = 1;
+        } else if (strcmp(word, "pack") == 0) {
+            op->kind = BATCH_PACK;
+            nargs = 2;
+        } else if (strcmp(word, "unpack") == 0) {
+            op->kind = BATCH_UNPACK;
+            nargs = 2;
+        } else if (strcmp(word, "flash") == 0) {
+            op->kind = BATCH_FLASH;
+            nargs = 2;
+        } else if (strcmp(word, "flash-all") == 0) {
+            op->kind = BATCH_FLASH_ALL;
+            nargs = 1;
+        } else if (strcmp(word, "resume") == 0) {
+            op->kind = BATCH_RESUME;
+            nargs = 1;
+        } else if (strcmp(word, "delete") == 0) {
+            op->kind = BATCH_DELETE;
+            nargs = 1;
+        } else if (strcmp(word, "backup") == 0) {
+            op->kind = BATCH_BACKUP;
+            nargs = 2;
+            if (i < argc && strcmp(argv[i], "--all") == 0) {
+                op->kind = BATCH_BACKUP_ALL;
+                i++;
+                nargs = 1;
+            }
+        } else if (strcmp(word, "backup-all") == 0) {
+            op->kind = BATCH_BACKUP_ALL;
+            nargs = 1;
+        } else if (strcmp(word, "restore") == 0) {
+            op->kind = BATCH_RESTORE;
+            nargs = 2;
+        } else if (strcmp(word, "sync") == 0) {
+            op->kind = BATCH_SYNC;
+            nargs = 2;
+        } else if (strcmp(word, "archive") == 0) {
+            op->kind = BATCH_ARCHIVE;
+        } else if (strcmp(word, "archive-list") == 0) {
+            op->kind = BATCH_ARCHIVE_LIST;
+        } else if (strcmp(word, "archive-restore") == 0) {
+            op->kind = BATCH_ARCHIVE_RESTORE;
+            nargs = 2;
+        } else if (strcmp(word, "timeline") == 0) {
+            op->kind = BATCH_TIMELINE;
+            nargs = 1;
+        } else if (strcmp(word, "timeline-restore") == 0) {
+            op->kind = BATCH_TIMELINE_RESTORE;
+            nargs = 2;
+        } else {
+            fprintf(stderr, "Unknown operation: %s\n", word);
+            batch_free(plan);
+            return -1;
+        }
+
+        if (i + nargs > argc) {
+            fprintf(stderr, "Missing arguments for '%s'\n", word);
+            batch_free(plan);
+            return -1;
+        }
+        for (int a = 0; a < nargs; a++) {
+            op->arg[a] = argv[i++];
+        }
+
+        if ((op->kind == BATCH_DELETE || op->kind == BATCH_BACKUP || op->kind == BATCH_RESTORE ||
+             op->kind == BATCH_SYNC || op->kind == BATCH_ARCHIVE_RESTORE || op->kind == BATCH_TIMELINE ||
+             op->kind == BATCH_TIMELINE_RESTORE) &&
+            parse_rom_id(op->arg[0]) < 0) {
+            fprintf(stderr, "Invalid ROM ID for '%s': %s\n", word, op->arg[0]);
+            batch_free(plan);
+            return -1;
+        }
+        if (op->kind == BATCH_FLASH && strlen(op->arg[1]) > 17) {
+            fprintf(stderr, "Display name too long (max 17 chars): %s\n", op->arg[1]);
+            batch_free(plan);
+            return -1;
+        }
+
+        plan->count++;
+    }
+
+    if (plan->count == 0) {
+        fprintf(stderr, "No operation given\n");
+        batch_free(plan);
+        return -1;
+    }
+
+    if (plan->all_carts && plan->watch) {
+        fprintf(stderr, "--all-carts and --watch cannot be combined\n");
+        batch_free(plan);
+        return -1;
+    }
+
+    // Sessions run with their output captured, so only operations whose result is the report make sense
+    for (int k = 0; (plan->all_carts || plan->watch) && k < plan->count; k++) {
+        BatchKind kind = plan->ops[k].kind;
+        if (kind == BATCH_LIST || kind == BATCH_INFO || kind == BATCH_TIMING || kind == BATCH_BACKUP ||
+            kind == BATCH_METRICS || kind == BATCH_SCAN || kind == BATCH_FIND || kind == BATCH_PLAN ||
+            kind == BATCH_ARCHIVE_LIST || kind == BATCH_TIMELINE || kind == BATCH_PACK || kind == BATCH_UNPACK) {
+            fprintf(stderr, "'%s' is not available with %s\n", batch_op_name(kind), plan->watch ? "--watch" : "--all-carts");
+            batch_free(plan);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void batch_free(BatchPlan *plan) {
+    free(plan->ops);
+    plan->ops = NULL;
+    plan->count = 0;
+}
+
+static int save_ram_banks(CrocoDevice *device, uint8_t rom_id) {
+    RomInfo info;
+    if (romcache_get_info(device, rom_id, &info) != 0) {
+        fprintf(stderr, "\x1b[1;31m   [!] Error: Could not retrieve info for ID %u\x1b[0m\n", rom_id);
+        return -1;
+    }
+    if (info.num_ram_banks == 0) {
+        fprintf(stderr, "\x1b[1;33m   [!] ROM %u has no RAM banks (no save).\x1b[0m\n", rom_id);
+        return -1;
+    }
+    return info.num_ram_banks;
+}
+
+int batch_needs_device(const BatchPlan *plan) {
+    for (int i = 0; i < plan->count; i++) {
+        BatchKind kind = plan->ops[i].kind;
+        if (kind != BATCH_SCAN && kind != BATCH_FIND && kind != BATCH_TIMING && kind != BATCH_METRICS &&
+            kind != BATCH_PACK && kind != BATCH_UNPACK) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int batch_run_op(CrocoDevice *device, const BatchOp *op) {
+    int banks;
+
+    switch (op->kind) {
+        case BATCH_LIST:
+            return list_games(device, 0);
+        case BATCH_INFO:
+            return get_device_info(device);
+        case BATCH_TIMING:
+            latency_print(stdout);
+            return 0;
+        case BATCH_METRICS:
+            return metrics_dump(op->arg[0]);
+        case BATCH_SCAN:
+            return library_scan_dir(op->arg[0]);
+        case BATCH_FIND:
+            return library_print(op->arg[0]);
+        case BATCH_PLAN:
+            return plan_cartridge(device, op->arg[0]);
+        case BATCH_PACK:
+            return lzpack_pack_file(op->arg[0], op->arg[1]);
+        case BATCH_UNPACK:
+            return lzpack_unpack_file(op->arg[0], op->arg[1]);
+        case BATCH_FLASH:
+            return upload_rom(device, op->arg[0], op->arg[1]);
+        case BATCH_FLASH_ALL:
+            return flash_queue(device, op->arg[0]);
+        case BATCH_RESUME:
+            return resume_rom(device, op->arg[0]);
+        case BATCH_DELETE:
+            return delete_rom(device, (uint8_t)parse_rom_id(op->arg[0]));
+        case BATCH_BACKUP:
+            banks = save_ram_banks(device, (uint8_t)parse_rom_id(op->arg[0]));
+            if (banks < 0) {
+                return -1;
+            }
+            return download_save(device, (uint8_t)parse_rom_id(op->arg[0]), op->arg[1], (uint8_t)banks);
+        case BATCH_BACKUP_ALL:
+            return backup_all(device, op->arg[0]);
+        case BATCH_RESTORE:
+            banks = save_ram_banks(device, (uint8_t)parse_rom_id(op->arg[0]));
+            if (banks < 0) {
+                return -1;
+            }
+            return upload_save(device, (uint8_t)parse_rom_id(op->arg[0]), op->arg[1], (uint8_t)banks);
+        case BATCH_SYNC:
+            return savesync_upload(device, (uint8_t)parse_rom_id(op->arg[0]), op->arg[1]);
+        case BATCH_ARCHIVE:
+            return archive_saves(device);
+        case BATCH_ARCHIVE_LIST:
+            return archive_list(device);
+        case BATCH_ARCHIVE_RESTORE:
+            return archive_restore(device, (uint8_t)parse_rom_id(op->arg[0]), op->arg[1]);
+        case BATCH_TIMELINE:
+            return timeline_list(device, (uint8_t)parse_rom_id(op->arg[0]));
+        case BATCH_TIMELINE_RESTORE:
+            return timeline_restore(device, (uint8_t)parse_rom_id(op->arg[0]), op->arg[1]);
+    }
+    return -1;
+}
+
+// The flashes of a plan that only adds ROMs must all fit, or none is started
+static int check_capacity(CrocoDevice *device, const BatchPlan *plan) {
+    Manifest manifest = { calloc(MANIFEST_MAX_ENTRIES, sizeof(ManifestEntry)), 0 };
+    if (!manifest.entries) {
+        return -1;
+    }
+    for (int i = 0; i < plan->count; i++) {
+        const BatchOp *op = &plan->ops[i];
+        if (op->kind == BATCH_DELETE || op->kind == BATCH_RESUME) {
+            manifest_free(&manifest);
+            return 0;
+        }
+        // An unresolvable @query or manifest is left for its own operation to report
+        if (op->kind == BATCH_FLASH) {
+            manifest_add(&manifest, op->arg[0], op->arg[1], 1, i + 1);
+        }
+        Manifest list;
+        if (op->kind == BATCH_FLASH_ALL && manifest_load(op->arg[0], &list) == 0) {
+            for (int k = 0; k < list.count; k++) {
+                manifest_add(&manifest, list.entries[k].path, list.entries[k].name, 1, list.entries[k].line);
+            }
+            manifest_free(&list);
+        }
+    }
+
+    int ret = manifest.count > 0 ? planner_check(device, &manifest) : 0;
+    manifest_free(&manifest);
+    return ret;
+}
+
+int batch_run(CrocoDevice *device, const BatchPlan *plan) {
+    int failures = 0;
+
+    if (device && !plan->force && check_capacity(device, plan) != 0) {
+        return 1;
+    }
+    if (device) {
+        device->allow_foreign_saves = plan->allow_foreign;
+    }
+
+    // A metrics operation needs the counters running from the first command
+    for (int i = 0; i < plan->count; i++) {
+        if (plan->ops[i].kind == BATCH_METRICS) {
+            metrics_enable();
+        }
+    }
+
+    for (int i = 0; i < plan->count; i++) {
+        if (batch_run_op(device, &plan->ops[i]) != 0) {
+            failures++;
+            if (!plan->keep_going) {
+                break;
+            }
+        }
+    }
+    return failures;
+}
@@ -0,0 +1,58 @@
+#ifndef CROCO_BATCH_H
+#define CROCO_BATCH_H
+
+#include "croco.h"
+
+typedef enum {
+    BATCH_LIST,
+    BATCH_INFO,
+    BATCH_FLASH,
+    BATCH_FLASH_ALL,
+    BATCH_RESUME,
+    BATCH_DELETE,
+    BATCH_BACKUP,
+    BATCH_BACKUP_ALL,
+    BATCH_RESTORE,
+    BATCH_SYNC,
+    BATCH_ARCHIVE,
+    BATCH_ARCHIVE_LIST,
+    BATCH_ARCHIVE_RESTORE,
+    BATCH_TIMELINE,
+    BATCH_TIMELINE_RESTORE,
+    BATCH_TIMING,
+    BATCH_METRICS,
+    BATCH_SCAN,
+    BATCH_FIND,
+    BATCH_PLAN,
+    BATCH_PACK,
+    BATCH_UNPACK,
+} BatchKind;
+
+typedef struct {
+    BatchKind kind;
+    const char *arg[2];
+} BatchOp;
+
+typedef struct {
+    BatchOp *ops;
+    int count;
+    int keep_going;     // run the remaining operations after a failure
+    int force;          // skip the ROM header and capacity pre-flight checks
+    int allow_foreign;  // restore archived saves and timeline points recorded from another ROM name
+    int trust_shadow;   // sync diffs against the shadow instead of sending the whole save
+    int all_carts;      // run the plan on every attached cartridge at once
+    int watch;          // run the plan on each cartridge as it is plugged in
+} BatchPlan;
+
+void batch_usage(FILE *out, const char *prog);
+const char *batch_op_name(BatchKind kind);
+// Validates the whole command line before the device is touched
+int batch_parse(int argc, char *argv[], BatchPlan *plan);
+// Library operations work without a cartridge; a plan of only those opens none
+int batch_needs_device(const BatchPlan *plan);
+int batch_run_op(CrocoDevice *device, const BatchOp *op);
+// Runs every operation over the one open session; returns the number of failures
+int batch_run(CrocoDevice *device, const BatchPlan *plan);
+void batch_free(BatchPlan *plan);
+
+#endif
@@ -0,0 +1,923 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include "croco.h"
+#include "journal.h"
+#include "library.h"
+#include "lzpack.h"
+#include "pipeline.h"
+#include "romcache.h"
+#include "romheader.h"
+#include "romimage.h"
+#include "savepack.h"
+#include "savesync.h"
+#include "timeline.h"
+
+// Per-bank progress counters; batch mode turns them off when stdout is not a terminal
+int show_progress = 1;
+
+// Cleared by --force for homebrew with a stale header
+int check_rom_header = 1;
+
+// Bank counters go to the session lane when the device has one, else onto the current line
+static void report_progress(CrocoDevice *device, const char *stage, uint32_t done, uint32_t total) {
+    if (device->progress) {
+        device->progress(device->progress_user, stage, done, total);
+    } else if (show_progress) {
+        printf("\r       \x1b[1;33m%s:\x1b[0m [\x1b[1;32m%u\x1b[0m/\x1b[1;32m%u\x1b[0m] ... ", stage, done, total);
+        fflush(stdout);
+    }
+}
+
+int list_games(CrocoDevice *device, int mode) {
+    printf("\n   \x1b[1;34m[>] Fetching Cartridge Memory...\x1b[0m\n");
+
+    RomTable *table;
+    if (romcache_read_table(device, &table) != 0) {
+        fprintf(stderr, "\x1b[1;31m[!] Error: Failed to retrieve ROM utilization\x1b[0m\n");
+        return -1;
+    }
+
+    uint8_t num_roms = table->num_roms;
+    uint16_t used_banks = table->used_raw;
+    uint16_t max_banks = table->max_banks;
+    float percent = ((float)used_banks / max_banks) * 100;
+    
+    if (mode != 1) {
+        printf("   \x1b[1;33m+-------------------------------------------------------------+\x1b[0m\n");
+        printf("     Storage: [\x1b[1;32m%u/%u Banks\x1b[0m] used (%.1f%% full)\n", used_banks, max_banks, percent);
+        printf("     Capacity: %u Games Registered\n", num_roms);
+        printf("   \x1b[1;33m+-------------------------------------------------------------+\x1b[0m\n\n");
+
+        if (num_roms == 0) {
+            printf("     \x1b[90m(No ROMs found on cartridge memory)\x1b[0m\n");
+            return 0;
+        }
+    }
+
+    printf(" \x1b[1;37m  ID   NAME                     | ROM SIZE   | RAM     | MBC \x1b[0m\n");
+    printf(" \x1b[90m  ---- ------------------------ | ---------- | ------- | ----\x1b[0m\n");
+
+    for (int i = 0; i < num_roms; i++) {
+        const RomInfo *info = &table->roms[i];
+
+        printf("   [\x1b[32m%2u\x1b[0m]  \x1b[1;36m%-23s\x1b[0m | \x1b[33m%3u Banks \x1b[0m | RAM: %2u | MBC: 0x%02X\n",
+            i, 
+            info->name, 
+            info->num_rom_banks,
+            info->num_ram_banks, 
+            info->mbc);
+    }
+    printf(" \x1b[90m  -------------------------------------------------------------\x1b[0m\n");
+
+    return 0;
+}
+
+int get_device_info(CrocoDevice *device) {
+    printf("\n   \x1b[1;34m[>] Accessing Hardware Registers...\x1b[0m\n\n");
+
+    uint8_t response[15];
+    int bytes = execute_command(device, 0xFE, NULL, 0, response, sizeof(response));
+
+    if (bytes < 11) {
+        printf("   \x1b[1;31m[!] CRITICAL ERROR: Hardware communication timeout.\x1b[0m\n");
+        return -1;
+    }
+
+    // Header for the Hardware Card
+    printf("   \x1b[1;37mCROCO HARDWARE MANIFEST\x1b[0m\n");
+    printf("   \x1b[90m=============================================================\x1b[0m\n");
+
+    // Feature and Hardware version
+    printf("    \x1b[1m%-15s\x1b[0m %u\n", "Feature Step:", response[0]);
+    printf("    \x1b[1m%-15s\x1b[0m v%u\n", "HW Revision:", response[1]);
+
+    // Software version with a nice color highlight
+    printf("    \x1b[1m%-15s\x1b[0m \x1b[32m%u.%u.%u%c\x1b[0m\n", 
+           "Firmware:", response[2], response[3], response[4], response[5]);
+
+    // Git Hash
+    uint32_t git_hash = (response[6] << 24) | (response[7] << 16) | (response[8] << 8) | response[9];
+    printf("    \x1b[1m%-15s\x1b[0m \x1b[36m#%08x\x1b[0m\n", "Git Commit:", git_hash);
+
+    // Git Dirty (Red if dirty, Green if clean)
+    const char* dirty_label = response[10] ? "\x1b[31mYES (Modified)\x1b[0m" : "\x1b[32mNO (Clean)\x1b[0m";
+    printf("    \x1b[1m%-15s\x1b[0m %s\n", "Git Dirty:", dirty_label);
+
+    // Get serial ID (command 0xFD)
+    if (read_serial(device) == 0) {
+        printf("    \x1b[1m%-15s\x1b[0m \x1b[1;33m", "Serial ID:");
+        for (int i = 0; i < 8; i++) {
+            printf("%02X", device->serial[i]);
+        }
+        printf("\x1b[0m\n");
+    }
+
+    printf("   \x1b[90m=============================================================\x1b[0m\n");
+
+    return 0;
+}
+typedef struct {
+    RomImage *image;
+    uint16_t total_banks;
+    FlashJournal *journal;      // checkpointed after every bank, NULL without a serial
+    CrocoDevice *device;
+    uint32_t pad_seq;           // first chunk of the trailing fill run, sent as 0x0C per bank
+    uint8_t pad_value;
+} RomUpload;
+
+// Chunks past EOF are zero-filled; a .crlz block that no longer decodes fails the stream
+static int fill_rom_chunk(void *user, uint32_t seq, uint8_t *payload) {
+    RomUpload *upload = user;
+    long offset = (long)seq * CHUNK_DATA_SIZE;
+    long avail = 0;
+    const uint8_t *data = rom_image_at(upload->image, offset, &avail);
+    if (!data && offset < upload->image->size) {
+        return -1;
+    }
+    pipeline_frame_chunk(payload, seq / ROM_CHUNKS_PER_BANK, seq % ROM_CHUNKS_PER_BANK, data, avail);
+    return 0;
+}
+
+// Extends hash over [from, to) of the image, a window at a time
+static int hash_rom_range(RomImage *image, long from, long to, uint32_t *hash) {
+    to = to < image->size ? to : image->size;
+    while (from < to) {
+        long avail;
+        const uint8_t *data = rom_image_at(image, from, &avail);
+        if (!data) {
+            return -1;
+        }
+        long len = avail < to - from ? avail : to - from;
+        *hash = journal_hash(*hash, data, len);
+        from += len;
+    }
+    return 0;
+}
+
+// The journal hash covers exactly the acknowledged prefix, so it can be
+// extended bank by bank instead of reading the whole ROM up front
+static void journal_checkpoint(RomUpload *upload, uint32_t acked) {
+    FlashJournal *journal = upload->journal;
+    if (!journal) {
+        return;
+    }
+    if (acked < journal->acked) {
+        journal->acked = 0;
+        journal->rom_hash = JOURNAL_HASH_INIT;
+    }
+
+    uint32_t hash = journal->rom_hash;
+    if (hash_rom_range(upload->image, (long)journal->acked * CHUNK_DATA_SIZE, (long)acked * CHUNK_DATA_SIZE, &hash) != 0) {
+        return;
+    }
+    journal->rom_hash = hash;
+    journal->acked = acked;
+    journal_save(upload->device->serial, journal);
+}
+
+static void rom_bank_progress(void *user, uint32_t acked) {
+    RomUpload *upload = user;
+    if (acked % ROM_CHUNKS_PER_BANK != 0) {
+        return;
+    }
+    if (upload->journal && acked > upload->journal->acked) {
+        journal_checkpoint(upload, acked);
+    }
+    rom_image_advance(upload->image, acked / ROM_CHUNKS_PER_BANK);
+    if (acked / ROM_CHUNKS_PER_BANK < upload->total_banks) {
+        report_progress(upload->device, "Writing Bank", acked / ROM_CHUNKS_PER_BANK + 1, upload->total_banks);
+    }
+}
+
+// Finds the trailing run of one byte value in the bank-padded image. Chunks
+// past EOF are zero-filled, homebrew usually pads with 0xFF up to there.
+static void plan_rom_padding(CrocoDevice *device, RomUpload *upload) {
+    uint32_t total = (uint32_t)upload->total_banks * ROM_CHUNKS_PER_BANK;
+    upload->pad_seq = total;
+    if (!(device->caps & CROCO_CAP_FILL_BANK)) {
+        return;
+    }
+
+    // The zeros past EOF join the file's own trailing run only if that is zeros too
+    const RomImage *image = upload->image;
+    uint8_t value = image->tail_value;
+    long run = image->tail_start;
+    if (image->size < (long)total * CHUNK_DATA_SIZE && value != 0x00) {
+        value = 0x00;
+        run = image->size;
+    }
+
+    upload->pad_seq = (uint32_t)((run + CHUNK_DATA_SIZE - 1) / CHUNK_DATA_SIZE);
+    upload->pad_value = value;
+}
+
+static void print_rom_padding(const RomUpload *upload) {
+    uint32_t total = (uint32_t)upload->total_banks * ROM_CHUNKS_PER_BANK;
+    if (upload->pad_seq < total) {
+        printf("       Padding: \x1b[1;33m%u chunks\x1b[0m of 0x%02X filled by the cartridge\n",
+               total - upload->pad_seq, upload->pad_value);
+    }
+}
+
+// Command 0x0C: Fill Bank, for every bank the trailing run touches from `from` on
+static int fill_rom_padding(CrocoDevice *device, RomUpload *upload, uint32_t from, PipelineJob *job) {
+    uint32_t total = (uint32_t)upload->total_banks * ROM_CHUNKS_PER_BANK;
+    uint32_t seq = from > upload->pad_seq ? from : upload->pad_seq;
+
+    while (seq < total) {
+        uint8_t payload[5];
+        uint16_t be_b = htons(seq / ROM_CHUNKS_PER_BANK);
+        uint16_t be_c = htons(seq % ROM_CHUNKS_PER_BANK);
+        memcpy(payload, &be_b, 2);
+        memcpy(payload + 2, &be_c, 2);
+        payload[4] = upload->pad_value;
+
+        uint8_t resp = 0xFF;
+        if (execute_command(device, 0x0C, payload, sizeof(payload), &resp, 1) < 1 || resp != 0) {
+            // The capability promised 0x0C but the cartridge refused it or never answered:
+            // the padding goes out as ordinary chunks, starting with the rest of this bank
+            printf("\n\x1b[1;33m   [i] Fill Bank not accepted at Bank %u (Code: %d), sending the padding as data\x1b[0m\n",
+                   seq / ROM_CHUNKS_PER_BANK, resp);
+            uint8_t stale[64];
+            while (drain_response(device, stale, sizeof(stale)) > 0) {
+            }
+            job->start_seq = seq;
+            job->total_chunks = total;
+            return pipeline_send_chunks(device, job);
+        }
+
+        seq += ROM_CHUNKS_PER_BANK - seq % ROM_CHUNKS_PER_BANK;
+        job->acked = seq;
+        rom_bank_progress(upload, seq);
+    }
+    return 0;
+}
+
+static int request_rom_upload(CrocoDevice *device, const char *rom_name, uint16_t total_banks) {
+    // Command 0x02: Request Upload
+    uint8_t req_payload[21] = {0};
+    uint16_t be_banks = htons(total_banks);
+    memcpy(req_payload, &be_banks, 2);
+    strncpy((char*)(req_payload + 2), rom_name, 17);
+    uint16_t speed_switch = htons(0xFFFF);
+    memcpy(req_payload + 19, &speed_switch, 2);
+
+    uint8_t resp;
+    if (execute_command(device, 0x02, req_payload, 21, &resp, 1) < 0 || resp != 0) {
+        fprintf(stderr, "\x1b[1;31m[!] Upload request rejected by cartridge (Error: %d)\x1b[0m\n", resp);
+        return -1;
+    }
+    return 0;
+}
+
+// Acks still queued on the IN endpoint after a stream was aborted. The leading
+// successful ones are for chunks the cartridge took after the last ack we read.
+static uint32_t collect_late_acks(CrocoDevice *device, uint8_t command) {
+    uint8_t buf[64];
+    uint32_t late = 0;
+    int counting = 1;
+    int len;
+
+    while ((len = drain_response(device, buf, sizeof(buf))) > 0) {
+        if (counting && len >= 2 && buf[0] == command && buf[1] == 0) {
+            late++;
+        } else {
+            counting = 0;
+        }
+    }
+    return late;
+}
+
+// Command 0x03: Send Chunks, from start_seq on
+static int send_rom_chunks(CrocoDevice *device, RomUpload *upload, uint32_t start_seq, PipelineJob *job) {
+    memset(job, 0, sizeof(*job));
+    job->command = 0x03;
+    job->total_chunks = upload->pad_seq;
+    job->start_seq = start_seq < upload->pad_seq ? start_seq : upload->pad_seq;
+    job->window = PIPELINE_DEFAULT_WINDOW;
+    job->fill = fill_rom_chunk;
+    job->progress = rom_bank_progress;
+    job->user = upload;
+
+    rom_bank_progress(upload, start_seq - start_seq % ROM_CHUNKS_PER_BANK);
+    if (pipeline_send_chunks(device, job) == 0 && fill_rom_padding(device, upload, start_seq, job) == 0) {
+        return 0;
+    }
+
+    // Late acks only extend a stream the link cut short. After a refused or
+    // misordered ack they belong to chunks behind one the cartridge never wrote.
+    uint32_t late = collect_late_acks(device, 0x03);
+    if (job->failed_status == PIPELINE_LINK_ERROR && job->failed_seq == job->acked) {
+        job->acked += late;
+    } else if (job->failed_seq < job->acked) {
+        job->acked = job->failed_seq;
+    }
+    journal_checkpoint(upload, job->acked);
+    return -1;
+}
+
+static void print_flash_success(void) {
+    printf("\n\n\x1b[1;32m   =================================================\x1b[0m\n");
+    printf("\x1b[1;32m       SUCCESS: ROM flashed to cartridge memory!\x1b[0m\n");
+    printf("\x1b[1;32m   =================================================\x1b[0m\n");
+}
+
+static void print_flash_failure(const RomUpload *upload, const PipelineJob *job, const char *file_path) {
+    printf("\n\x1b[1;31m[!] WRITE ERROR at Bank %u, Chunk %u\x1b[0m\n",
+           job->failed_seq / ROM_CHUNKS_PER_BANK, job->failed_seq % ROM_CHUNKS_PER_BANK);
+    if (upload->journal) {
+        printf("\x1b[1;33m    Progress saved at Bank %u, Chunk %u. Resume with 'resume %s' or menu option [r].\x1b[0m\n",
+               job->acked / ROM_CHUNKS_PER_BANK, job->acked % ROM_CHUNKS_PER_BANK, file_path);
+    }
+}
+
+// Everything the header can tell is checked before the upload request, so a
+// damaged file fails here rather than after the last bank
+int preflight_rom(const RomImage *image, RomHeader *header) {
+    *header = image->header;
+    if (!image->has_header) {
+        if (!check_rom_header) {
+            return 0;
+        }
+        printf("\x1b[1;31m[!] %s is too small to hold a Game Boy header (%ld bytes)\x1b[0m\n", image->path, image->size);
+    } else if (!check_rom_header || romheader_verify(header, image->size, 1) == 0) {
+        return 0;
+    }
+    printf("\x1b[1;33m    Nothing was sent. Use --force to flash it anyway.\x1b[0m\n");
+    return -1;
+}
+
+// The header title, or the file name when the header has none
+const char *default_rom_name(const char *file_path, const RomHeader *header, char *name, size_t len) {
+    if (header->title[0]) {
+        snprintf(name, len, "%s", header->title);
+        return name;
+    }
+    const char *base = strrchr(file_path, '/');
+    base = base ? base + 1 : file_path;
+    snprintf(name, len, "%.*s", (int)strcspn(base, "."), base);
+    return name;
+}
+
+int upload_rom(CrocoDevice *device, const char *file_path, const char *rom_name) {
+    // @<query> picks the ROM from the library index (see src/library.c)
+    char library_path[512];
+    if (file_path[0] == '@') {
+        if (library_resolve(file_path + 1, library_path, sizeof(library_path)) != 0) {
+            return -1;
+        }
+        file_path = library_path;
+    }
+
+    RomImage image;
+    if (rom_image_open(file_path, &image) != 0) {
+        return -1;
+    }
+
+    RomHeader header;
+    char title[18];
+    if (preflight_rom(&image, &header) != 0) {
+        rom_image_close(&image);
+        return -1;
+    }
+    if (!rom_name || strcmp(rom_name, "-") == 0) {
+        rom_name = default_rom_name(file_path, &header, title, sizeof(title));
+    }
+
+    long file_size = image.size;
+    uint16_t total_banks = (uint16_t)((file_size + ROM_BANK_SIZE - 1) / ROM_BANK_SIZE);
+
+    printf("\n\x1b[1;34m   [>] Initializing Data Stream...\x1b[0m\n");
+    printf("       Target:  \x1b[1;36m%s\x1b[0m\n", rom_name);
+    if (file_path == library_path) {
+        printf("       Source:  \x1b[90m%s\x1b[0m\n", file_path);
+    }
+    printf("       Size:    \x1b[1;33m%ld bytes\x1b[0m (%u banks)\n", file_size, total_banks);
+    if (header.rom_banks) {
+        printf("       Header:  \x1b[1;33m%s\x1b[0m (0x%02X), %u ROM banks, %u RAM banks\n",
+               romheader_mbc_name(header.cart_type), header.cart_type, header.rom_banks, header.ram_banks);
+    }
+
+    if (flash_rom_image(device, &image, rom_name, 0) != 0) {
+        rom_image_close(&image);
+        return -1;
+    }
+
+    print_flash_success();
+    rom_image_close(&image);
+    romcache_after_upload(device);
+    return 0;
+}
+
+int flash_rom_image(CrocoDevice *device, RomImage *image, const char *rom_name, int quiet) {
+    long size = image->size;
+    uint16_t total_banks = (uint16_t)((size + ROM_BANK_SIZE - 1) / ROM_BANK_SIZE);
+
+    // The serial keys the checkpoint journal; flashing still works without one
+    FlashJournal journal = {0};
+    RomUpload upload = { image, total_banks, NULL, device, 0, 0 };
+    plan_rom_padding(device, &upload);
+    if (!quiet) {
+        print_rom_padding(&upload);
+    }
+    // The summary before 0x02 tells a later resume whether this upload left an entry behind
+    if (read_serial(device) == 0 && romcache_read_summary(device, &journal.roms_before, &journal.used_before, NULL) == 0) {
+        snprintf(journal.name, sizeof(journal.name), "%s", rom_name);
+        journal.rom_size = (uint32_t)size;
+        journal.rom_hash = JOURNAL_HASH_INIT;
+        journal.total_banks = total_banks;
+        upload.journal = &journal;
+    }
+
+    if (request_rom_upload(device, rom_name, total_banks) != 0) {
+        return -1;
+    }
+    if (!quiet) {
+        printf("\n\x1b[1;32m   [+] Handshake successful. Uploading data...\x1b[0m\n\n");
+    }
+
+    if (upload.journal) {
+        journal_save(device->serial, &journal);
+    }
+
+    PipelineJob job;
+    if (send_rom_chunks(device, &upload, 0, &job) != 0) {
+        print_flash_failure(&upload, &job, image->path);
+        return -1;
+    }
+    if (upload.journal) {
+        journal_clear(device->serial);
+    }
+    return 0;
+}
+
+// Puts the ROM table back to the summary the journal recorded before 0x02.
+// An entry the interrupted upload registered is deleted; any other change
+// means something else wrote the cartridge since, and nothing is touched.
+static int discard_partial_rom(CrocoDevice *device, const FlashJournal *journal) {
+    uint8_t num_roms;
+    uint16_t used_raw;
+    if (romcache_read_summary(device, &num_roms, &used_raw, NULL) != 0) {
+        fprintf(stderr, "\x1b[1;31m[!] No summary from the cartridge\x1b[0m\n");
+        return -1;
+    }
+
+    if (num_roms == journal->roms_before + 1) {
+        RomInfo info;
+        if (romcache_get_info(device, journal->roms_before, &info) == 0 &&
+            strncmp(info.name, journal->name, 17) == 0 &&
+            (info.num_rom_banks == 0 || info.num_rom_banks == journal->total_banks)) {
+            printf("\x1b[1;33m   [i] Removing the incomplete '%s' entry at ID %u\x1b[0m\n", journal->name, journal->roms_before);
+            if (delete_rom(device, journal->roms_before) != 0 ||
+                romcache_read_summary(device, &num_roms, &used_raw, NULL) != 0) {
+                return -1;
+            }
+        }
+    }
+
+    if (num_roms != journal->roms_before || used_raw != journal->used_before) {
+        printf("\x1b[1;31m[!] The cartridge changed since '%s' was being flashed (%u ROMs, %u banks; %u ROMs, %u banks before).\x1b[0m\n",
+               journal->name, num_roms, used_raw, journal->roms_before, journal->used_before);
+        printf("\x1b[1;33m    Nothing was sent. Flash it again with 'flash'.\x1b[0m\n");
+        return -1;
+    }
+    return 0;
+}
+
+int resume_rom(CrocoDevice *device, const char *file_path) {
+    FlashJournal journal;
+    if (read_serial(device) != 0 || journal_load(device->serial, &journal) != 0) {
+        printf("\x1b[1;33m[!] No interrupted flash is recorded for this cartridge.\x1b[0m\n");
+        return -1;
+    }
+
+    RomImage image;
+    if (rom_image_open(file_path, &image) != 0) {
+        return -1;
+    }
+
+    // Only the prefix already on the cartridge has to match
+    uint32_t hash = JOURNAL_HASH_INIT;
+    if ((uint32_t)image.size != journal.rom_size ||
+        hash_rom_range(&image, 0, (long)journal.acked * CHUNK_DATA_SIZE, &hash) != 0 || hash != journal.rom_hash) {
+        printf("\x1b[1;31m[!] %s is not the ROM that was being flashed as '%s'.\x1b[0m\n", file_path, journal.name);
+        rom_image_close(&image);
+        return -1;
+    }
+    if (image.map) {
+        long prefix = (long)journal.acked * CHUNK_DATA_SIZE;
+        madvise((void *)image.map, prefix < image.size ? prefix : image.size, MADV_DONTNEED);
+    }
+
+    RomUpload upload = { &image, journal.total_banks, &journal, device, 0, 0 };
+
+    // Acks the interrupted run never read may still be waiting on the endpoint
+    uint32_t late = collect_late_acks(device, 0x03);
+    if (late) {
+        journal_checkpoint(&upload, journal.acked + late);
+    }
+    uint32_t start = journal.acked;
+
+    printf("\n\x1b[1;34m   [>] Resuming Data Stream...\x1b[0m\n");
+    printf("       Target:  \x1b[1;36m%s\x1b[0m\n", journal.name);
+    printf("       Resume:  \x1b[1;33mBank %u, Chunk %u\x1b[0m (%u banks)\n\n",
+           start / ROM_CHUNKS_PER_BANK, start % ROM_CHUNKS_PER_BANK, journal.total_banks);
+
+    plan_rom_padding(device, &upload);
+    print_rom_padding(&upload);
+    PipelineJob job;
+    int ret = send_rom_chunks(device, &upload, start, &job);
+
+    // Flash is programmed a bank at a time, so a refused chunk may mean the
+    // partially written bank is gone; its first chunk reopens it
+    if (ret != 0 && job.acked == start && job.failed_status > 0 && start % ROM_CHUNKS_PER_BANK != 0) {
+        uint32_t bank_start = start - start % ROM_CHUNKS_PER_BANK;
+        printf("\n\x1b[1;33m   [i] Cartridge refused Chunk %u, replaying Bank %u\x1b[0m\n",
+               start % ROM_CHUNKS_PER_BANK, bank_start / ROM_CHUNKS_PER_BANK);
+        journal_checkpoint(&upload, bank_start);
+        start = bank_start;
+        ret = send_rom_chunks(device, &upload, bank_start, &job);
+    }
+
+    // Still refused: the upload is not open any more. Start over, but only on
+    // a cartridge that looks like it did before the first 0x02.
+    if (ret != 0 && job.acked == start && job.failed_status > 0) {
+        printf("\n\x1b[1;33m   [i] The cartridge no longer takes this upload, flashing again from Bank 0\x1b[0m\n");
+        if (discard_partial_rom(device, &journal) != 0 ||
+            request_rom_upload(device, journal.name, journal.total_banks) != 0) {
+            rom_image_close(&image);
+            return -1;
+        }
+        journal_checkpoint(&upload, 0);
+        ret = send_rom_chunks(device, &upload, 0, &job);
+    }
+
+    if (ret != 0) {
+        print_flash_failure(&upload, &job, file_path);
+        rom_image_close(&image);
+        return -1;
+    }
+
+    print_flash_success();
+    rom_image_close(&image);
+    journal_clear(device->serial);
+    romcache_after_upload(device);
+    return 0;
+}
+
+int delete_rom(CrocoDevice *device, uint8_t rom_id) {
+    printf("      Attempting to delete ROM ID: %u...\n", rom_id);
+
+    uint8_t payload = rom_id;
+    uint8_t response[2];
+
+    // Command 0x05: deleteRom
+    int bytes = execute_command(device, 0x05, &payload, 1, response, sizeof(response));
+
+    if (bytes < 1) {
+        fprintf(stderr, "Error: No response from cartridge during delete.\n");
+        return -1;
+    }
+
+    if (response[0] != 0) {
+        fprintf(stderr, "\x1b[1;31mDelete failed! Cartridge rejected command with code: %d\x1b[0m\n", response[0]);
+        return -1;
+    }
+
+    printf("      \x1b[1;32mSuccessfully deleted ROM %u and its save file.\x1b[0m\n", rom_id);
+    romcache_after_delete(device, rom_id);
+    // The slots above shift down, so their sync shadows no longer line up
+    for (int id = rom_id; id < ROM_TABLE_MAX; id++) {
+        savesync_forget(device, (uint8_t)id);
+    }
+    timeline_after_delete(device, rom_id);
+    return 0;
+}
+
+// Recovery for 0x07 streams. Every reply carries its bank/chunk tag, so
+// chunks are placed by tag rather than by arrival order: a stale packet ahead
+// of the stream only shifts replies by one, and the shifted-out tail is picked
+// up by draining the endpoint. Chunks that never arrive are requested again,
+// and if the cartridge already ended its stream a fresh one is opened and
+// only the gaps are kept.
+#define SAVE_MAX_RETRIES 3
+
+typedef struct {
+    CrocoDevice *device;
+    uint8_t *data;
+    uint8_t total_banks;
+    uint8_t *have;          // one flag per chunk
+    uint32_t received;      // distinct chunks stored
+    int pass;
+    int closed;             // the cartridge answered 0x07 with an error status
+    uint32_t stale;         // untagged or duplicate packets dropped
+    uint32_t realigned;     // chunks that arrived in another slot than requested
+    uint32_t rerequested;
+    uint32_t restarts;
+} SaveDownload;
+
+static int store_save_chunk(void *user, uint32_t seq, const uint8_t *response, int len) {
+    SaveDownload *save = user;
+
+    if (response[0] == 0x07 && len >= 2 && len < 1 + CHUNK_PAYLOAD_SIZE) {
+        save->closed = 1;
+        return 0;
+    }
+    if (response[0] != 0x07 || len < 1 + CHUNK_PAYLOAD_SIZE) {
+        save->stale++;
+        return 0;
+    }
+
+    uint16_t received_b = (uint16_t)((response[1] << 8) | response[2]);
+    uint16_t received_c = (uint16_t)((response[3] << 8) | response[4]);
+    uint32_t tag = (uint32_t)received_b * SRAM_CHUNKS_PER_BANK + received_c;
+    if (received_b >= save->total_banks || received_c >= SRAM_CHUNKS_PER_BANK || save->have[tag]) {
+        save->stale++;
+        return 0;
+    }
+
+    if (save->pass == 0 && tag != seq) {
+        save->realigned++;
+    }
+    memcpy(save->data + tag * CHUNK_DATA_SIZE, response + 5, CHUNK_DATA_SIZE);
+    save->have[tag] = 1;
+    save->received++;
+    return 0;
+}
+
+// Replies a failed pass never collected are still valid chunks
+static void drain_save_packets(CrocoDevice *device, SaveDownload *save) {
+    uint8_t buf[64];
+    int len;
+    while ((len = drain_response(device, buf, sizeof(buf))) > 0) {
+        store_save_chunk(save, UINT32_MAX, buf, len);
+    }
+}
+
+static void print_save_progress(void *user, uint32_t acked) {
+    SaveDownload *save = user;
+    if (save->pass != 0 || acked % SRAM_CHUNKS_PER_BANK != 0 ||
+        acked / SRAM_CHUNKS_PER_BANK >= save->total_banks) {
+        return;
+    }
+    report_progress(save->device, "Reading Bank", acked / SRAM_CHUNKS_PER_BANK + 1, save->total_banks);
+}
+
+static int request_save_download(CrocoDevice *device, uint8_t rom_id, SaveDownload *save) {
+    // Command 0x06: Request Save Download
+    uint8_t resp = 0xFF;
+    int ret = execute_command(device, 0x06, &rom_id, 1, &resp, 1);
+
+    if (ret < 0) {
+        // A stale packet may have been read in place of the reply, which is then still queued
+        uint8_t buf[64];
+        int len;
+        while ((len = drain_response(device, buf, sizeof(buf))) > 0) {
+            if (buf[0] == 0x06 && len >= 2) {
+                resp = buf[1];
+                ret = 1;
+            } else {
+                save->stale++;
+            }
+        }
+        if (ret < 0) {
+            // The request never reached the cartridge, so asking again is safe
+            save->rerequested++;
+            ret = execute_command(device, 0x06, &rom_id, 1, &resp, 1);
+        } else {
+            save->stale++;
+        }
+    }
+
+    if (ret < 0 || resp != 0) {
+        printf("\x1b[1;31m[!] Download request rejected (Code: %d)\x1b[0m\n", resp);
+        return -1;
+    }
+    return 0;
+}
+
+// Command 0x07: Receive Chunks. Errors are left to the caller's gap check.
+static void run_save_pass(CrocoDevice *device, SaveDownload *save, uint32_t requests) {
+    PipelineJob job = {0};
+    job.command = 0x07;
+    job.total_chunks = requests;
+    job.window = PIPELINE_DEFAULT_WINDOW;
+    job.receive = store_save_chunk;
+    job.progress = print_save_progress;
+    job.user = save;
+
+    print_save_progress(save, 0);
+    if (pipeline_send_chunks(device, &job) != 0 || save->received < requests) {
+        drain_save_packets(device, save);
+    }
+}
+
+int read_save(CrocoDevice *device, uint8_t rom_id, uint8_t num_ram_banks, uint8_t *buffer) {
+    uint32_t total = (uint32_t)num_ram_banks * SRAM_CHUNKS_PER_BANK;
+    SaveDownload save = {0};
+    save.device = device;
+    save.data = buffer;
+    save.total_banks = num_ram_banks;
+    save.have = calloc(total, 1);
+    if (!save.have) {
+        return -1;
+    }
+
+    if (request_save_download(device, rom_id, &save) != 0) {
+        free(save.have);
+        return -1;
+    }
+    run_save_pass(device, &save, total);
+
+    while (save.received < total && save.pass < SAVE_MAX_RETRIES) {
+        uint32_t requests = total - save.received;
+        save.pass++;
+        if (save.closed) {
+            // The cartridge finished its stream; open a new one and keep only the gaps
+            if (request_save_download(device, rom_id, &save) != 0) {
+                break;
+            }
+            save.closed = 0;
+            save.restarts++;
+            requests = total;
+        }
+        save.rerequested += total - save.received;
+        run_save_pass(device, &save, requests);
+    }
+
+    if (save.stale || save.realigned || save.rerequested) {
+        printf("\n\x1b[1;33m   [i] Link recovery: %u stale packet(s) dropped, %u chunk(s) realigned, "
+               "%u re-requested, %u stream restart(s)\x1b[0m",
+               save.stale, save.realigned, save.rerequested, save.restarts);
+    }
+
+    if (save.received < total) {
+        uint32_t first = 0;
+        while (save.have[first]) {
+            first++;
+        }
+        printf("\n\x1b[1;31m[!] READ ERROR at Bank %u, Chunk %u (%u chunk(s) missing after %d retries)\x1b[0m\n",
+               first / SRAM_CHUNKS_PER_BANK, first % SRAM_CHUNKS_PER_BANK, total - save.received, save.pass);
+        printf("    \x1b[1;33mAdvice: Check the USB connection and avoid unpowered hubs.\x1b[0m\n");
+        free(save.have);
+        return -1;
+    }
+
+    free(save.have);
+    return 0;
+}
+
+int download_save(CrocoDevice *device, uint8_t rom_id, const char *dest_path, uint8_t num_ram_banks) {
+    // A destination ending in .crlz gets the compressed container instead of the raw image
+    LzWriter *packed = NULL;
+    FILE *f = NULL;
+    if (lzpack_wants(dest_path)) {
+        packed = lzpack_create(dest_path);
+    } else {
+        f = fopen(dest_path, "wb");
+    }
+    if (!f && !packed) {
+        printf("\x1b[1;31m[!] ERROR: Could not create save file: %s\x1b[0m\n", dest_path);
+        return -1;
+    }
+
+    uint32_t total_size = num_ram_banks * SRAM_BANK_SIZE;
+
+    printf("\n\x1b[1;34m   [>] Requesting Savegame Data...\x1b[0m\n");
+    printf("       ROM ID:  \x1b[1;36m%u\x1b[0m\n", rom_id);
+    printf("       Size:    \x1b[1;33m%u bytes\x1b[0m (%u RAM banks)\n\n", total_size, num_ram_banks);
+
+    uint8_t *data = malloc(total_size);
+    int ok = data && read_save(device, rom_id, num_ram_banks, data) == 0;
+    if (ok) {
+        savesync_record_slot(device, rom_id, num_ram_banks, data, total_size);
+    }
+    int written = 0;
+    if (ok && packed) {
+        if (lzpack_write(packed, data, total_size) == 0) {
+            written = lzpack_close(packed) == 0;
+            packed = NULL;
+        }
+    } else if (ok) {
+        written = fwrite(data, 1, total_size, f) == total_size;
+    }
+    free(data);
+    if (packed) {
+        lzpack_abort(packed);
+    }
+    if (f) {
+        written = (fclose(f) == 0) && written;
+    }
+
+    if (!ok) {
+        return -1;
+    }
+    if (!written) {
+        printf("\n\x1b[1;31m[!] DISK ERROR: Failed to write to save file.\x1b[0m\n");
+        return -1;
+    }
+
+    printf("\n\n\x1b[1;32m   =================================================\x1b[0m\n");
+    printf("\x1b[1;32m       SUCCESS: Savegame dumped to %s\x1b[0m\n", dest_path);
+    printf("\x1b[1;32m   =================================================\x1b[0m\n");
+    return 0;
+}
+
+int upload_save(CrocoDevice *device, uint8_t rom_id, const char *file_path, uint8_t num_ram_banks) {
+    // Packed backups from backup-all are unpacked transparently
+    uint8_t *file_data;
+    long actual_size;
+    if (savepack_load(file_path, &file_data, &actual_size) != 0) {
+        printf("\x1b[1;31m[!] ERROR: Could not open save file: %s\x1b[0m\n", file_path);
+        return -1;
+    }
+
+    uint32_t expected_size = num_ram_banks * SRAM_BANK_SIZE;
+    if (actual_size < expected_size) {
+        printf("\x1b[1;33m[!] WARNING: File is smaller than expected (%ld < %u bytes). Padding with zeros.\x1b[0m\n", actual_size, expected_size);
+    }
+
+    printf("\n\x1b[1;34m   [>] Initializing Save Upload...\x1b[0m\n");
+    printf("       Target ROM ID: \x1b[1;36m%u\x1b[0m\n", rom_id);
+    printf("       Total Upload:  \x1b[1;33m%u bytes\x1b[0m\n", expected_size);
+
+    if (write_save(device, rom_id, num_ram_banks, file_data, actual_size) != 0) {
+        free(file_data);
+        return -1;
+    }
+    savesync_record_slot(device, rom_id, num_ram_banks, file_data, actual_size);
+
+    printf("\n\n\x1b[1;32m   =================================================\x1b[0m\n");
+    printf("\x1b[1;32m       SUCCESS: Savegame uploaded to cartridge!\x1b[0m\n");
+    printf("\x1b[1;32m   =================================================\x1b[0m\n");
+
+    free(file_data);
+    return 0;
+}
+
+typedef struct {
+    CrocoDevice *device;
+    const uint8_t *data;
+    long size;
+    const uint32_t *chunks;     // chunk sent at each stream position; NULL for every chunk in order
+    uint8_t total_banks;
+} SaveUpload;
+
+static int fill_save_chunk(void *user, uint32_t seq, uint8_t *payload) {
+    SaveUpload *upload = user;
+    uint32_t chunk = upload->chunks ? upload->chunks[seq] : seq;
+    long offset = (long)chunk * CHUNK_DATA_SIZE;
+    pipeline_frame_chunk(payload, chunk / SRAM_CHUNKS_PER_BANK, chunk % SRAM_CHUNKS_PER_BANK,
+                         upload->data + (offset < upload->size ? offset : 0), upload->size - offset);
+    return 0;
+}
+
+static void save_bank_progress(void *user, uint32_t acked) {
+    SaveUpload *upload = user;
+    if (!upload->chunks && acked % SRAM_CHUNKS_PER_BANK == 0 && acked / SRAM_CHUNKS_PER_BANK < upload->total_banks) {
+        report_progress(upload->device, "Writing Bank", acked / SRAM_CHUNKS_PER_BANK + 1, upload->total_banks);
+    }
+}
+
+int send_save_chunks(CrocoDevice *device, uint8_t num_ram_banks, const uint8_t *data, long size,
+                     const uint32_t *chunks, uint32_t count) {
+    SaveUpload upload = { device, data, size, chunks, num_ram_banks };
+    PipelineJob job = {0};
+    job.command = 0x09;
+    job.total_chunks = chunks ? count : (uint32_t)num_ram_banks * SRAM_CHUNKS_PER_BANK;
+    job.window = PIPELINE_DEFAULT_WINDOW;
+    job.fill = fill_save_chunk;
+    job.progress = save_bank_progress;
+    job.user = &upload;
+
+    save_bank_progress(&upload, 0);
+    if (pipeline_send_chunks(device, &job) == 0) {
+        return 0;
+    }
+
+    uint32_t chunk = chunks ? chunks[job.failed_seq < count ? job.failed_seq : count - 1] : job.failed_seq;
+    printf("\n\x1b[1;31m[!] WRITE ERROR at Bank %u, Chunk %u\x1b[0m\n", chunk / SRAM_CHUNKS_PER_BANK, chunk % SRAM_CHUNKS_PER_BANK);
+    collect_late_acks(device, 0x09);
+    return -1;
+}
+
+int write_save(CrocoDevice *device, uint8_t rom_id, uint8_t num_ram_banks, const uint8_t *data, long size) {
+    // Command 0x08: Request Save Upload
+    uint8_t resp;
+    if (execute_command(device, 0x08, &rom_id, 1, &resp, 1) < 0 || resp != 0) {
+        printf("\x1b[1;31m[!] Upload request rejected by cartridge (Code: %d)\x1b[0m\n", resp);
+        return -1;
+    }
+    printf("\x1b[1;32m   [+] Handshake successful. Sending SRAM data...\x1b[0m\n\n");
+
+    if (send_save_chunks(device, num_ram_banks, data, size, NULL, 0) != 0) {
+        savesync_forget(device, rom_id);
+        return -1;
+    }
+
+    return 0;
+}
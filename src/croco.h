@@ -0,0 +1,105 @@
+#ifndef CROCO_H
+#define CROCO_H
+
+#include <stdint.h>
+#include <libusb.h>
+#include "romheader.h"
+
+#define CROCO_VENDOR_ID  0x2e8a
+#define CROCO_PRODUCT_ID 0x107F
+#define TIMEOUT_MS 5000
+#define DRAIN_TIMEOUT_MS 20     // an idle IN endpoint is empty after this long
+
+#define ROM_BANK_SIZE 16384
+#define CROCO_MAX_ROM_BANKS 888 // flash capacity when the 0x01 summary does not report one
+#define ROM_CHUNKS_PER_BANK 512
+#define CHUNK_DATA_SIZE 32
+#define SRAM_BANK_SIZE 8192
+#define SRAM_CHUNKS_PER_BANK 256
+
+// Protocol extensions no released firmware implements. The 0xFE feature step
+// numbers the firmware's own roadmap, so they are never inferred from it: the
+// simulator declares what it implements, a trace replays what its capture
+// had, and CROCO_FIRMWARE_CAPS=fill,... opts a real cartridge in.
+#define CROCO_CAP_FILL_BANK 0x01    // 0x0C fills the rest of a ROM bank with one byte value
+#define CROCO_CAP_SPARSE_SAVE 0x02  // 0x09 may skip chunks forward; skipped chunks keep their SRAM contents
+
+typedef struct CrocoTransport CrocoTransport;
+typedef struct RomTable RomTable;
+typedef struct RomImage RomImage;
+typedef struct TraceWriter TraceWriter;
+typedef struct PipelineRing PipelineRing;
+
+typedef struct {
+    libusb_context *usb_ctx;          // this cartridge's own context; only its session thread handles events on it
+    libusb_device_handle *dev;
+    uint16_t vendor_id;
+    uint16_t product_id;
+    uint8_t out_ep;
+    uint8_t in_ep;
+    int if_num;
+    const CrocoTransport *transport;  // NULL means the libusb backend
+    void *backend;                    // transport private state
+    uint8_t serial[8];                // 0xFD serial ID, valid once has_serial is set
+    int has_serial;
+    uint8_t caps;                     // CROCO_CAP_* this cartridge is known to implement
+    int allow_foreign_saves;          // archive and timeline restores may target a slot now holding another ROM name
+    RomTable *rom_table;              // session copy of the ROM table cache
+    TraceWriter *trace;               // CROCO_TRACE capture, NULL when off (see src/trace.c)
+    PipelineRing *ring;               // chunk transfer slots, allocated by the first stream (see src/pipeline.c)
+    // Bank progress observer; NULL prints the inline counter (see src/session.c)
+    void (*progress)(void *user, const char *stage, uint32_t done, uint32_t total);
+    void *progress_user;
+} CrocoDevice;
+
+typedef struct {
+    uint8_t rom_id;
+    char name[18];
+    uint8_t num_ram_banks;
+    uint8_t mbc;
+    uint16_t num_rom_banks;     // 16 KiB banks
+} RomInfo;
+
+// device.c
+int find_croco_device(CrocoDevice *device);
+// Opens and claims one enumerated or hotplugged cartridge
+int open_cartridge(libusb_device *dev, CrocoDevice *device);
+// Opens every attached cartridge, at most max; returns how many are ready
+int open_all_devices(CrocoDevice *devices, int max);
+int get_endpoints(CrocoDevice *device);
+int configure_device(CrocoDevice *device);
+int open_device(CrocoDevice *device);
+int send_command(CrocoDevice *device, uint8_t *cmd, int cmd_len);
+int read_response(CrocoDevice *device, uint8_t *buffer, int max_len);
+// Reads one stale response left over from an aborted stream; 0 once the endpoint is empty
+int drain_response(CrocoDevice *device, uint8_t *buffer, int max_len);
+int execute_command(CrocoDevice *device, uint8_t command, uint8_t *payload,
+                    int payload_len, uint8_t *response, int response_len);
+int read_serial(CrocoDevice *device);
+void cleanup(CrocoDevice *device);
+
+// commands.c
+extern int show_progress;
+extern int check_rom_header;    // refuse ROMs whose header or checksums do not match the file
+int list_games(CrocoDevice *device, int mode);
+int get_device_info(CrocoDevice *device);
+int upload_rom(CrocoDevice *device, const char *file_path, const char *rom_name);
+// The steps of upload_rom, for callers that flash several ROMs in a row (see src/romimage.h)
+int preflight_rom(const RomImage *image, RomHeader *header);
+const char *default_rom_name(const char *file_path, const RomHeader *header, char *name, size_t len);
+// 0x02 request and chunk stream for an open, checked image; quiet leaves out the banners.
+// The ROM table cache is not updated.
+int flash_rom_image(CrocoDevice *device, RomImage *image, const char *rom_name, int quiet);
+int resume_rom(CrocoDevice *device, const char *file_path);
+int delete_rom(CrocoDevice *device, uint8_t rom_id);
+int read_save(CrocoDevice *device, uint8_t rom_id, uint8_t num_ram_banks, uint8_t *buffer);
+int download_save(CrocoDevice *device, uint8_t rom_id, const char *dest_path, uint8_t num_ram_banks);
+int upload_save(CrocoDevice *device, uint8_t rom_id, const char *file_path, uint8_t num_ram_banks);
+// 0x08/0x09 for an image in memory; bytes past size are sent as zeros
+int write_save(CrocoDevice *device, uint8_t rom_id, uint8_t num_ram_banks, const uint8_t *data, long size);
+// The 0x09 stream after an accepted 0x08, pipelined; chunks lists the chunk indices to send
+// in order (count of them), or NULL for the whole save
+int send_save_chunks(CrocoDevice *device, uint8_t num_ram_banks, const uint8_t *data, long size,
+                     const uint32_t *chunks, uint32_t count);
+
+#endif
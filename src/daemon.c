@@ -0,0 +1,305 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <libusb.h>
+#include "daemon.h"
+#include "metrics.h"
+#include "session.h"
+#include "sim.h"
+#include "transport.h"
+
+// Hotplug provisioning. libusb reports arrivals through a callback inside the
+// default context's event loop, which only the main loop pumps (every opened
+// cartridge has a context of its own), and it must not do I/O itself; it only
+// queues the device. The main loop opens it,
+// reads the serial and hands it to that serial's job queue.
+//
+// Under CROCO_SIM the arrivals come from a schedule instead: carts=N are
+// plugged in plug=<ms> apart, and serials=<n> makes later carts replugs.
+
+typedef struct {
+    uint8_t serial[8];
+    CrocoSession *running;
+    CrocoDevice *queued;        // plugged in again while the previous job was running
+    int jobs;
+} CartQueue;
+
+typedef struct {
+    const BatchPlan *plan;
+    FILE *term;
+
+    pthread_mutex_t lock;       // guards the hotplug inbox
+    libusb_device *arrived[DAEMON_MAX_CARTS];
+    int num_arrived;
+    int removed;
+
+    CartQueue carts[DAEMON_MAX_CARTS];
+    int num_carts;
+    int jobs;
+    int failed;
+} Daemon;
+
+static volatile sig_atomic_t stop_requested;
+
+static void on_stop_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+static int LIBUSB_CALL hotplug_cb(libusb_context *ctx, libusb_device *dev, libusb_hotplug_event event, void *user) {
+    (void)ctx;
+    Daemon *daemon = user;
+
+    pthread_mutex_lock(&daemon->lock);
+    if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED) {
+        if (daemon->num_arrived < DAEMON_MAX_CARTS) {
+            daemon->arrived[daemon->num_arrived++] = libusb_ref_device(dev);
+        }
+    } else {
+        daemon->removed++;
+    }
+    pthread_mutex_unlock(&daemon->lock);
+    return 0;
+}
+
+static void print_cart(Daemon *daemon, const uint8_t *serial, const char *event, int job) {
+    fprintf(daemon->term, "   [\x1b[1;36m%02X%02X%02X%02X%02X%02X%02X%02X\x1b[0m] %s %d",
+            serial[0], serial[1], serial[2], serial[3], serial[4], serial[5], serial[6], serial[7], event, job);
+    fprintf(daemon->term, "\n");
+    fflush(daemon->term);
+}
+
+static void release_device(CrocoDevice *device) {
+    cleanup(device);
+    free(device);
+}
+
+static CartQueue *cart_queue(Daemon *daemon, const uint8_t *serial) {
+    for (int i = 0; i < daemon->num_carts; i++) {
+        if (memcmp(daemon->carts[i].serial, serial, 8) == 0) {
+            return &daemon->carts[i];
+        }
+    }
+    if (daemon->num_carts == DAEMON_MAX_CARTS) {
+        return NULL;
+    }
+    CartQueue *cart = &daemon->carts[daemon->num_carts++];
+    memcpy(cart->serial, serial, 8);
+    return cart;
+}
+
+static void start_job(Daemon *daemon, CartQueue *cart, CrocoDevice *device, const char *event) {
+    CrocoSession *session = malloc(sizeof(CrocoSession));
+    if (!session) {
+        release_device(device);
+        return;
+    }
+    session_init(session, device, daemon->plan, (int)(cart - daemon->carts));
+    cart->jobs++;
+    daemon->jobs++;
+    print_cart(daemon, cart->serial, event, cart->jobs);
+    session_start(session);
+    cart->running = session;
+}
+
+static void cart_arrived(Daemon *daemon, CrocoDevice *device) {
+    if (stop_requested) {
+        release_device(device);
+        return;
+    }
+    if (read_serial(device) != 0) {
+        fprintf(daemon->term, "   \x1b[1;31m[!] Ignoring a cartridge that did not report its serial ID\x1b[0m\n");
+        release_device(device);
+        return;
+    }
+
+    CartQueue *cart = cart_queue(daemon, device->serial);
+    if (!cart) {
+        fprintf(daemon->term, "   \x1b[1;31m[!] Too many cartridges in one run, ignoring a new one\x1b[0m\n");
+        release_device(device);
+        return;
+    }
+    if (cart->running) {
+        // A replug during the job: the running session fails on the old handle, this one runs next
+        if (cart->queued) {
+            release_device(cart->queued);
+        }
+        cart->queued = device;
+        print_cart(daemon, cart->serial, "\x1b[1;33mplugged in again\x1b[0m, queued behind job", cart->jobs);
+        return;
+    }
+    start_job(daemon, cart, device, "\x1b[1;34mplugged in\x1b[0m, starting job");
+}
+
+static int reap_jobs(Daemon *daemon) {
+    int running = 0;
+    for (int i = 0; i < daemon->num_carts; i++) {
+        CartQueue *cart = &daemon->carts[i];
+        if (!cart->running) {
+            continue;
+        }
+        if (!session_finished(cart->running)) {
+            running++;
+            continue;
+        }
+
+        CrocoSession *session = cart->running;
+        session_join(session);
+        session_draw_lane(daemon->term, session);
+        fflush(daemon->term);
+        daemon->failed += (session->failures != 0);
+        pthread_mutex_destroy(&session->lock);
+        release_device(session->device);
+        free(session);
+        cart->running = NULL;
+
+        if (cart->queued) {
+            CrocoDevice *next = cart->queued;
+            cart->queued = NULL;
+            if (stop_requested) {
+                release_device(next);
+            } else {
+                start_job(daemon, cart, next, "\x1b[1;34mstarting queued job\x1b[0m");
+                running++;
+            }
+        }
+    }
+    return running;
+}
+
+static void take_usb_arrivals(Daemon *daemon) {
+    libusb_device *arrived[DAEMON_MAX_CARTS];
+    pthread_mutex_lock(&daemon->lock);
+    int count = daemon->num_arrived;
+    int removed = daemon->removed;
+    memcpy(arrived, daemon->arrived, count * sizeof(libusb_device *));
+    daemon->num_arrived = 0;
+    daemon->removed = 0;
+    pthread_mutex_unlock(&daemon->lock);
+
+    for (int i = 0; i < removed; i++) {
+        fprintf(daemon->term, "   \x1b[90m[-] A cartridge was unplugged\x1b[0m\n");
+    }
+    for (int i = 0; i < count; i++) {
+        CrocoDevice *device = calloc(1, sizeof(CrocoDevice));
+        if (device && open_cartridge(arrived[i], device) == 0) {
+            cart_arrived(daemon, device);
+        } else {
+            free(device);
+        }
+        libusb_unref_device(arrived[i]);
+    }
+}
+
+int daemon_run(const BatchPlan *plan) {
+    Daemon *daemon = calloc(1, sizeof(Daemon));
+    if (!daemon) {
+        return -1;
+    }
+    daemon->plan = plan;
+    pthread_mutex_init(&daemon->lock, NULL);
+
+    const char *sim_spec = getenv("CROCO_SIM");
+    SimConfig sim_config;
+    int sim_next = 0;
+    libusb_hotplug_callback_handle handle;
+    int registered = 0;
+
+    if (sim_spec) {
+        sim_config_default(&sim_config);
+        if (sim_config_parse(&sim_config, sim_spec) != 0) {
+            fprintf(stderr, "Failed to start cartridge simulator\n");
+            free(daemon);
+            return -1;
+        }
+    } else if (!libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)) {
+        fprintf(stderr, "\x1b[1;31m[!] Error: libusb has no hotplug support on this platform\x1b[0m\n");
+        free(daemon);
+        return -1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    // ENUMERATE reports the carts that are already plugged in as arrivals too;
+    // they wait in the inbox until the loop below picks them up
+    if (!sim_spec) {
+        int rc = libusb_hotplug_register_callback(NULL, LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+                                                  LIBUSB_HOTPLUG_ENUMERATE, CROCO_VENDOR_ID, CROCO_PRODUCT_ID,
+                                                  LIBUSB_HOTPLUG_MATCH_ANY, hotplug_cb, daemon, &handle);
+        if (rc != LIBUSB_SUCCESS) {
+            fprintf(stderr, "\x1b[1;31m[!] Error: Hotplug registration failed: %s\x1b[0m\n", libusb_error_name(rc));
+            free(daemon);
+            return -1;
+        }
+        registered = 1;
+    }
+
+    printf("\n\x1b[1;34m   [>] Waiting for cartridges, %d operation(s) per cart (Ctrl-C to stop)...\x1b[0m\n\n", plan->count);
+
+    char log_path[256];
+    daemon->term = session_capture_stdout(log_path, sizeof(log_path));
+    if (!daemon->term) {
+        fprintf(stderr, "\x1b[1;31m[!] Error: Could not capture session output\x1b[0m\n");
+        if (registered) {
+            libusb_hotplug_deregister_callback(NULL, handle);
+        }
+        free(daemon);
+        return -1;
+    }
+
+    uint64_t start_ns = monotonic_ns();
+    for (;;) {
+        if (sim_spec) {
+            uint64_t elapsed_ms = (monotonic_ns() - start_ns) / 1000000;
+            while (!stop_requested && sim_next < sim_config.carts &&
+                   elapsed_ms >= (uint64_t)sim_next * sim_config.plug_ms) {
+                CrocoDevice *device = calloc(1, sizeof(CrocoDevice));
+                if (device && sim_open_cart(device, &sim_config, sim_next) == 0) {
+                    cart_arrived(daemon, device);
+                } else {
+                    free(device);
+                }
+                sim_next++;
+            }
+        } else if (registered) {
+            struct timeval tv = { 0, DAEMON_POLL_MS * 1000 };
+            libusb_handle_events_timeout_completed(NULL, &tv, NULL);
+            take_usb_arrivals(daemon);
+        }
+
+        metrics_poll();
+        int running = reap_jobs(daemon);
+        int hub_empty = sim_spec && sim_next >= sim_config.carts;
+        if (running == 0 && (stop_requested || hub_empty)) {
+            break;
+        }
+        if (sim_spec) {
+            struct timespec ts = { 0, DAEMON_POLL_MS * 1000000L };
+            nanosleep(&ts, NULL);
+        }
+    }
+
+    if (registered) {
+        libusb_hotplug_deregister_callback(NULL, handle);
+        take_usb_arrivals(daemon);
+    }
+    session_restore_stdout(daemon->term);
+
+    int failed = daemon->failed;
+    printf("\n   \x1b[1;32m[+] %d job(s) on %d cartridge(s)\x1b[0m", daemon->jobs, daemon->num_carts);
+    if (failed) {
+        printf(", \x1b[1;31m%d failed\x1b[0m", failed);
+    }
+    printf("\n       Session output: %s\n", log_path);
+
+    pthread_mutex_destroy(&daemon->lock);
+    free(daemon);
+    return failed;
+}
@@ -0,0 +1,16 @@
+#ifndef CROCO_DAEMON_H
+#define CROCO_DAEMON_H
+
+#include "batch.h"
+
+#define DAEMON_MAX_CARTS 64         // distinct serial IDs seen in one run
+#define DAEMON_POLL_MS 100
+
+// Waits for cartridges to be plugged in and runs the plan on each one as a
+// session of its own. Jobs are queued per serial ID: a cart plugged in again
+// while its previous job is still running starts once that job is reaped.
+// Runs until SIGINT/SIGTERM, or until a simulated hub has no carts left.
+// Returns the number of failed jobs, or -1 if hotplug is unavailable.
+int daemon_run(const BatchPlan *plan);
+
+#endif
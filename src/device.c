@@ -0,0 +1,440 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libusb.h>
+#include "croco.h"
+#include "metrics.h"
+#include "pipeline.h"
+#include "response.h"
+#include "romcache.h"
+#include "sim.h"
+#include "trace.h"
+#include "transport.h"
+
+static int is_croco(libusb_device *dev) {
+    struct libusb_device_descriptor desc;
+    return libusb_get_device_descriptor(dev, &desc) == 0 &&
+           desc.idVendor == CROCO_VENDOR_ID && desc.idProduct == CROCO_PRODUCT_ID;
+}
+
+// Each cartridge gets a libusb context of its own, so only the thread that
+// drives it ever runs its transfer callbacks: the pipeline and response
+// state they touch lives on that thread's stack. Enumeration and hotplug
+// stay on the default context; the device is found again here by its
+// bus and address.
+static const struct {
+    const char *name;
+    uint8_t cap;
+} cap_names[] = {
+    { "fill", CROCO_CAP_FILL_BANK },
+    { "sparse-save", CROCO_CAP_SPARSE_SAVE },
+};
+
+// CROCO_FIRMWARE_CAPS, for firmware builds that implement the extensions
+static uint8_t caps_from_env(void) {
+    const char *spec = getenv("CROCO_FIRMWARE_CAPS");
+    if (!spec || !*spec) {
+        return 0;
+    }
+
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%s", spec);
+    uint8_t caps = 0;
+    for (char *name = strtok(buf, ","); name; name = strtok(NULL, ",")) {
+        size_t i = 0;
+        while (i < sizeof(cap_names) / sizeof(cap_names[0]) && strcmp(name, cap_names[i].name) != 0) {
+            i++;
+        }
+        if (i < sizeof(cap_names) / sizeof(cap_names[0])) {
+            caps |= cap_names[i].cap;
+        } else {
+            fprintf(stderr, "\x1b[1;33m[!] WARNING: Unknown firmware capability '%s' ignored\x1b[0m\n", name);
+        }
+    }
+    return caps;
+}
+
+static int open_usb_device(libusb_device *dev, CrocoDevice *device) {
+    uint8_t bus = libusb_get_bus_number(dev);
+    uint8_t address = libusb_get_device_address(dev);
+    libusb_context *ctx = NULL;
+    if (libusb_init(&ctx) != 0) {
+        fprintf(stderr, "Failed to initialize libusb\n");
+        return -1;
+    }
+
+    libusb_device **devs;
+    libusb_device *own = NULL;
+    ssize_t cnt = libusb_get_device_list(ctx, &devs);
+    for (ssize_t i = 0; i < cnt; i++) {
+        if (libusb_get_bus_number(devs[i]) == bus && libusb_get_device_address(devs[i]) == address && is_croco(devs[i])) {
+            own = devs[i];
+            break;
+        }
+    }
+    if (!own || libusb_open(own, &device->dev) != 0) {
+        fprintf(stderr, "Failed to open device\n");
+        printf("\x1b[1;33mTry with `sudo`\x1b[0m\n");
+        if (cnt >= 0) {
+            libusb_free_device_list(devs, 1);
+        }
+        libusb_exit(ctx);
+        return -1;
+    }
+    device->usb_ctx = ctx;
+    device->caps = caps_from_env();
+
+    struct libusb_device_descriptor desc;
+    libusb_get_device_descriptor(own, &desc);
+    device->vendor_id = desc.idVendor;
+    device->product_id = desc.idProduct;
+    printf("Found device: %04x:%04x (bus %u, port %u)\n", desc.idVendor, desc.idProduct,
+           libusb_get_bus_number(own), libusb_get_port_number(own));
+    libusb_free_device_list(devs, 1);
+    return 0;
+}
+
+int find_croco_device(CrocoDevice *device) {
+    libusb_device **devs;
+    libusb_device *found = NULL;
+    ssize_t cnt = libusb_get_device_list(NULL, &devs);
+
+    if (cnt < 0) {
+        fprintf(stderr, "Error getting device list\n");
+        return -1;
+    }
+
+    for (ssize_t i = 0; i < cnt; i++) {
+        if (is_croco(devs[i])) {
+            found = devs[i];
+            break;
+        }
+    }
+
+    if (!found) {
+        fprintf(stderr, "Croco Cartridge not found\n");
+        libusb_free_device_list(devs, 1);
+        return -1;
+    }
+
+    int ret = open_usb_device(found, device);
+    libusb_free_device_list(devs, 1);
+    return ret;
+}
+
+int get_endpoints(CrocoDevice *device) {
+    struct libusb_config_descriptor *config = NULL;
+    const struct libusb_interface *iface = NULL;
+    const struct libusb_interface_descriptor *iface_desc = NULL;
+    int ret = 0;
+
+    ret = libusb_get_active_config_descriptor(libusb_get_device(device->dev), &config);
+    if (ret != 0) {
+        fprintf(stderr, "Failed to get config descriptor: %s\n", libusb_error_name(ret));
+        return -1;
+    }
+
+    // Find interface with class 0xFF (vendor specific)
+    for (int i = 0; i < config->bNumInterfaces; i++) {
+        iface = &config->interface[i];
+        if (iface->num_altsetting > 0) {
+            iface_desc = &iface->altsetting[0];
+
+            if (iface_desc->bInterfaceClass == 0xFF) {
+                device->if_num = iface_desc->bInterfaceNumber;
+
+                for (int j = 0; j < iface_desc->bNumEndpoints; j++) {
+                    const struct libusb_endpoint_descriptor *ep = &iface_desc->endpoint[j];
+
+                    if ((ep->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK) == LIBUSB_TRANSFER_TYPE_BULK) {
+                        if (ep->bEndpointAddress & LIBUSB_ENDPOINT_IN) {
+                            device->in_ep = ep->bEndpointAddress;
+                        } else {
+                            device->out_ep = ep->bEndpointAddress;
+                        }
+                    }
+                }
+                break;
+            }
+        }
+    }
+
+    libusb_free_config_descriptor(config);
+
+    if (device->out_ep == 0 || device->in_ep == 0) {
+        fprintf(stderr, "Could not find bulk endpoints\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int configure_device(CrocoDevice *device) {
+    int ret;
+
+    ret = libusb_kernel_driver_active(device->dev, 0);
+    if (ret == 1) {
+        ret = libusb_detach_kernel_driver(device->dev, 0);
+        if (ret != 0 && ret != LIBUSB_ERROR_NOT_SUPPORTED) {
+            fprintf(stderr, "\x1b[1;31mCRITICAL: Access denied. \x1b[1;33mTry running with `sudo` or close the WebApp.\n");
+            fprintf(stderr, "\x1b[1;31mFailed to detach kernel driver: %s\n", libusb_error_name(ret));
+            return -1;
+        }
+    }
+
+    ret = libusb_claim_interface(device->dev, device->if_num);
+    if (ret != 0) {
+        fprintf(stderr, "Failed to claim interface: %s\n", libusb_error_name(ret));
+        return -1;
+    }
+
+    ret = libusb_set_interface_alt_setting(device->dev, device->if_num, 0);
+    if (ret != 0) {
+        fprintf(stderr, "Failed to set alt setting: %s\n", libusb_error_name(ret));
+        libusb_release_interface(device->dev, device->if_num);
+        return -1;
+    }
+
+    // Control transfer - request 0x22, value 0x01 (CDC protocol setup)
+    ret = libusb_control_transfer(
+        device->dev,
+        LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_RECIPIENT_INTERFACE,
+        0x22,
+        0x01,
+        device->if_num,
+        NULL,
+        0,
+        TIMEOUT_MS
+    );
+
+    if (ret != 0) {
+        fprintf(stderr, "Control transfer failed: %s\n", libusb_error_name(ret));
+        libusb_release_interface(device->dev, device->if_num);
+        return -1;
+    }
+
+    return 0;
+}
+
+int send_command(CrocoDevice *device, uint8_t *cmd, int cmd_len) {
+    int transferred = 0;
+    int result = transport_transfer_sync(device, XFER_OUT, cmd, cmd_len, &transferred, TIMEOUT_MS);
+
+    if (result != XFER_COMPLETED) {
+        fprintf(stderr, "Failed to send command: %s\n", transfer_status_name(result));
+        return -1;
+    }
+
+    return transferred;
+}
+
+int read_response(CrocoDevice *device, uint8_t *buffer, int max_len) {
+    int transferred = 0;
+    int result = transport_transfer_sync(device, XFER_IN, buffer, max_len, &transferred, TIMEOUT_MS);
+
+    if (result != XFER_COMPLETED && result != XFER_TIMED_OUT) {
+        fprintf(stderr, "Failed to read response: %s\n", transfer_status_name(result));
+        return -1;
+    }
+
+    return transferred;
+}
+
+int drain_response(CrocoDevice *device, uint8_t *buffer, int max_len) {
+    int transferred = 0;
+    int result = transport_transfer_sync(device, XFER_IN, buffer, max_len, &transferred, DRAIN_TIMEOUT_MS);
+
+    if (result == XFER_TIMED_OUT) {
+        return 0;
+    }
+    if (result != XFER_COMPLETED) {
+        return -1;
+    }
+    return transferred;
+}
+
+int execute_command(CrocoDevice *device, uint8_t command, uint8_t *payload,
+                    int payload_len, uint8_t *response, int response_len) {
+    uint8_t cmd_buffer[65];
+    int cmd_len = 1 + payload_len;
+
+    if (cmd_len > 65) {
+        fprintf(stderr, "Command too large\n");
+        return -1;
+    }
+
+    cmd_buffer[0] = command;
+    if (payload_len > 0 && payload != NULL) {
+        memcpy(cmd_buffer + 1, payload, payload_len);
+    }
+
+    uint8_t buffer[128];
+    ResponseWait wait;
+    if (response_submit(device, &wait, command, buffer, sizeof(buffer)) != 0) {
+        return -1;
+    }
+
+    uint64_t send_ns = metrics_enabled ? monotonic_ns() : 0;
+    if (send_command(device, cmd_buffer, cmd_len) < 0) {
+        if (metrics_enabled) {
+            metrics_count_error(command);
+        }
+        response_cancel(&wait);
+        return -1;
+    }
+    if (metrics_enabled) {
+        metrics_record_send(command, monotonic_ns() - send_ns, cmd_len);
+    }
+
+    int bytes_read = response_wait(&wait);
+    if (bytes_read < 0) {
+        return -1;
+    }
+
+    if (bytes_read < 1) {
+        fprintf(stderr, "No response from device\n");
+        printf("\x1b[1;33mTry (in the same order): disconnect / reconnect, close the WebApp, or use `sudo`.\x1b[0m\n");
+        return -1;
+    }
+
+    // First byte should echo the command
+    if (buffer[0] != command) {
+        if (metrics_enabled) {
+            metrics_count_echo_mismatch(command);
+        }
+        fprintf(stderr, "Command echo mismatch: expected 0x%02x, got 0x%02x\n",
+                command, buffer[0]);
+        return -1;
+    }
+
+    // Copy response data (skip echo byte)
+    int data_len = bytes_read - 1;
+    if (data_len > response_len) {
+        data_len = response_len;
+    }
+    memcpy(response, buffer + 1, data_len);
+
+    return data_len;
+}
+
+static int open_backend(CrocoDevice *device) {
+    // CROCO_REPLAY answers from a recorded trace (see src/trace.c)
+    const char *replay_spec = getenv("CROCO_REPLAY");
+    if (replay_spec) {
+        if (replay_open(device, replay_spec) != 0) {
+            fprintf(stderr, "Failed to start trace replay\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    // CROCO_SIM swaps the cartridge for the software simulator (see src/sim.c)
+    const char *sim_spec = getenv("CROCO_SIM");
+    if (sim_spec) {
+        SimConfig sim_config;
+        sim_config_default(&sim_config);
+        if (sim_config_parse(&sim_config, sim_spec) != 0 || sim_open(device, &sim_config) != 0) {
+            fprintf(stderr, "Failed to start cartridge simulator\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    if (find_croco_device(device) != 0) {
+        return -1;
+    }
+    if (get_endpoints(device) != 0 || configure_device(device) != 0) {
+        cleanup(device);
+        return -1;
+    }
+    return 0;
+}
+
+int open_device(CrocoDevice *device) {
+    if (open_backend(device) != 0) {
+        return -1;
+    }
+
+    // CROCO_TRACE records every transfer from here on, whichever backend serves it
+    const char *trace_path = getenv("CROCO_TRACE");
+    if (trace_path && *trace_path && trace_open(device, trace_path) != 0) {
+        cleanup(device);
+        return -1;
+    }
+    return 0;
+}
+
+int open_cartridge(libusb_device *dev, CrocoDevice *device) {
+    if (open_usb_device(dev, device) != 0) {
+        return -1;
+    }
+    if (get_endpoints(device) != 0 || configure_device(device) != 0) {
+        cleanup(device);
+        memset(device, 0, sizeof(*device));
+        return -1;
+    }
+    return 0;
+}
+
+int open_all_devices(CrocoDevice *devices, int max) {
+    const char *sim_spec = getenv("CROCO_SIM");
+    if (sim_spec) {
+        SimConfig sim_config;
+        sim_config_default(&sim_config);
+        if (sim_config_parse(&sim_config, sim_spec) != 0) {
+            fprintf(stderr, "Failed to start cartridge simulator\n");
+            return -1;
+        }
+        // carts=N simulates a hub; each cart gets its own serial
+        int count = 0;
+        for (int i = 0; i < sim_config.carts && count < max; i++) {
+            if (sim_open_cart(&devices[count], &sim_config, i) == 0) {
+                count++;
+            }
+        }
+        return count;
+    }
+
+    libusb_device **devs;
+    ssize_t cnt = libusb_get_device_list(NULL, &devs);
+    if (cnt < 0) {
+        fprintf(stderr, "Error getting device list\n");
+        return -1;
+    }
+
+    // A cart that cannot be claimed is skipped so the others still run
+    int count = 0;
+    for (ssize_t i = 0; i < cnt && count < max; i++) {
+        if (is_croco(devs[i]) && open_cartridge(devs[i], &devices[count]) == 0) {
+            count++;
+        }
+    }
+    libusb_free_device_list(devs, 1);
+
+    if (count == 0) {
+        fprintf(stderr, "Croco Cartridge not found\n");
+    }
+    return count;
+}
+
+int read_serial(CrocoDevice *device) {
+    if (device->has_serial) {
+        return 0;
+    }
+
+    // Command 0xFD: 8-byte RP2040 unique ID
+    uint8_t response[10];
+    if (execute_command(device, 0xFD, NULL, 0, response, sizeof(response)) < 8) {
+        return -1;
+    }
+    memcpy(device->serial, response, 8);
+    device->has_serial = 1;
+    return 0;
+}
+
+void cleanup(CrocoDevice *device) {
+    trace_close(device);
+    romcache_free(device);
+    pipeline_release(device);
+    transport_close(device);
+}
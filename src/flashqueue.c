@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "flashqueue.h"
+#include "manifest.h"
+#include "romcache.h"
+#include "romimage.h"
+#include "transport.h"
+
+#define PREFETCH_PAGE 4096
+
+typedef struct {
+    const ManifestEntry *entry;
+    RomImage image;             // open only from just before the entry streams until it is done
+    int opened;
+    long size;
+    char name[18];
+    uint16_t banks;
+    uint64_t start_ns;
+    uint64_t end_ns;
+} QueueItem;
+
+// Opens the next entry while the current one streams: a .crlz file gets its
+// checking pass, and a plain file has one byte per page touched so the stream
+// never waits on a fault
+static void *prefetch_main(void *arg) {
+    QueueItem *item = arg;
+    item->opened = rom_image_open(item->entry->path, &item->image) == 0;
+    if (item->opened && item->image.map) {
+        madvise((void *)item->image.map, item->image.size, MADV_WILLNEED);
+        volatile uint8_t sink = 0;
+        for (long off = 0; off < item->image.size; off += PREFETCH_PAGE) {
+            sink ^= item->image.map[off];
+        }
+        (void)sink;
+    }
+    return NULL;
+}
+
+static void close_items(QueueItem *items, int count) {
+    for (int i = 0; i < count; i++) {
+        if (items[i].opened) {
+            rom_image_close(&items[i].image);
+            items[i].opened = 0;
+        }
+    }
+}
+
+// Checks every file and reports all the problems, not just the first. Each is
+// closed again, so a long manifest never holds more than two images at once.
+static int prepare_items(const Manifest *manifest, QueueItem *items) {
+    int errors = 0;
+    for (int i = 0; i < manifest->count; i++) {
+        QueueItem *item = &items[i];
+        item->entry = &manifest->entries[i];
+        if (rom_image_open(item->entry->path, &item->image) != 0) {
+            errors++;
+            continue;
+        }
+
+        RomHeader header;
+        int ok = preflight_rom(&item->image, &header) == 0;
+        item->size = item->image.size;
+        rom_image_close(&item->image);
+        if (!ok) {
+            errors++;
+            continue;
+        }
+        if (strcmp(item->entry->name, "-") == 0) {
+            default_rom_name(item->entry->path, &header, item->name, sizeof(item->name));
+        } else {
+            snprintf(item->name, sizeof(item->name), "%s", item->entry->name);
+        }
+        item->banks = (uint16_t)((item->size + ROM_BANK_SIZE - 1) / ROM_BANK_SIZE);
+    }
+    return errors ? -1 : 0;
+}
+
+static double kib_per_s(uint64_t bytes, uint64_t ns) {
+    return ns ? bytes / 1024.0 / (ns / 1e9) : 0.0;
+}
+
+static void print_report(const QueueItem *items, int count, int flashed, uint64_t total_ns) {
+    uint64_t bytes = 0;
+    uint64_t between_ns = 0;
+
+    printf("\n\n \x1b[1;37m  #    NAME              | BANKS | TIME      | SPEED\x1b[0m\n");
+    printf(" \x1b[90m  ---- ----------------- | ----- | --------- | -------------\x1b[0m\n");
+    for (int i = 0; i < flashed; i++) {
+        uint64_t ns = items[i].end_ns - items[i].start_ns;
+        bytes += (uint64_t)items[i].size;
+        if (i > 0) {
+            between_ns += items[i].start_ns - items[i - 1].end_ns;
+        }
+        printf("   [\x1b[32m%2d\x1b[0m] \x1b[1;36m%-17s\x1b[0m | %5u | %7.2f s | %7.1f KiB/s\n",
+               i + 1, items[i].name, items[i].banks, ns / 1e9, kib_per_s(items[i].size, ns));
+    }
+    printf(" \x1b[90m  -------------------------------------------------------------\x1b[0m\n");
+
+    printf("     Flashed:  \x1b[1;32m%d of %d ROMs\x1b[0m, %llu KiB in %.2f s (%.1f KiB/s)\n",
+           flashed, count, (unsigned long long)(bytes / 1024), total_ns / 1e9, kib_per_s(bytes, total_ns));
+    // From one ROM's last ack to the next upload request
+    printf("     Between:  %.2f ms in total\n", between_ns / 1e6);
+}
+
+int flash_queue(CrocoDevice *device, const char *manifest_file) {
+    Manifest manifest;
+    if (manifest_load(manifest_file, &manifest) != 0) {
+        return -1;
+    }
+    QueueItem *items = calloc(manifest.count, sizeof(QueueItem));
+    if (!items) {
+        manifest_free(&manifest);
+        return -1;
+    }
+    if (prepare_items(&manifest, items) != 0) {
+        printf("\x1b[1;31m[!] %s has ROMs that cannot be flashed; nothing was sent.\x1b[0m\n", manifest_file);
+        free(items);
+        manifest_free(&manifest);
+        return -1;
+    }
+
+    printf("\n\x1b[1;34m   [>] Flashing %d ROM(s) from %s...\x1b[0m\n", manifest.count, manifest_file);
+
+    int flashed = 0;
+    pthread_t prefetch;
+    int prefetching = 0;
+    uint64_t start_ns = monotonic_ns();
+    for (int i = 0; i < manifest.count; i++) {
+        QueueItem *item = &items[i];
+        if (prefetching) {
+            pthread_join(prefetch, NULL);
+            prefetching = 0;
+        }
+        if (!item->opened) {
+            item->opened = rom_image_open(item->entry->path, &item->image) == 0;
+        }
+        if (!item->opened || item->image.size != item->size) {
+            printf("\x1b[1;31m[!] %s changed after it was checked\x1b[0m\n", item->entry->path);
+            break;
+        }
+        if (i + 1 < manifest.count) {
+            prefetching = pthread_create(&prefetch, NULL, prefetch_main, &items[i + 1]) == 0;
+        }
+
+        printf("\n       [\x1b[32m%2d/%d\x1b[0m] \x1b[1;36m%-17s\x1b[0m %u banks\n", i + 1, manifest.count, item->name, item->banks);
+        item->start_ns = monotonic_ns();
+        int ret = flash_rom_image(device, &item->image, item->name, 1);
+        rom_image_close(&item->image);
+        item->opened = 0;
+        if (ret != 0) {
+            break;
+        }
+        item->end_ns = monotonic_ns();
+        flashed++;
+    }
+    uint64_t total_ns = monotonic_ns() - start_ns;
+    if (prefetching) {
+        pthread_join(prefetch, NULL);
+    }
+
+    if (flashed) {
+        romcache_after_uploads(device, flashed);
+    }
+    print_report(items, manifest.count, flashed, total_ns);
+    if (flashed < manifest.count) {
+        printf("\x1b[1;31m[!] Stopped at %s; the ROMs after it were not flashed.\x1b[0m\n", items[flashed].name);
+    }
+
+    close_items(items, manifest.count);
+    free(items);
+    int ret = flashed == manifest.count ? 0 : -1;
+    manifest_free(&manifest);
+    return ret;
+}
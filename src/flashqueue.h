@@ -0,0 +1,13 @@
+#ifndef CROCO_FLASHQUEUE_H
+#define CROCO_FLASHQUEUE_H
+
+#include "croco.h"
+
+// Flashes every ROM of a manifest (see manifest.h; priorities are ignored)
+// back to back. All files are mapped and checked before the first upload
+// request, and a helper thread faults the next ROM in while the current one
+// streams, so each 0x02 follows the last ack of the previous ROM directly.
+// Per-ROM and aggregate throughput are printed at the end.
+int flash_queue(CrocoDevice *device, const char *manifest_file);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef CROCO_HASH_H
+#define CROCO_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-32 as used by zip and the No-Intro DATs; start with 0 and chain the result
+uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t len);
+
+typedef struct {
+    uint32_t h[5];
+    uint64_t length;
+    uint8_t block[64];
+    size_t used;
+} Sha1;
+
+void sha1_init(Sha1 *ctx);
+void sha1_update(Sha1 *ctx, const uint8_t *data, size_t len);
+void sha1_final(Sha1 *ctx, uint8_t digest[20]);
+
+#endif
@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "journal.h"
+#include "romcache.h"
+
+// On-disk layout (little endian), next to the ROM table cache:
+//   "CRFJ" | version u8 | name[17] | rom_size u32 | rom_hash u32 | total_banks u16 | acked u32 |
+//   roms_before u8 | used_before u16
+#define JOURNAL_MAGIC "CRFJ"
+#define JOURNAL_VERSION 3
+#define JOURNAL_SIZE 39
+
+static void put_le32(uint8_t *p, uint32_t v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = (v >> 24) & 0xFF;
+}
+
+static uint32_t get_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+uint32_t journal_hash(uint32_t hash, const uint8_t *data, long size) {
+    for (long i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+int journal_save(const uint8_t *serial, const FlashJournal *journal) {
+    char path[256], tmp[264];
+    if (romcache_mkdir() != 0 || romcache_file(serial, "flash", path, sizeof(path)) != 0) {
+        return -1;
+    }
+
+    uint8_t rec[JOURNAL_SIZE];
+    memcpy(rec, JOURNAL_MAGIC, 4);
+    rec[4] = JOURNAL_VERSION;
+    memcpy(rec + 5, journal->name, 17);
+    put_le32(rec + 22, journal->rom_size);
+    put_le32(rec + 26, journal->rom_hash);
+    rec[30] = journal->total_banks & 0xFF;
+    rec[31] = journal->total_banks >> 8;
+    put_le32(rec + 32, journal->acked);
+    rec[36] = journal->roms_before;
+    rec[37] = journal->used_before & 0xFF;
+    rec[38] = journal->used_before >> 8;
+
+    // Temp file and rename, so a crash mid-write keeps the previous checkpoint
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "wb");
+    if (!f) {
+        return -1;
+    }
+    int ok = fwrite(rec, 1, sizeof(rec), f) == sizeof(rec);
+    if (fclose(f) != 0 || !ok || rename(tmp, path) != 0) {
+        remove(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+int journal_load(const uint8_t *serial, FlashJournal *journal) {
+    char path[256];
+    if (romcache_file(serial, "flash", path, sizeof(path)) != 0) {
+        return -1;
+    }
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return -1;
+    }
+
+    uint8_t rec[JOURNAL_SIZE];
+    int ok = fread(rec, 1, sizeof(rec), f) == sizeof(rec) &&
+             memcmp(rec, JOURNAL_MAGIC, 4) == 0 && rec[4] == JOURNAL_VERSION;
+    fclose(f);
+    if (!ok) {
+        return -1;
+    }
+
+    memcpy(journal->name, rec + 5, 17);
+    journal->name[17] = '\0';
+    journal->rom_size = get_le32(rec + 22);
+    journal->rom_hash = get_le32(rec + 26);
+    journal->total_banks = (uint16_t)(rec[30] | (rec[31] << 8));
+    journal->acked = get_le32(rec + 32);
+    journal->roms_before = rec[36];
+    journal->used_before = (uint16_t)(rec[37] | (rec[38] << 8));
+    return 0;
+}
+
+void journal_clear(const uint8_t *serial) {
+    char path[256];
+    if (romcache_file(serial, "flash", path, sizeof(path)) == 0) {
+        remove(path);
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef CROCO_JOURNAL_H
+#define CROCO_JOURNAL_H
+
+#include "croco.h"
+
+// Checkpoint of an interrupted ROM flash. The cartridge has a single upload
+// slot, so there is at most one journal per serial ID.
+typedef struct {
+    char name[18];
+    uint32_t rom_size;
+    uint32_t rom_hash;      // FNV-1a of the acked prefix, to refuse resuming with another file
+    uint16_t total_banks;
+    uint32_t acked;         // chunks the cartridge acknowledged
+    uint8_t roms_before;    // 0x01 summary just before the upload request
+    uint16_t used_before;
+} FlashJournal;
+
+#define JOURNAL_HASH_INIT 2166136261u
+
+// Extends an FNV-1a hash over data
+uint32_t journal_hash(uint32_t hash, const uint8_t *data, long size);
+int journal_save(const uint8_t *serial, const FlashJournal *journal);
+int journal_load(const uint8_t *serial, FlashJournal *journal);
+void journal_clear(const uint8_t *serial);
+
+#endif
@@ -0,0 +1,431 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <libusb.h>
+#include "libcroco.h"
+#include "croco.h"
+#include "metrics.h"
+#include "romcache.h"
+
+// A handle is the session.c model with a queue in front: one thread per
+// cartridge runs the same command functions the CLI does. The worker hands
+// results back through a self-pipe, the usual way to wake a poll loop from
+// another thread.
+
+typedef enum {
+    JOB_EXECUTE,
+    JOB_LIST,
+    JOB_FLASH,
+    JOB_DELETE,
+    JOB_BACKUP,
+    JOB_RESTORE,
+} CrocoJobKind;
+
+typedef struct CrocoJob {
+    CrocoJobKind kind;
+    uint8_t command;            // JOB_EXECUTE
+    uint8_t *payload;
+    int payload_len;
+    uint8_t *response;
+    int response_len;
+    CrocoRomList *list;         // JOB_LIST
+    uint8_t rom_id;
+    char path[512];
+    char name[18];
+    croco_done_fn done;
+    void *user;
+    int status;
+    struct CrocoJob *next;
+} CrocoJob;
+
+struct CrocoHandle {
+    CrocoDevice device;
+    pthread_t thread;
+    int closing;
+    int wake_fd[2];             // read end is croco_event_fd
+
+    pthread_mutex_t lock;       // guards everything below
+    pthread_cond_t queued;
+    CrocoJob *waiting;
+    CrocoJob *waiting_tail;
+    CrocoJob *finished;
+    CrocoJob *finished_tail;
+    int signalled;              // a byte is in the pipe and not yet drained
+    int allow_foreign_saves;    // copied to the device before each job
+
+    croco_progress_fn progress;
+    void *progress_user;
+    char stage[24];
+    uint32_t done;
+    uint32_t total;
+    int progress_pending;
+};
+
+int croco_init(void) {
+    metrics_init_from_env();
+    return libusb_init(NULL) == 0 ? 0 : -1;
+}
+
+void croco_exit(void) {
+    libusb_exit(NULL);
+}
+
+// Called with the lock held; one byte stands for any number of events
+static void wake_loop(CrocoHandle *handle) {
+    if (!handle->signalled) {
+        uint8_t byte = 1;
+        if (write(handle->wake_fd[1], &byte, 1) == 1) {
+            handle->signalled = 1;
+        }
+    }
+}
+
+static void job_progress(void *user, const char *stage, uint32_t done, uint32_t total) {
+    CrocoHandle *handle = user;
+    pthread_mutex_lock(&handle->lock);
+    snprintf(handle->stage, sizeof(handle->stage), "%s", stage);
+    handle->done = done;
+    handle->total = total;
+    handle->progress_pending = 1;
+    wake_loop(handle);
+    pthread_mutex_unlock(&handle->lock);
+}
+
+static int save_banks(CrocoDevice *device, uint8_t rom_id) {
+    RomInfo info;
+    if (romcache_get_info(device, rom_id, &info) != 0 || info.num_ram_banks == 0) {
+        return -1;
+    }
+    return info.num_ram_banks;
+}
+
+static int list_roms(CrocoDevice *device, CrocoRomList *list) {
+    RomTable *table;
+    if (romcache_read_table(device, &table) != 0) {
+        return -1;
+    }
+    list->used_banks = table->used_raw;
+    list->max_banks = table->max_banks;
+    list->count = table->num_roms;
+    for (int i = 0; i < table->num_roms; i++) {
+        const RomInfo *info = &table->roms[i];
+        CrocoRom *rom = &list->roms[i];
+        rom->id = (uint8_t)i;
+        memcpy(rom->name, info->name, sizeof(rom->name));
+        rom->ram_banks = info->num_ram_banks;
+        rom->mbc = info->mbc;
+        rom->rom_banks = info->num_rom_banks;
+    }
+    return 0;
+}
+
+static int run_job(CrocoHandle *handle, CrocoJob *job) {
+    CrocoDevice *device = &handle->device;
+    int banks;
+
+    switch (job->kind) {
+        case JOB_EXECUTE:
+            return execute_command(device, job->command, job->payload, job->payload_len, job->response, job->response_len);
+        case JOB_LIST:
+            return list_roms(device, job->list);
+        case JOB_FLASH:
+            return upload_rom(device, job->path, job->name[0] ? job->name : NULL);
+        case JOB_DELETE:
+            return delete_rom(device, job->rom_id);
+        case JOB_BACKUP:
+            banks = save_banks(device, job->rom_id);
+            return banks < 0 ? -1 : download_save(device, job->rom_id, job->path, (uint8_t)banks);
+        case JOB_RESTORE:
+            banks = save_banks(device, job->rom_id);
+            return banks < 0 ? -1 : upload_save(device, job->rom_id, job->path, (uint8_t)banks);
+    }
+    return -1;
+}
+
+static void *worker_main(void *arg) {
+    CrocoHandle *handle = arg;
+    croco_log_set_source(handle);
+
+    pthread_mutex_lock(&handle->lock);
+    for (;;) {
+        while (!handle->waiting && !handle->closing) {
+            pthread_cond_wait(&handle->queued, &handle->lock);
+        }
+        if (handle->closing) {
+            break;
+        }
+        CrocoJob *job = handle->waiting;
+        handle->waiting = job->next;
+        if (!handle->waiting) {
+            handle->waiting_tail = NULL;
+        }
+        handle->device.allow_foreign_saves = handle->allow_foreign_saves;
+        pthread_mutex_unlock(&handle->lock);
+
+        job->status = run_job(handle, job);
+        job->next = NULL;
+
+        pthread_mutex_lock(&handle->lock);
+        if (handle->finished_tail) {
+            handle->finished_tail->next = job;
+        } else {
+            handle->finished = job;
+        }
+        handle->finished_tail = job;
+        wake_loop(handle);
+    }
+    pthread_mutex_unlock(&handle->lock);
+    return NULL;
+}
+
+// Takes over an opened device: reads its serial and starts the worker
+static CrocoHandle *handle_start(const CrocoDevice *device) {
+    CrocoHandle *handle = calloc(1, sizeof(CrocoHandle));
+    if (!handle) {
+        return NULL;
+    }
+    handle->device = *device;
+    if (pipe(handle->wake_fd) != 0) {
+        free(handle);
+        return NULL;
+    }
+    fcntl(handle->wake_fd[0], F_SETFL, O_NONBLOCK);
+    fcntl(handle->wake_fd[1], F_SETFL, O_NONBLOCK);
+    fcntl(handle->wake_fd[0], F_SETFD, FD_CLOEXEC);
+    fcntl(handle->wake_fd[1], F_SETFD, FD_CLOEXEC);
+    pthread_mutex_init(&handle->lock, NULL);
+    pthread_cond_init(&handle->queued, NULL);
+
+    handle->device.progress = job_progress;
+    handle->device.progress_user = handle;
+    void *source = croco_log_set_source(handle);
+    read_serial(&handle->device);
+    croco_log_set_source(source);
+
+    if (pthread_create(&handle->thread, NULL, worker_main, handle) != 0) {
+        pthread_cond_destroy(&handle->queued);
+        pthread_mutex_destroy(&handle->lock);
+        close(handle->wake_fd[0]);
+        close(handle->wake_fd[1]);
+        free(handle);
+        return NULL;
+    }
+    return handle;
+}
+
+int croco_open(CrocoHandle **handle) {
+    CrocoDevice device = {0};
+    if (open_device(&device) != 0) {
+        return -1;
+    }
+    *handle = handle_start(&device);
+    if (!*handle) {
+        cleanup(&device);
+        return -1;
+    }
+    return 0;
+}
+
+int croco_open_all(CrocoHandle **handles, int max) {
+    CrocoDevice *devices = calloc(max > 0 ? max : 1, sizeof(CrocoDevice));
+    if (!devices) {
+        return -1;
+    }
+    int count = open_all_devices(devices, max);
+    int opened = 0;
+    for (int i = 0; i < count; i++) {
+        CrocoHandle *handle = handle_start(&devices[i]);
+        if (handle) {
+            handles[opened++] = handle;
+        } else {
+            cleanup(&devices[i]);
+        }
+    }
+    free(devices);
+    return count < 0 ? -1 : opened;
+}
+
+static void free_jobs(CrocoJob *job) {
+    while (job) {
+        CrocoJob *next = job->next;
+        free(job->payload);
+        free(job);
+        job = next;
+    }
+}
+
+void croco_close(CrocoHandle *handle) {
+    pthread_mutex_lock(&handle->lock);
+    handle->closing = 1;
+    pthread_cond_signal(&handle->queued);
+    pthread_mutex_unlock(&handle->lock);
+    pthread_join(handle->thread, NULL);
+
+    free_jobs(handle->waiting);
+    free_jobs(handle->finished);
+    cleanup(&handle->device);
+    pthread_cond_destroy(&handle->queued);
+    pthread_mutex_destroy(&handle->lock);
+    close(handle->wake_fd[0]);
+    close(handle->wake_fd[1]);
+    free(handle);
+}
+
+const uint8_t *croco_serial(const CrocoHandle *handle) {
+    return handle->device.has_serial ? handle->device.serial : NULL;
+}
+
+void croco_set_progress(CrocoHandle *handle, croco_progress_fn progress, void *user) {
+    pthread_mutex_lock(&handle->lock);
+    handle->progress = progress;
+    handle->progress_user = user;
+    pthread_mutex_unlock(&handle->lock);
+}
+
+void croco_set_allow_foreign_saves(CrocoHandle *handle, int allow) {
+    pthread_mutex_lock(&handle->lock);
+    handle->allow_foreign_saves = allow;
+    pthread_mutex_unlock(&handle->lock);
+}
+
+int croco_event_fd(const CrocoHandle *handle) {
+    return handle->wake_fd[0];
+}
+
+int croco_dispatch(CrocoHandle *handle) {
+    pthread_mutex_lock(&handle->lock);
+    uint8_t drain[16];
+    while (read(handle->wake_fd[0], drain, sizeof(drain)) > 0) {
+    }
+    handle->signalled = 0;
+
+    CrocoJob *finished = handle->finished;
+    handle->finished = handle->finished_tail = NULL;
+    int report = handle->progress_pending && handle->progress;
+    handle->progress_pending = 0;
+    char stage[24];
+    memcpy(stage, handle->stage, sizeof(stage));
+    uint32_t done = handle->done;
+    uint32_t total = handle->total;
+    croco_progress_fn progress = handle->progress;
+    void *progress_user = handle->progress_user;
+    pthread_mutex_unlock(&handle->lock);
+
+    // Callbacks run unlocked, so they may queue the next operation
+    if (report) {
+        progress(handle, stage, done, total, progress_user);
+    }
+    int count = 0;
+    while (finished) {
+        CrocoJob *job = finished;
+        finished = job->next;
+        if (job->done) {
+            job->done(handle, job->status, job->user);
+        }
+        free(job->payload);
+        free(job);
+        count++;
+    }
+    return count;
+}
+
+static CrocoJob *new_job(CrocoJobKind kind, croco_done_fn done, void *user) {
+    CrocoJob *job = calloc(1, sizeof(CrocoJob));
+    if (job) {
+        job->kind = kind;
+        job->done = done;
+        job->user = user;
+    }
+    return job;
+}
+
+static int submit_job(CrocoHandle *handle, CrocoJob *job) {
+    if (!job) {
+        return -1;
+    }
+    pthread_mutex_lock(&handle->lock);
+    if (handle->closing) {
+        pthread_mutex_unlock(&handle->lock);
+        free_jobs(job);
+        return -1;
+    }
+    if (handle->waiting_tail) {
+        handle->waiting_tail->next = job;
+    } else {
+        handle->waiting = job;
+    }
+    handle->waiting_tail = job;
+    pthread_cond_signal(&handle->queued);
+    pthread_mutex_unlock(&handle->lock);
+    return 0;
+}
+
+static CrocoJob *path_job(CrocoJobKind kind, uint8_t rom_id, const char *path, croco_done_fn done, void *user) {
+    if (strlen(path) >= sizeof(((CrocoJob *)0)->path)) {
+        return NULL;
+    }
+    CrocoJob *job = new_job(kind, done, user);
+    if (job) {
+        job->rom_id = rom_id;
+        snprintf(job->path, sizeof(job->path), "%s", path);
+    }
+    return job;
+}
+
+int croco_execute(CrocoHandle *handle, uint8_t command, const uint8_t *payload, int payload_len,
+                  uint8_t *response, int response_len, croco_done_fn done, void *user) {
+    CrocoJob *job = new_job(JOB_EXECUTE, done, user);
+    if (job && payload_len > 0) {
+        job->payload = malloc(payload_len);
+        if (!job->payload) {
+            free(job);
+            return -1;
+        }
+        memcpy(job->payload, payload, payload_len);
+        job->payload_len = payload_len;
+    }
+    if (job) {
+        job->command = command;
+        job->response = response;
+        job->response_len = response_len;
+    }
+    return submit_job(handle, job);
+}
+
+int croco_list(CrocoHandle *handle, CrocoRomList *list, croco_done_fn done, void *user) {
+    CrocoJob *job = new_job(JOB_LIST, done, user);
+    if (job) {
+        job->list = list;
+    }
+    return submit_job(handle, job);
+}
+
+int croco_flash(CrocoHandle *handle, const char *rom_path, const char *name, croco_done_fn done, void *user) {
+    if (name && strlen(name) > 17) {
+        return -1;
+    }
+    CrocoJob *job = path_job(JOB_FLASH, 0, rom_path, done, user);
+    if (job && name && strcmp(name, "-") != 0) {
+        snprintf(job->name, sizeof(job->name), "%s", name);
+    }
+    return submit_job(handle, job);
+}
+
+int croco_delete(CrocoHandle *handle, uint8_t rom_id, croco_done_fn done, void *user) {
+    CrocoJob *job = new_job(JOB_DELETE, done, user);
+    if (job) {
+        job->rom_id = rom_id;
+    }
+    return submit_job(handle, job);
+}
+
+int croco_backup(CrocoHandle *handle, uint8_t rom_id, const char *save_path, croco_done_fn done, void *user) {
+    return submit_job(handle, path_job(JOB_BACKUP, rom_id, save_path, done, user));
+}
+
+int croco_restore(CrocoHandle *handle, uint8_t rom_id, const char *save_path, croco_done_fn done, void *user) {
+    return submit_job(handle, path_job(JOB_RESTORE, rom_id, save_path, done, user));
+}
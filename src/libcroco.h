@@ -0,0 +1,76 @@
+#ifndef LIBCROCO_H
+#define LIBCROCO_H
+
+#include <stdint.h>
+#include "log.h"
+
+// Embedding API (make lib: build/libcroco.a, build/libcroco.so). Each handle
+// owns one cartridge and a worker thread; operations are queued on it and
+// run one after another, and the calls below never block on the device.
+//
+// Completions and progress are not delivered from the worker. They wait on
+// the handle until croco_dispatch runs them on the caller's thread, and
+// croco_event_fd becomes readable whenever there is something to dispatch,
+// so one poll/epoll loop can drive any number of cartridges. Progress is
+// coalesced: a slow loop sees the latest counters, not every bank.
+//
+// Nothing is written to stdout; messages go to the croco_set_log sink, whose
+// source argument is the CrocoHandle whose operation printed them (NULL for
+// messages from croco_open and croco_open_all before a handle exists).
+
+typedef struct CrocoHandle CrocoHandle;
+
+typedef struct {
+    uint8_t id;
+    char name[18];
+    uint8_t ram_banks;
+    uint8_t mbc;
+    uint16_t rom_banks;         // 16 KiB banks the ROM occupies
+} CrocoRom;
+
+typedef struct {
+    uint16_t used_banks;
+    uint16_t max_banks;
+    int count;
+    CrocoRom roms[256];
+} CrocoRomList;
+
+// status is 0 or -1; for croco_execute it is the response length, or -1
+typedef void (*croco_done_fn)(CrocoHandle *handle, int status, void *user);
+typedef void (*croco_progress_fn)(CrocoHandle *handle, const char *stage, uint32_t done, uint32_t total, void *user);
+
+// libusb and the CROCO_METRICS counters; once per process
+int croco_init(void);
+void croco_exit(void);
+
+// The first cartridge, or the CROCO_SIM / CROCO_REPLAY backend
+int croco_open(CrocoHandle **handle);
+// Every attached cartridge, at most max; returns how many handles were opened
+int croco_open_all(CrocoHandle **handles, int max);
+// Waits for the running operation; queued ones and undispatched callbacks are dropped
+void croco_close(CrocoHandle *handle);
+
+// 0xFD serial ID, read when the handle was opened; NULL if the cartridge did not report one
+const uint8_t *croco_serial(const CrocoHandle *handle);
+void croco_set_progress(CrocoHandle *handle, croco_progress_fn progress, void *user);
+// Off by default: a save archived or recorded from another ROM name is not
+// restored to a slot. Takes effect from the next operation the worker starts.
+void croco_set_allow_foreign_saves(CrocoHandle *handle, int allow);
+
+int croco_event_fd(const CrocoHandle *handle);
+// Runs the pending progress and completion callbacks; returns how many operations completed
+int croco_dispatch(CrocoHandle *handle);
+
+// Each returns 0 once the operation is queued. Buffers the caller passes in
+// must stay valid until its completion; paths and names are copied.
+int croco_execute(CrocoHandle *handle, uint8_t command, const uint8_t *payload, int payload_len,
+                  uint8_t *response, int response_len, croco_done_fn done, void *user);
+int croco_list(CrocoHandle *handle, CrocoRomList *list, croco_done_fn done, void *user);
+// name NULL or "-" uses the header title
+int croco_flash(CrocoHandle *handle, const char *rom_path, const char *name, croco_done_fn done, void *user);
+int croco_delete(CrocoHandle *handle, uint8_t rom_id, croco_done_fn done, void *user);
+// A .crlz save path writes the compressed container
+int croco_backup(CrocoHandle *handle, uint8_t rom_id, const char *save_path, croco_done_fn done, void *user);
+int croco_restore(CrocoHandle *handle, uint8_t rom_id, const char *save_path, croco_done_fn done, void *user);
+
+#endif
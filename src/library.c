@@ -0,0 +1,580 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "library.h"
+#include "hash.h"
+#include "romcache.h"
+#include "romheader.h"
+#include "transport.h"
+
+// On-disk layout (little endian), in the cache directory:
+//   "CRLB" | version u8 | 3 reserved | count u32
+//   count x { crc32 u32 | sha1[20] | size u32 | mtime u64 | name[17] | num_ram_banks u8 |
+//             mbc u8 | num_rom_banks u16 | cgb_flag u8 | header_ok u8 | path_len u16 | path }
+#define LIBRARY_MAGIC "CRLB"
+#define LIBRARY_VERSION 1
+#define LIBRARY_HEADER 12
+#define LIBRARY_RECORD 61
+#define LIBRARY_HASH_STEP (1 << 20)     // CRC and SHA-1 take turns on each MiB while it is in cache
+
+static void put_le16(uint8_t *p, uint16_t v) {
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static void put_le32(uint8_t *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = (v >> (i * 8)) & 0xFF;
+    }
+}
+
+static void put_le64(uint8_t *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+        p[i] = (v >> (i * 8)) & 0xFF;
+    }
+}
+
+static uint16_t get_le16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get_le64(const uint8_t *p) {
+    return (uint64_t)get_le32(p) | ((uint64_t)get_le32(p + 4) << 32);
+}
+
+static int library_path(char *buf, size_t len) {
+    char dir[200];
+    if (romcache_dir(dir, sizeof(dir)) != 0) {
+        return -1;
+    }
+    snprintf(buf, len, "%s/library.index", dir);
+    return 0;
+}
+
+static int library_push(RomLibrary *lib, const LibraryEntry *entry) {
+    if (lib->count == lib->cap) {
+        int cap = lib->cap ? lib->cap * 2 : 256;
+        LibraryEntry *grown = realloc(lib->entries, cap * sizeof(LibraryEntry));
+        if (!grown) {
+            return -1;
+        }
+        lib->entries = grown;
+        lib->cap = cap;
+    }
+    lib->entries[lib->count++] = *entry;
+    return 0;
+}
+
+void library_free(RomLibrary *lib) {
+    for (int i = 0; i < lib->count; i++) {
+        free(lib->entries[i].path);
+    }
+    free(lib->entries);
+    memset(lib, 0, sizeof(*lib));
+}
+
+int library_load(RomLibrary *lib) {
+    memset(lib, 0, sizeof(*lib));
+    char path[256];
+    if (library_path(path, sizeof(path)) != 0) {
+        return -1;
+    }
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return 0;
+    }
+
+    uint8_t header[LIBRARY_HEADER];
+    if (fread(header, 1, sizeof(header), f) != sizeof(header) ||
+        memcmp(header, LIBRARY_MAGIC, 4) != 0 || header[4] != LIBRARY_VERSION) {
+        fclose(f);
+        fprintf(stderr, "Ignoring library index %s: unknown format\n", path);
+        return 0;
+    }
+
+    uint32_t count = get_le32(header + 8);
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t rec[LIBRARY_RECORD];
+        if (fread(rec, 1, sizeof(rec), f) != sizeof(rec)) {
+            break;
+        }
+        LibraryEntry entry = {0};
+        entry.crc32 = get_le32(rec);
+        memcpy(entry.sha1, rec + 4, 20);
+        entry.size = get_le32(rec + 24);
+        entry.mtime = (int64_t)get_le64(rec + 28);
+        memcpy(entry.info.name, rec + 36, 17);
+        entry.info.name[17] = '\0';
+        entry.info.num_ram_banks = rec[53];
+        entry.info.mbc = rec[54];
+        entry.info.num_rom_banks = get_le16(rec + 55);
+        entry.info.rom_id = 0xFF;
+        entry.cgb_flag = rec[57];
+        entry.header_ok = rec[58];
+
+        uint16_t path_len = get_le16(rec + 59);
+        entry.path = malloc(path_len + 1);
+        if (!entry.path || fread(entry.path, 1, path_len, f) != path_len) {
+            free(entry.path);
+            break;
+        }
+        entry.path[path_len] = '\0';
+        if (library_push(lib, &entry) != 0) {
+            free(entry.path);
+            break;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+int library_save(const RomLibrary *lib) {
+    char path[256], tmp[264];
+    if (romcache_mkdir() != 0 || library_path(path, sizeof(path)) != 0) {
+        return -1;
+    }
+
+    // Temp file and rename, like the flash journal
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "wb");
+    if (!f) {
+        return -1;
+    }
+
+    uint8_t header[LIBRARY_HEADER] = {0};
+    memcpy(header, LIBRARY_MAGIC, 4);
+    header[4] = LIBRARY_VERSION;
+    put_le32(header + 8, (uint32_t)lib->count);
+    int ok = fwrite(header, 1, sizeof(header), f) == sizeof(header);
+
+    for (int i = 0; ok && i < lib->count; i++) {
+        const LibraryEntry *entry = &lib->entries[i];
+        size_t path_len = strlen(entry->path);
+        uint8_t rec[LIBRARY_RECORD] = {0};
+        put_le32(rec, entry->crc32);
+        memcpy(rec + 4, entry->sha1, 20);
+        put_le32(rec + 24, entry->size);
+        put_le64(rec + 28, (uint64_t)entry->mtime);
+        memcpy(rec + 36, entry->info.name, 17);
+        rec[53] = entry->info.num_ram_banks;
+        rec[54] = entry->info.mbc;
+        put_le16(rec + 55, entry->info.num_rom_banks);
+        rec[57] = entry->cgb_flag;
+        rec[58] = entry->header_ok;
+        put_le16(rec + 59, (uint16_t)path_len);
+        ok = fwrite(rec, 1, sizeof(rec), f) == sizeof(rec) && fwrite(entry->path, 1, path_len, f) == path_len;
+    }
+
+    if (fclose(f) != 0 || !ok || rename(tmp, path) != 0) {
+        remove(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+// Scanning
+
+typedef struct {
+    char *path;
+    int64_t mtime;
+    uint32_t size;
+    int reuse;                  // index into the old library, -1 to hash
+    int known;                  // the old library has this path, changed or not
+    int failed;
+    LibraryEntry entry;
+} ScanItem;
+
+typedef struct {
+    ScanItem *items;
+    int count;
+    int cap;
+    int next;                   // next item for a worker
+    pthread_mutex_t lock;
+} ScanPool;
+
+static int is_rom_file(const char *name) {
+    const char *ext = strrchr(name, '.');
+    return ext && (strcasecmp(ext, ".gb") == 0 || strcasecmp(ext, ".gbc") == 0);
+}
+
+static void scan_walk(ScanPool *pool, const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) {
+        return;
+    }
+
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        if (de->d_name[0] == '.') {
+            continue;
+        }
+        char path[PATH_MAX];
+        if (snprintf(path, sizeof(path), "%s/%s", dir, de->d_name) >= (int)sizeof(path)) {
+            continue;
+        }
+        struct stat st;
+        if (stat(path, &st) != 0) {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            scan_walk(pool, path);
+            continue;
+        }
+        if (!S_ISREG(st.st_mode) || !is_rom_file(de->d_name) || st.st_size == 0 || st.st_size > UINT32_MAX) {
+            continue;
+        }
+
+        if (pool->count == pool->cap) {
+            int cap = pool->cap ? pool->cap * 2 : 256;
+            ScanItem *grown = realloc(pool->items, cap * sizeof(ScanItem));
+            if (!grown) {
+                break;
+            }
+            pool->items = grown;
+            pool->cap = cap;
+        }
+        ScanItem *item = &pool->items[pool->count];
+        memset(item, 0, sizeof(*item));
+        item->path = strdup(path);
+        item->size = (uint32_t)st.st_size;
+        item->mtime = (int64_t)st.st_mtime;
+        item->reuse = -1;
+        if (item->path) {
+            pool->count++;
+        }
+    }
+    closedir(d);
+}
+
+static int hash_rom(ScanItem *item) {
+    int fd = open(item->path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    void *map = mmap(NULL, item->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    madvise(map, item->size, MADV_SEQUENTIAL);
+    const uint8_t *data = map;
+
+    LibraryEntry *entry = &item->entry;
+    RomHeader header;
+    if (romheader_parse(data, item->size, &header) == 0) {
+        snprintf(entry->info.name, sizeof(entry->info.name), "%s", header.title);
+        entry->info.num_ram_banks = header.ram_banks;
+        entry->info.mbc = header.cart_type;
+        entry->cgb_flag = header.cgb_flag;
+        entry->header_ok = (romheader_verify(&header, item->size, 0) == 0);
+    }
+    entry->info.rom_id = 0xFF;
+    entry->info.num_rom_banks = (uint16_t)((item->size + ROM_BANK_SIZE - 1) / ROM_BANK_SIZE);
+
+    Sha1 sha;
+    sha1_init(&sha);
+    uint32_t crc = 0;
+    for (uint32_t off = 0; off < item->size; off += LIBRARY_HASH_STEP) {
+        uint32_t len = item->size - off < LIBRARY_HASH_STEP ? item->size - off : LIBRARY_HASH_STEP;
+        crc = crc32_update(crc, data + off, len);
+        sha1_update(&sha, data + off, len);
+    }
+    sha1_final(&sha, entry->sha1);
+    entry->crc32 = crc;
+    munmap(map, item->size);
+    return 0;
+}
+
+static void *scan_worker(void *arg) {
+    ScanPool *pool = arg;
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        int i = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+        if (i >= pool->count) {
+            return NULL;
+        }
+        ScanItem *item = &pool->items[i];
+        if (item->reuse < 0 && hash_rom(item) != 0) {
+            item->failed = 1;
+        }
+    }
+}
+
+static int under_dir(const char *path, const char *dir, size_t dir_len) {
+    return strncmp(path, dir, dir_len) == 0 && (path[dir_len] == '/' || path[dir_len] == '\0');
+}
+
+static int compare_entry_path(const void *a, const void *b) {
+    const LibraryEntry *x = *(const LibraryEntry *const *)a;
+    const LibraryEntry *y = *(const LibraryEntry *const *)b;
+    return strcmp(x->path, y->path);
+}
+
+int library_scan(RomLibrary *lib, const char *dir) {
+    char root[PATH_MAX];
+    if (!realpath(dir, root)) {
+        fprintf(stderr, "\x1b[1;31m   [!] Error: Cannot open directory %s\x1b[0m\n", dir);
+        return -1;
+    }
+    size_t root_len = strlen(root);
+
+    ScanPool pool = {0};
+    pthread_mutex_init(&pool.lock, NULL);
+    scan_walk(&pool, root);
+
+    // Unchanged files keep their hashes; look them up by path
+    const LibraryEntry **by_path = malloc((lib->count + 1) * sizeof(LibraryEntry *));
+    if (!by_path) {
+        pthread_mutex_destroy(&pool.lock);
+        free(pool.items);
+        return -1;
+    }
+    for (int i = 0; i < lib->count; i++) {
+        by_path[i] = &lib->entries[i];
+    }
+    qsort(by_path, lib->count, sizeof(LibraryEntry *), compare_entry_path);
+
+    int to_hash = 0;
+    uint64_t hash_bytes = 0;
+    for (int i = 0; i < pool.count; i++) {
+        ScanItem *item = &pool.items[i];
+        LibraryEntry key = { .path = item->path };
+        const LibraryEntry *keyp = &key;
+        const LibraryEntry **found = bsearch(&keyp, by_path, lib->count, sizeof(LibraryEntry *), compare_entry_path);
+        item->known = (found != NULL);
+        if (found && (*found)->size == item->size && (*found)->mtime == item->mtime) {
+            item->reuse = (int)(*found - lib->entries);
+        } else {
+            to_hash++;
+            hash_bytes += item->size;
+        }
+    }
+    free(by_path);
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = cpus < 1 ? 1 : (cpus > LIBRARY_MAX_THREADS ? LIBRARY_MAX_THREADS : (int)cpus);
+    threads = threads > to_hash ? (to_hash > 0 ? to_hash : 1) : threads;
+
+    printf("\n\x1b[1;34m   [>] Indexing %s: %d ROM file(s), %d to hash on %d thread(s)...\x1b[0m\n",
+           root, pool.count, to_hash, threads);
+
+    uint64_t start_ns = monotonic_ns();
+    pthread_t workers[LIBRARY_MAX_THREADS];
+    int started = 0;
+    for (int t = 0; t < threads; t++) {
+        if (pthread_create(&workers[started], NULL, scan_worker, &pool) == 0) {
+            started++;
+        }
+    }
+    if (started == 0) {
+        scan_worker(&pool);
+    }
+    for (int t = 0; t < started; t++) {
+        pthread_join(workers[t], NULL);
+    }
+    double seconds = (monotonic_ns() - start_ns) / 1e9;
+
+    // Entries outside the scanned tree stay; inside it the scan is the truth
+    RomLibrary next = {0};
+    int removed = 0;
+    int ret = 0;
+    for (int i = 0; i < lib->count; i++) {
+        LibraryEntry *entry = &lib->entries[i];
+        if (!under_dir(entry->path, root, root_len)) {
+            ret |= library_push(&next, entry);
+            entry->path = NULL;
+        } else {
+            removed++;
+        }
+    }
+    int failed = 0;
+    int bad_header = 0;
+    for (int i = 0; i < pool.count; i++) {
+        ScanItem *item = &pool.items[i];
+        LibraryEntry entry;
+        if (item->failed) {
+            failed++;
+            free(item->path);
+            continue;
+        }
+        if (item->reuse >= 0) {
+            entry = lib->entries[item->reuse];
+            free(entry.path);
+            lib->entries[item->reuse].path = NULL;
+        } else {
+            entry = item->entry;
+            entry.size = item->size;
+            entry.mtime = item->mtime;
+        }
+        entry.path = item->path;
+        bad_header += !entry.header_ok;
+        removed -= item->known;
+        if (library_push(&next, &entry) != 0) {
+            free(item->path);
+            ret = -1;
+        }
+    }
+    library_free(lib);
+    *lib = next;
+    pthread_mutex_destroy(&pool.lock);
+    free(pool.items);
+
+    printf("   \x1b[1;32m[+] %d ROM(s) indexed\x1b[0m: %d hashed, %d unchanged, %d removed",
+           pool.count - failed, to_hash - failed, pool.count - to_hash, removed);
+    if (bad_header) {
+        printf(", \x1b[1;33m%d with a bad header\x1b[0m", bad_header);
+    }
+    if (failed) {
+        printf(", \x1b[1;31m%d unreadable\x1b[0m", failed);
+    }
+    printf("\n");
+    if (to_hash > 0) {
+        printf("       %.1f MiB hashed in %.2f s (%.1f MiB/s)\n", hash_bytes / 1048576.0, seconds,
+               seconds > 0 ? hash_bytes / 1048576.0 / seconds : 0.0);
+    }
+    return ret;
+}
+
+// Queries
+
+static int parse_hex(const char *text, uint8_t *out, int max) {
+    int n = 0;
+    for (; text[0] && text[1] && n < max; text += 2) {
+        if (!isxdigit((unsigned char)text[0]) || !isxdigit((unsigned char)text[1])) {
+            return -1;
+        }
+        char byte[3] = { text[0], text[1], '\0' };
+        out[n++] = (uint8_t)strtoul(byte, NULL, 16);
+    }
+    return (*text == '\0') ? n : -1;
+}
+
+static int contains_nocase(const char *haystack, const char *needle) {
+    size_t n = strlen(needle);
+    for (; *haystack; haystack++) {
+        if (strncasecmp(haystack, needle, n) == 0) {
+            return 1;
+        }
+    }
+    return n == 0;
+}
+
+static int entry_matches(const LibraryEntry *entry, const char *query) {
+    if (strncasecmp(query, "crc:", 4) == 0) {
+        return entry->crc32 == (uint32_t)strtoul(query + 4, NULL, 16);
+    }
+    if (strncasecmp(query, "sha1:", 5) == 0) {
+        uint8_t prefix[20];
+        int n = parse_hex(query + 5, prefix, 20);
+        return n > 0 && memcmp(entry->sha1, prefix, n) == 0;
+    }
+    if (strncasecmp(query, "mbc:", 4) == 0) {
+        char *end;
+        unsigned long code = strtoul(query + 4, &end, 16);
+        if (*end == '\0' && end != query + 4) {
+            return entry->info.mbc == code;
+        }
+        return contains_nocase(romheader_mbc_name(entry->info.mbc), query + 4);
+    }
+    const char *base = strrchr(entry->path, '/');
+    return contains_nocase(entry->info.name, query) || contains_nocase(base ? base + 1 : entry->path, query);
+}
+
+int library_find(const RomLibrary *lib, const char *query, const LibraryEntry **matches, int max) {
+    int count = 0;
+    for (int i = 0; i < lib->count; i++) {
+        if (entry_matches(&lib->entries[i], query)) {
+            if (count < max) {
+                matches[count] = &lib->entries[i];
+            }
+            count++;
+        }
+    }
+    return count;
+}
+
+static void print_entries(const LibraryEntry **entries, int count) {
+    printf(" \x1b[1;37m  CRC32     TITLE             | ROM SIZE   | RAM     | TYPE\x1b[0m\n");
+    printf(" \x1b[90m  --------  ----------------- | ---------- | ------- | ----\x1b[0m\n");
+    for (int i = 0; i < count; i++) {
+        const LibraryEntry *entry = entries[i];
+        printf("   \x1b[32m%08x\x1b[0m  \x1b[1;36m%-17s\x1b[0m | \x1b[33m%3u Banks \x1b[0m | RAM: %2u | %s%s\n",
+               entry->crc32, entry->info.name, entry->info.num_rom_banks, entry->info.num_ram_banks,
+               romheader_mbc_name(entry->info.mbc), entry->header_ok ? "" : " \x1b[1;31m(bad header)\x1b[0m");
+        printf("             \x1b[90m%s\x1b[0m\n", entry->path);
+    }
+}
+
+int library_scan_dir(const char *dir) {
+    RomLibrary lib;
+    if (library_load(&lib) != 0) {
+        fprintf(stderr, "\x1b[1;31m   [!] Error: No cache directory for the library index\x1b[0m\n");
+        return -1;
+    }
+    int ret = library_scan(&lib, dir);
+    if (ret == 0 && library_save(&lib) != 0) {
+        fprintf(stderr, "\x1b[1;31m   [!] Error: Could not write the library index\x1b[0m\n");
+        ret = -1;
+    }
+    library_free(&lib);
+    return ret;
+}
+
+int library_print(const char *query) {
+    RomLibrary lib;
+    if (library_load(&lib) != 0) {
+        return -1;
+    }
+    const LibraryEntry **matches = malloc((lib.count + 1) * sizeof(LibraryEntry *));
+    if (!matches) {
+        library_free(&lib);
+        return -1;
+    }
+    int count = library_find(&lib, query, matches, lib.count);
+
+    printf("\n   \x1b[1;34m[>] %d of %d ROM(s) in the library match '%s'\x1b[0m\n\n", count, lib.count, query);
+    if (count > 0) {
+        print_entries(matches, count);
+    }
+    free(matches);
+    library_free(&lib);
+    return count > 0 ? 0 : -1;
+}
+
+int library_resolve(const char *query, char *path, size_t len) {
+    RomLibrary lib;
+    if (library_load(&lib) != 0) {
+        return -1;
+    }
+
+    const LibraryEntry *matches[LIBRARY_MAX_MATCHES];
+    int count = library_find(&lib, query, matches, LIBRARY_MAX_MATCHES);
+    if (count == 1) {
+        snprintf(path, len, "%s", matches[0]->path);
+        library_free(&lib);
+        return 0;
+    }
+
+    if (count == 0) {
+        printf("\x1b[1;31m[!] No ROM in the library matches '%s'\x1b[0m\n", query);
+    } else {
+        printf("\x1b[1;31m[!] '%s' matches %d ROMs, be more specific:\x1b[0m\n\n", query, count);
+        print_entries(matches, count < LIBRARY_MAX_MATCHES ? count : LIBRARY_MAX_MATCHES);
+    }
+    library_free(&lib);
+    return -1;
+}
@@ -0,0 +1,49 @@
+#ifndef CROCO_LIBRARY_H
+#define CROCO_LIBRARY_H
+
+#include "croco.h"
+
+#define LIBRARY_MAX_THREADS 16
+#define LIBRARY_MAX_MATCHES 32      // candidates listed when a query is ambiguous
+
+// Local ROM collection, indexed by content. The metadata comes from the ROM
+// header in the same shape as the cartridge's ROM table, so library entries
+// and cartridge slots can be compared directly.
+typedef struct {
+    RomInfo info;               // title, SRAM banks, cartridge type and 16 KiB banks; rom_id unused
+    uint32_t crc32;
+    uint8_t sha1[20];
+    uint32_t size;
+    int64_t mtime;
+    uint8_t cgb_flag;
+    uint8_t header_ok;          // header and checksums match the file (see romheader_verify)
+    char *path;                 // absolute
+} LibraryEntry;
+
+typedef struct {
+    LibraryEntry *entries;
+    int count;
+    int cap;
+} RomLibrary;
+
+// The index lives in the cache directory as library.index; a missing index is an empty library
+int library_load(RomLibrary *lib);
+int library_save(const RomLibrary *lib);
+void library_free(RomLibrary *lib);
+
+// Indexes every .gb/.gbc below dir on a thread pool. Files whose size and
+// mtime are unchanged keep their hashes; entries whose file is gone are dropped.
+int library_scan(RomLibrary *lib, const char *dir);
+
+// Query forms: crc:<8 hex>, sha1:<hex prefix>, mbc:<type name or code>,
+// anything else matches the title or file name, case-insensitively.
+// Stores up to max matches and returns how many there are in total.
+int library_find(const RomLibrary *lib, const char *query, const LibraryEntry **matches, int max);
+
+// Batch operations
+int library_scan_dir(const char *dir);
+int library_print(const char *query);
+// flash @<query>: the path of the one ROM the query matches
+int library_resolve(const char *query, char *path, size_t len);
+
+#endif
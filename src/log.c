@@ -0,0 +1,64 @@
+#include <stdarg.h>
+#include <stdlib.h>
+#include "log.h"
+
+static croco_log_fn log_sink;
+static void *log_user;
+static __thread void *log_source;
+
+void croco_set_log(croco_log_fn sink, void *user) {
+    log_sink = sink;
+    log_user = user;
+}
+
+void *croco_log_set_source(void *source) {
+    void *previous = log_source;
+    log_source = source;
+    return previous;
+}
+
+static int log_vprintf(int level, const char *format, va_list args) {
+    char line[512];
+    va_list again;
+    va_copy(again, args);
+    int len = vsnprintf(line, sizeof(line), format, args);
+    if (len < 0 || !log_sink) {
+        va_end(again);
+        return len;
+    }
+
+    // Tables and banners fit the stack buffer; anything longer is formatted again
+    if ((size_t)len < sizeof(line)) {
+        log_sink(log_user, log_source, level, line);
+    } else {
+        char *text = malloc((size_t)len + 1);
+        if (text) {
+            vsnprintf(text, (size_t)len + 1, format, again);
+            log_sink(log_user, log_source, level, text);
+            free(text);
+        }
+    }
+    va_end(again);
+    return len;
+}
+
+int croco_log_printf(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int len = log_vprintf(CROCO_LOG_INFO, format, args);
+    va_end(args);
+    return len;
+}
+
+int croco_log_fprintf(FILE *stream, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int len;
+    if (stream == stdout || stream == stderr) {
+        len = log_vprintf(stream == stderr ? CROCO_LOG_ERROR : CROCO_LOG_INFO, format, args);
+    } else {
+        len = vfprintf(stream, format, args);
+    }
+    va_end(args);
+    return len;
+}
@@ -0,0 +1,34 @@
+#ifndef CROCO_LOG_H
+#define CROCO_LOG_H
+
+#include <stdio.h>
+
+// Where the protocol modules' messages go. The library build (make lib)
+// compiles every module with -DCROCO_LIBRARY -include src/log.h, which turns
+// their printf and fprintf(stdout/stderr, ...) into calls below, so nothing
+// reaches the embedding process's stdout. Without a sink the text is dropped;
+// the CLI installs one that writes to the real streams.
+
+#define CROCO_LOG_INFO 0            // was stdout
+#define CROCO_LOG_ERROR 1           // was stderr
+
+// May be called from any thread that runs an operation. source is what the
+// calling thread last passed to croco_log_set_source: libcroco tags each
+// worker with its CrocoHandle, the CLI tags session threads with their
+// session. NULL for messages from untagged threads.
+typedef void (*croco_log_fn)(void *user, void *source, int level, const char *text);
+
+void croco_set_log(croco_log_fn sink, void *user);
+// Thread-local; returns the previous source of the calling thread
+void *croco_log_set_source(void *source);
+
+int croco_log_printf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+// Other streams (metrics files, the session terminal) are written as usual
+int croco_log_fprintf(FILE *stream, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+#ifdef CROCO_LIBRARY
+#define printf(...) croco_log_printf(__VA_ARGS__)
+#define fprintf(stream, ...) croco_log_fprintf(stream, __VA_ARGS__)
+#endif
+
+#endif
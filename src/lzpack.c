@@ -0,0 +1,487 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "lzpack.h"
+#include "hash.h"
+
+// LZ77 in the LZ4 sequence layout: a token byte with the literal count in
+// the high nibble and the match length minus 4 in the low one (15 means more
+// length bytes follow, each adding up to 255), the literals, then a 16-bit
+// offset back into the output. The last sequence of a block is literals only.
+// SRAM and ROM padding are long single-byte runs, which become offset-1
+// matches of any length.
+
+#define LZPACK_VERSION 1
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 12
+
+static uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static uint32_t lz_hash(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static void put_le32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t get_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+size_t lzpack_bound(size_t raw_size) {
+    return raw_size + raw_size / 255 + 16;
+}
+
+static uint8_t *put_length(uint8_t *op, const uint8_t *end, size_t len) {
+    for (; len >= 255; len -= 255) {
+        if (op >= end) {
+            return NULL;
+        }
+        *op++ = 255;
+    }
+    if (op >= end) {
+        return NULL;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+// One sequence; match_len 0 for the closing literals-only one
+static uint8_t *put_sequence(uint8_t *op, const uint8_t *end, const uint8_t *lit, size_t lit_len,
+                             size_t offset, size_t match_len) {
+    if (op >= end) {
+        return NULL;
+    }
+    size_t ml = match_len ? match_len - LZ_MIN_MATCH : 0;
+    uint8_t *token = op++;
+    *token = (uint8_t)(((lit_len < 15 ? lit_len : 15) << 4) | (ml < 15 ? ml : 15));
+    if (lit_len >= 15 && !(op = put_length(op, end, lit_len - 15))) {
+        return NULL;
+    }
+    if ((size_t)(end - op) < lit_len) {
+        return NULL;
+    }
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+    if (!match_len) {
+        return op;
+    }
+    if (end - op < 2) {
+        return NULL;
+    }
+    *op++ = (uint8_t)offset;
+    *op++ = (uint8_t)(offset >> 8);
+    if (ml >= 15 && !(op = put_length(op, end, ml - 15))) {
+        return NULL;
+    }
+    return op;
+}
+
+size_t lzpack_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap) {
+    uint32_t table[1 << LZ_HASH_BITS] = {0};   // position + 1, 0 for empty
+    const uint8_t *end = dst + cap;
+    uint8_t *op = dst;
+    size_t anchor = 0;
+    size_t ip = 0;
+
+    while (ip + LZ_MIN_MATCH <= len) {
+        uint32_t h = lz_hash(read32(src + ip));
+        size_t cand = table[h];
+        table[h] = (uint32_t)(ip + 1);
+        if (cand == 0 || ip - (cand - 1) > LZ_MAX_OFFSET || read32(src + cand - 1) != read32(src + ip)) {
+            ip++;
+            continue;
+        }
+        cand--;
+
+        size_t match = LZ_MIN_MATCH;
+        while (ip + match < len && src[cand + match] == src[ip + match]) {
+            match++;
+        }
+        op = put_sequence(op, end, src + anchor, ip - anchor, ip - cand, match);
+        if (!op) {
+            return 0;
+        }
+        ip += match;
+        anchor = ip;
+    }
+
+    op = put_sequence(op, end, src + anchor, len - anchor, 0, 0);
+    return op ? (size_t)(op - dst) : 0;
+}
+
+static int get_length(const uint8_t **ip, const uint8_t *end, size_t *len) {
+    uint8_t b;
+    do {
+        if (*ip >= end) {
+            return -1;
+        }
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+int lzpack_decompress(const uint8_t *src, size_t len, uint8_t *out, size_t out_len) {
+    const uint8_t *ip = src;
+    const uint8_t *end = src + len;
+    size_t op = 0;
+
+    while (ip < end) {
+        uint8_t token = *ip++;
+        size_t lit = token >> 4;
+        if (lit == 15 && get_length(&ip, end, &lit) != 0) {
+            return -1;
+        }
+        if ((size_t)(end - ip) < lit || out_len - op < lit) {
+            return -1;
+        }
+        memcpy(out + op, ip, lit);
+        ip += lit;
+        op += lit;
+        if (ip == end) {
+            break;
+        }
+
+        if (end - ip < 2) {
+            return -1;
+        }
+        size_t offset = ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        size_t match = token & 15;
+        if (match == 15 && get_length(&ip, end, &match) != 0) {
+            return -1;
+        }
+        match += LZ_MIN_MATCH;
+        if (offset == 0 || offset > op || out_len - op < match) {
+            return -1;
+        }
+        // Overlapping copies are how runs are stored, so byte by byte
+        const uint8_t *from = out + op - offset;
+        for (size_t i = 0; i < match; i++) {
+            out[op + i] = from[i];
+        }
+        op += match;
+    }
+    return op == out_len ? 0 : -1;
+}
+
+int lzpack_is_packed(const uint8_t *data, size_t size) {
+    return size >= LZPACK_HEADER_SIZE && memcmp(data, LZPACK_MAGIC, 4) == 0 && data[4] == LZPACK_VERSION;
+}
+
+int lzpack_wants(const char *path) {
+    size_t len = strlen(path);
+    size_t suffix = strlen(LZPACK_SUFFIX);
+    return len > suffix && strcmp(path + len - suffix, LZPACK_SUFFIX) == 0;
+}
+
+struct LzWriter {
+    FILE *f;
+    char path[512];
+    char tmp[520];
+    uint64_t raw_size;
+    size_t fill;
+    uint8_t block[LZPACK_BLOCK_SIZE];
+    uint8_t packed[LZPACK_BLOCK_HEADER_SIZE + LZPACK_BLOCK_SIZE + LZPACK_BLOCK_SIZE / 255 + 16];
+};
+
+LzWriter *lzpack_create(const char *path) {
+    LzWriter *writer = calloc(1, sizeof(LzWriter));
+    if (!writer) {
+        return NULL;
+    }
+    snprintf(writer->path, sizeof(writer->path), "%s", path);
+    snprintf(writer->tmp, sizeof(writer->tmp), "%s.tmp", path);
+    writer->f = fopen(writer->tmp, "wb");
+
+    // The raw size is filled in on close
+    uint8_t header[LZPACK_HEADER_SIZE] = {0};
+    memcpy(header, LZPACK_MAGIC, 4);
+    header[4] = LZPACK_VERSION;
+    if (!writer->f || fwrite(header, 1, sizeof(header), writer->f) != sizeof(header)) {
+        lzpack_abort(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+static int flush_block(LzWriter *writer) {
+    if (writer->fill == 0) {
+        return 0;
+    }
+    uint8_t *data = writer->packed + LZPACK_BLOCK_HEADER_SIZE;
+    size_t stored = lzpack_compress(writer->block, writer->fill, data, writer->fill - 1);
+    if (stored == 0) {
+        memcpy(data, writer->block, writer->fill);
+        stored = writer->fill;
+    }
+    put_le32(writer->packed, (uint32_t)writer->fill);
+    put_le32(writer->packed + 4, (uint32_t)stored);
+    put_le32(writer->packed + 8, crc32_update(0, writer->block, writer->fill));
+
+    size_t total = LZPACK_BLOCK_HEADER_SIZE + stored;
+    if (fwrite(writer->packed, 1, total, writer->f) != total) {
+        return -1;
+    }
+    writer->fill = 0;
+    return 0;
+}
+
+int lzpack_write(LzWriter *writer, const uint8_t *data, size_t len) {
+    while (len > 0) {
+        size_t take = LZPACK_BLOCK_SIZE - writer->fill < len ? LZPACK_BLOCK_SIZE - writer->fill : len;
+        memcpy(writer->block + writer->fill, data, take);
+        writer->fill += take;
+        writer->raw_size += take;
+        data += take;
+        len -= take;
+        if (writer->fill == LZPACK_BLOCK_SIZE && flush_block(writer) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int lzpack_close(LzWriter *writer) {
+    uint8_t size[8];
+    for (int i = 0; i < 8; i++) {
+        size[i] = (uint8_t)(writer->raw_size >> (i * 8));
+    }
+    int ok = flush_block(writer) == 0 && fseek(writer->f, 8, SEEK_SET) == 0 &&
+             fwrite(size, 1, 8, writer->f) == 8 && fflush(writer->f) == 0 && fsync(fileno(writer->f)) == 0;
+    ok = (fclose(writer->f) == 0) && ok;
+    writer->f = NULL;
+    if (!ok || rename(writer->tmp, writer->path) != 0) {
+        lzpack_abort(writer);
+        return -1;
+    }
+    free(writer);
+    return 0;
+}
+
+void lzpack_abort(LzWriter *writer) {
+    if (writer->f) {
+        fclose(writer->f);
+    }
+    unlink(writer->tmp);
+    free(writer);
+}
+
+struct LzReader {
+    FILE *f;
+    uint64_t raw_size;
+    size_t pos;
+    size_t len;
+    uint8_t block[LZPACK_BLOCK_SIZE];
+    uint8_t packed[LZPACK_BLOCK_SIZE];
+};
+
+LzReader *lzpack_open(const char *path) {
+    LzReader *reader = calloc(1, sizeof(LzReader));
+    if (!reader) {
+        return NULL;
+    }
+    uint8_t header[LZPACK_HEADER_SIZE];
+    reader->f = fopen(path, "rb");
+    if (!reader->f || fread(header, 1, sizeof(header), reader->f) != sizeof(header) ||
+        !lzpack_is_packed(header, sizeof(header))) {
+        lzpack_close_reader(reader);
+        return NULL;
+    }
+    for (int i = 0; i < 8; i++) {
+        reader->raw_size |= (uint64_t)header[8 + i] << (i * 8);
+    }
+
+    // Every block takes at least its header and one stored byte, which bounds
+    // what the file can decode to before anyone allocates for it
+    struct stat st;
+    if (fstat(fileno(reader->f), &st) != 0 ||
+        reader->raw_size > (uint64_t)(st.st_size - LZPACK_HEADER_SIZE) / (LZPACK_BLOCK_HEADER_SIZE + 1) * LZPACK_BLOCK_SIZE) {
+        lzpack_close_reader(reader);
+        return NULL;
+    }
+    return reader;
+}
+
+uint64_t lzpack_raw_size(const LzReader *reader) {
+    return reader->raw_size;
+}
+
+static int next_block(LzReader *reader) {
+    uint8_t header[LZPACK_BLOCK_HEADER_SIZE];
+    size_t got = fread(header, 1, sizeof(header), reader->f);
+    if (got == 0 && feof(reader->f)) {
+        return 0;
+    }
+    uint32_t raw = get_le32(header);
+    uint32_t stored = get_le32(header + 4);
+    if (got != sizeof(header) || raw == 0 || raw > LZPACK_BLOCK_SIZE || stored > raw ||
+        fread(reader->packed, 1, stored, reader->f) != stored) {
+        return -1;
+    }
+
+    if (stored == raw) {
+        memcpy(reader->block, reader->packed, raw);
+    } else if (lzpack_decompress(reader->packed, stored, reader->block, raw) != 0) {
+        return -1;
+    }
+    if (crc32_update(0, reader->block, raw) != get_le32(header + 8)) {
+        return -1;
+    }
+    reader->pos = 0;
+    reader->len = raw;
+    return 1;
+}
+
+long lzpack_read(LzReader *reader, uint8_t *out, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        if (reader->pos == reader->len) {
+            int ret = next_block(reader);
+            if (ret < 0) {
+                return -1;
+            }
+            if (ret == 0) {
+                break;
+            }
+        }
+        size_t take = reader->len - reader->pos < len - done ? reader->len - reader->pos : len - done;
+        memcpy(out + done, reader->block + reader->pos, take);
+        reader->pos += take;
+        done += take;
+    }
+    return (long)done;
+}
+
+void lzpack_close_reader(LzReader *reader) {
+    if (reader->f) {
+        fclose(reader->f);
+    }
+    free(reader);
+}
+
+int lzpack_load(const char *path, uint64_t max_size, uint8_t **data, long *size) {
+    LzReader *reader = lzpack_open(path);
+    if (!reader) {
+        return -1;
+    }
+    uint64_t raw_size = lzpack_raw_size(reader);
+    uint8_t *raw = (raw_size <= max_size && raw_size <= LONG_MAX) ? malloc(raw_size ? raw_size : 1) : NULL;
+    uint8_t extra;
+    int ok = raw && lzpack_read(reader, raw, raw_size) == (long)raw_size && lzpack_read(reader, &extra, 1) == 0;
+    lzpack_close_reader(reader);
+    if (!ok) {
+        free(raw);
+        return -1;
+    }
+    *data = raw;
+    *size = (long)raw_size;
+    return 0;
+}
+
+long lzpack_save(const char *path, const uint8_t *data, size_t len) {
+    LzWriter *writer = lzpack_create(path);
+    if (!writer) {
+        return -1;
+    }
+    if (lzpack_write(writer, data, len) != 0) {
+        lzpack_abort(writer);
+        return -1;
+    }
+    struct stat st;
+    if (lzpack_close(writer) != 0 || stat(path, &st) != 0) {
+        return -1;
+    }
+    return (long)st.st_size;
+}
+
+int lzpack_pack_file(const char *in_path, const char *out_path) {
+    FILE *in = fopen(in_path, "rb");
+    if (!in) {
+        printf("\x1b[1;31m[!] ERROR: Could not open %s\x1b[0m\n", in_path);
+        return -1;
+    }
+    LzWriter *writer = lzpack_create(out_path);
+    uint8_t *buf = malloc(LZPACK_BLOCK_SIZE);
+    if (!writer || !buf) {
+        printf("\x1b[1;31m[!] ERROR: Could not create %s\x1b[0m\n", out_path);
+        if (writer) {
+            lzpack_abort(writer);
+        }
+        free(buf);
+        fclose(in);
+        return -1;
+    }
+
+    size_t got;
+    int ok = 1;
+    while (ok && (got = fread(buf, 1, LZPACK_BLOCK_SIZE, in)) > 0) {
+        ok = lzpack_write(writer, buf, got) == 0;
+    }
+    ok = ok && !ferror(in);
+    free(buf);
+    fclose(in);
+    uint64_t raw_size = writer->raw_size;
+    if (!ok) {
+        lzpack_abort(writer);
+    }
+    if (!ok || lzpack_close(writer) != 0) {
+        printf("\x1b[1;31m[!] ERROR: Could not write %s\x1b[0m\n", out_path);
+        return -1;
+    }
+
+    FILE *out = fopen(out_path, "rb");
+    long packed = 0;
+    if (out) {
+        fseek(out, 0, SEEK_END);
+        packed = ftell(out);
+        fclose(out);
+    }
+    printf("\x1b[1;32m[+] %s: %llu -> %ld bytes (%.1f%%)\x1b[0m\n", out_path, (unsigned long long)raw_size, packed,
+           raw_size ? 100.0 * packed / raw_size : 0.0);
+    return 0;
+}
+
+int lzpack_unpack_file(const char *in_path, const char *out_path) {
+    LzReader *reader = lzpack_open(in_path);
+    if (!reader) {
+        printf("\x1b[1;31m[!] ERROR: %s is not a .crlz file\x1b[0m\n", in_path);
+        return -1;
+    }
+
+    // Like the writer, the output only appears under its name once complete
+    char tmp[520];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", out_path);
+    FILE *out = fopen(tmp, "wb");
+    uint8_t *buf = malloc(LZPACK_BLOCK_SIZE);
+    uint64_t total = 0;
+    long got = 0;
+    while (out && buf && (got = lzpack_read(reader, buf, LZPACK_BLOCK_SIZE)) > 0 && fwrite(buf, 1, got, out) == (size_t)got) {
+        total += got;
+    }
+    int ok = out && buf && got == 0 && total == lzpack_raw_size(reader) && fflush(out) == 0 && fsync(fileno(out)) == 0;
+    free(buf);
+    lzpack_close_reader(reader);
+    if (out) {
+        ok = (fclose(out) == 0) && ok;
+    }
+    if (!ok || rename(tmp, out_path) != 0) {
+        unlink(tmp);
+        printf("\x1b[1;31m[!] ERROR: Could not unpack %s\x1b[0m\n", in_path);
+        return -1;
+    }
+    printf("\x1b[1;32m[+] %s: %llu bytes\x1b[0m\n", out_path, (unsigned long long)total);
+    return 0;
+}
@@ -0,0 +1,61 @@
+#ifndef CROCO_LZPACK_H
+#define CROCO_LZPACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Compressed container for saves and ROMs (.crlz). The image is cut into
+// blocks of up to 64 KiB, each compressed on its own, so a reader never
+// holds more than one block and a writer can stream as data arrives.
+//
+//   header  magic "CRLZ" | version u8 | 3 reserved | raw size u64 LE
+//   block   raw len u32 LE | stored len u32 LE | crc32 of the raw bytes u32 LE | data
+//
+// A block whose stored length equals its raw length is kept uncompressed.
+
+#define LZPACK_MAGIC "CRLZ"
+#define LZPACK_HEADER_SIZE 16
+#define LZPACK_BLOCK_HEADER_SIZE 12
+#define LZPACK_BLOCK_SIZE 65536
+#define LZPACK_SUFFIX ".crlz"
+
+// Worst-case compressed size of one block
+size_t lzpack_bound(size_t raw_size);
+// Returns the compressed size, or 0 if the output would not fit in cap
+size_t lzpack_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap);
+// Returns 0 if src decodes to exactly out_len bytes
+int lzpack_decompress(const uint8_t *src, size_t len, uint8_t *out, size_t out_len);
+
+int lzpack_is_packed(const uint8_t *data, size_t size);
+// Whether path ends in .crlz, the name that selects this format for output
+int lzpack_wants(const char *path);
+
+typedef struct LzWriter LzWriter;
+typedef struct LzReader LzReader;
+
+// The file appears under its name only once lzpack_close succeeds
+LzWriter *lzpack_create(const char *path);
+int lzpack_write(LzWriter *writer, const uint8_t *data, size_t len);
+int lzpack_close(LzWriter *writer);
+void lzpack_abort(LzWriter *writer);
+
+// Writes a whole image as a .crlz file; returns the file size or -1
+long lzpack_save(const char *path, const uint8_t *data, size_t len);
+
+// Fails on a raw size the file's blocks could not hold
+LzReader *lzpack_open(const char *path);
+uint64_t lzpack_raw_size(const LzReader *reader);
+// Fills up to len bytes; returns how many, 0 at the end, -1 on a damaged block
+long lzpack_read(LzReader *reader, uint8_t *out, size_t len);
+void lzpack_close_reader(LzReader *reader);
+
+// Batch operations: pack <in> <out> and unpack <in> <out>, streaming a block at a time
+int lzpack_pack_file(const char *in_path, const char *out_path);
+int lzpack_unpack_file(const char *in_path, const char *out_path);
+
+// Decodes a whole file into the heap, refusing one that would expand past
+// max_size; the caller frees *data
+int lzpack_load(const char *path, uint64_t max_size, uint8_t **data, long *size);
+
+#endif
@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include "manifest.h"
+#include "library.h"
+
+// Splits off the next field, honouring double quotes; NULL at the end of the line
+static char *next_field(char **cursor) {
+    char *p = *cursor;
+    while (isspace((unsigned char)*p)) {
+        p++;
+    }
+    if (*p == '\0' || *p == '#') {
+        return NULL;
+    }
+
+    char *start = p;
+    if (*p == '"') {
+        start = ++p;
+        while (*p && *p != '"') {
+            p++;
+        }
+    } else {
+        while (*p && !isspace((unsigned char)*p)) {
+            p++;
+        }
+    }
+    if (*p) {
+        *p++ = '\0';
+    }
+    *cursor = p;
+    return start;
+}
+
+int manifest_add(Manifest *manifest, const char *rom, const char *name, int priority, int line) {
+    if (manifest->count == MANIFEST_MAX_ENTRIES) {
+        printf("\x1b[1;31m[!] More than %d ROMs in one manifest\x1b[0m\n", MANIFEST_MAX_ENTRIES);
+        return -1;
+    }
+    ManifestEntry *entry = &manifest->entries[manifest->count];
+    memset(entry, 0, sizeof(*entry));
+    if (rom[0] == '@') {
+        if (library_resolve(rom + 1, entry->path, sizeof(entry->path)) != 0) {
+            return -1;
+        }
+    } else {
+        snprintf(entry->path, sizeof(entry->path), "%s", rom);
+    }
+    snprintf(entry->name, sizeof(entry->name), "%s", name);
+    entry->priority = priority;
+    entry->line = line;
+    manifest->count++;
+    return 0;
+}
+
+// 1 for a blank or comment line
+static int parse_line(Manifest *manifest, char *line, int number) {
+    char *cursor = line;
+    char *rom = next_field(&cursor);
+    if (!rom) {
+        return 1;
+    }
+    char *name = next_field(&cursor);
+    char *priority = next_field(&cursor);
+    long value = 1;
+
+    if (name && strlen(name) > 17) {
+        printf("\x1b[1;31m[!] Line %d: display name too long (max 17 chars): %s\x1b[0m\n", number, name);
+        return -1;
+    }
+    if (priority) {
+        char *end;
+        errno = 0;
+        value = strtol(priority, &end, 10);
+        if (errno != 0 || *end != '\0' || value < 1 || value > 1000000) {
+            printf("\x1b[1;31m[!] Line %d: invalid priority: %s\x1b[0m\n", number, priority);
+            return -1;
+        }
+    }
+    if (next_field(&cursor)) {
+        printf("\x1b[1;31m[!] Line %d: too many fields\x1b[0m\n", number);
+        return -1;
+    }
+    if (manifest_add(manifest, rom, name ? name : "-", (int)value, number) != 0) {
+        printf("\x1b[1;31m[!] Line %d: %s was not added\x1b[0m\n", number, rom);
+        return -1;
+    }
+    return 0;
+}
+
+int manifest_load(const char *file, Manifest *manifest) {
+    memset(manifest, 0, sizeof(*manifest));
+    FILE *f = fopen(file, "r");
+    if (!f) {
+        printf("\x1b[1;31m[!] Could not open manifest %s\x1b[0m\n", file);
+        return -1;
+    }
+    manifest->entries = calloc(MANIFEST_MAX_ENTRIES, sizeof(ManifestEntry));
+    if (!manifest->entries) {
+        fclose(f);
+        return -1;
+    }
+
+    // Every line is checked so one run reports all the mistakes
+    char line[1024];
+    int number = 0;
+    int errors = 0;
+    while (fgets(line, sizeof(line), f)) {
+        number++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (parse_line(manifest, line, number) < 0) {
+            errors++;
+        }
+    }
+    fclose(f);
+
+    if (errors == 0 && manifest->count == 0) {
+        printf("\x1b[1;31m[!] Manifest %s lists no ROMs\x1b[0m\n", file);
+        errors++;
+    }
+    if (errors) {
+        manifest_free(manifest);
+        return -1;
+    }
+    return 0;
+}
+
+void manifest_free(Manifest *manifest) {
+    free(manifest->entries);
+    manifest->entries = NULL;
+    manifest->count = 0;
+}
@@ -0,0 +1,34 @@
+#ifndef CROCO_MANIFEST_H
+#define CROCO_MANIFEST_H
+
+// A list of ROMs to put on a cartridge, one per line:
+//
+//   # rom                 name         priority
+//   roms/zelda.gbc        "Zelda DX"   10
+//   "@pokemon red"        -            5
+//
+// The name defaults to "-" (the header title) and the priority to 1. Fields
+// are separated by whitespace; double quotes keep a field with spaces
+// together. A ROM of @<query> is looked up in the library.
+
+#define MANIFEST_MAX_ENTRIES 256
+
+typedef struct {
+    char path[512];             // resolved file
+    char name[18];              // display name, "-" for the header title
+    int priority;
+    int line;
+} ManifestEntry;
+
+typedef struct {
+    ManifestEntry *entries;
+    int count;
+} Manifest;
+
+// Prints every problem with its line number; -1 if there was any
+int manifest_load(const char *file, Manifest *manifest);
+// Appends one ROM, resolving @<query>; the entries array must be allocated
+int manifest_add(Manifest *manifest, const char *rom, const char *name, int priority, int line);
+void manifest_free(Manifest *manifest);
+
+#endif
@@ -0,0 +1,385 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <signal.h>
+#include "metrics.h"
+
+// Per-opcode counters and histograms for everything that crosses the bus.
+// Off by default: the call sites test metrics_enabled before taking a
+// timestamp, so a run without CROCO_METRICS pays one predictable branch.
+//
+// Every thread records into its own shard, so the pipeline threads of
+// several cartridges never wait on each other. Only the owner writes a
+// shard; a dump sums all of them under shard_lock. A thread that exits
+// folds its shard into `retired` first. Within a shard the per-opcode
+// blocks are allocated on first use, so the few opcodes a thread touches
+// are all that costs memory.
+
+typedef struct MetricsShard {
+    OpcodeMetrics *ops[256];
+    struct MetricsShard *next;
+} MetricsShard;
+
+int metrics_enabled;
+
+static MetricsShard *shards;            // live threads
+static MetricsShard retired;            // threads that exited
+static pthread_mutex_t shard_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t shard_key;
+static pthread_once_t shard_once = PTHREAD_ONCE_INIT;
+static __thread MetricsShard *local_shard;
+static char dump_path[256];
+static volatile sig_atomic_t dump_requested;
+
+// Single writer per shard: a load and a store, no locked add. Relaxed atomics
+// keep the dump's concurrent reads defined.
+static void bump(uint64_t *p, uint64_t v) {
+    __atomic_store_n(p, __atomic_load_n(p, __ATOMIC_RELAXED) + v, __ATOMIC_RELAXED);
+}
+
+static void bump32(uint32_t *p) {
+    __atomic_store_n(p, __atomic_load_n(p, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+}
+
+static uint64_t load(const uint64_t *p) {
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+static int bucket_index(uint64_t us) {
+    if (us < METRICS_SUB_BUCKETS) {
+        return (int)us;
+    }
+    int k = 63 - __builtin_clzll(us);
+    if (k >= METRICS_MAX_MAGNITUDE) {
+        return METRICS_BUCKETS - 1;
+    }
+    return (k - 3) * METRICS_SUB_BUCKETS + (int)((us >> (k - 4)) - METRICS_SUB_BUCKETS);
+}
+
+static uint64_t bucket_lower_us(int index) {
+    if (index < METRICS_SUB_BUCKETS) {
+        return (uint64_t)index;
+    }
+    int k = index / METRICS_SUB_BUCKETS + 3;
+    uint64_t sub = (uint64_t)(index % METRICS_SUB_BUCKETS);
+    return (METRICS_SUB_BUCKETS + sub) << (k - 4);
+}
+
+// The shard's count is left at 0; merging sums it from the buckets, so a
+// dump racing a sample never sees more bucket entries than samples
+static void histogram_record(MetricsHistogram *hist, uint64_t ns) {
+    uint64_t us = ns / 1000;
+    bump(&hist->total_us, us);
+    if (us > load(&hist->max_us)) {
+        __atomic_store_n(&hist->max_us, us, __ATOMIC_RELAXED);
+    }
+    bump32(&hist->buckets[bucket_index(us)]);
+}
+
+static void histogram_merge(MetricsHistogram *dst, const MetricsHistogram *src) {
+    for (int b = 0; b < METRICS_BUCKETS; b++) {
+        uint32_t n = __atomic_load_n(&src->buckets[b], __ATOMIC_RELAXED);
+        dst->buckets[b] += n;
+        dst->count += n;
+    }
+    dst->total_us += load(&src->total_us);
+    uint64_t max_us = load(&src->max_us);
+    if (max_us > dst->max_us) {
+        dst->max_us = max_us;
+    }
+}
+
+// Called with shard_lock held; dst belongs to the caller
+static void shard_merge(MetricsShard *dst, MetricsShard *src) {
+    for (int op = 0; op < 256; op++) {
+        const OpcodeMetrics *m = __atomic_load_n(&src->ops[op], __ATOMIC_ACQUIRE);
+        if (!m || (!dst->ops[op] && !(dst->ops[op] = calloc(1, sizeof(OpcodeMetrics))))) {
+            continue;
+        }
+        OpcodeMetrics *d = dst->ops[op];
+        d->bytes_out += load(&m->bytes_out);
+        d->bytes_in += load(&m->bytes_in);
+        d->timeouts += load(&m->timeouts);
+        d->echo_mismatches += load(&m->echo_mismatches);
+        d->errors += load(&m->errors);
+        histogram_merge(&d->send, &m->send);
+        histogram_merge(&d->response, &m->response);
+    }
+}
+
+static void shard_free_ops(MetricsShard *shard) {
+    for (int op = 0; op < 256; op++) {
+        free(shard->ops[op]);
+        shard->ops[op] = NULL;
+    }
+}
+
+// Runs on the exiting thread
+static void shard_exit(void *arg) {
+    MetricsShard *shard = arg;
+    local_shard = NULL;
+    pthread_mutex_lock(&shard_lock);
+    MetricsShard **link = &shards;
+    while (*link && *link != shard) {
+        link = &(*link)->next;
+    }
+    if (*link) {
+        *link = shard->next;
+    }
+    shard_merge(&retired, shard);
+    pthread_mutex_unlock(&shard_lock);
+    shard_free_ops(shard);
+    free(shard);
+}
+
+static void shard_key_init(void) {
+    pthread_key_create(&shard_key, shard_exit);
+}
+
+static MetricsShard *thread_shard(void) {
+    if (local_shard) {
+        return local_shard;
+    }
+    MetricsShard *shard = calloc(1, sizeof(MetricsShard));
+    if (!shard) {
+        return NULL;
+    }
+    pthread_once(&shard_once, shard_key_init);
+    pthread_mutex_lock(&shard_lock);
+    shard->next = shards;
+    shards = shard;
+    pthread_mutex_unlock(&shard_lock);
+    pthread_setspecific(shard_key, shard);
+    local_shard = shard;
+    return shard;
+}
+
+// The sum of every shard, for one dump; release with shard_free_ops
+static void metrics_snapshot(MetricsShard *total) {
+    memset(total, 0, sizeof(*total));
+    pthread_mutex_lock(&shard_lock);
+    shard_merge(total, &retired);
+    for (MetricsShard *shard = shards; shard; shard = shard->next) {
+        shard_merge(total, shard);
+    }
+    pthread_mutex_unlock(&shard_lock);
+}
+
+uint64_t metrics_percentile_us(const MetricsHistogram *hist, double pct) {
+    if (hist->count == 0) {
+        return 0;
+    }
+    uint64_t target = (uint64_t)(hist->count * pct / 100.0 + 0.5);
+    if (target < 1) {
+        target = 1;
+    }
+
+    // Highest value that falls into the same bucket, capped at the real maximum
+    uint64_t seen = 0;
+    for (int b = 0; b < METRICS_BUCKETS; b++) {
+        seen += hist->buckets[b];
+        if (seen >= target) {
+            uint64_t upper = (b + 1 < METRICS_BUCKETS) ? bucket_lower_us(b + 1) - 1 : hist->max_us;
+            return upper < hist->max_us ? upper : hist->max_us;
+        }
+    }
+    return hist->max_us;
+}
+
+static OpcodeMetrics *opcode_slot(uint8_t opcode) {
+    MetricsShard *shard = thread_shard();
+    if (!shard) {
+        return NULL;
+    }
+    OpcodeMetrics *m = shard->ops[opcode];
+    if (!m && (m = calloc(1, sizeof(OpcodeMetrics)))) {
+        __atomic_store_n(&shard->ops[opcode], m, __ATOMIC_RELEASE);
+    }
+    return m;
+}
+
+void metrics_poll(void) {
+    // Claimed atomically, so one signal is one dump however many threads poll
+    if (dump_path[0] && __sync_lock_test_and_set(&dump_requested, 0)) {
+        metrics_dump(dump_path);
+    }
+}
+
+void metrics_record_send(uint8_t opcode, uint64_t ns, int bytes) {
+    OpcodeMetrics *m = opcode_slot(opcode);
+    if (m) {
+        histogram_record(&m->send, ns);
+        bump(&m->bytes_out, bytes > 0 ? (uint64_t)bytes : 0);
+    }
+    metrics_poll();
+}
+
+void metrics_record_response(uint8_t opcode, uint64_t ns, int bytes) {
+    OpcodeMetrics *m = opcode_slot(opcode);
+    if (m) {
+        histogram_record(&m->response, ns);
+        bump(&m->bytes_in, bytes > 0 ? (uint64_t)bytes : 0);
+    }
+}
+
+static void count_event(uint8_t opcode, size_t offset) {
+    OpcodeMetrics *m = opcode_slot(opcode);
+    if (m) {
+        bump((uint64_t *)((char *)m + offset), 1);
+    }
+}
+
+void metrics_count_timeout(uint8_t opcode) {
+    count_event(opcode, offsetof(OpcodeMetrics, timeouts));
+}
+
+void metrics_count_echo_mismatch(uint8_t opcode) {
+    count_event(opcode, offsetof(OpcodeMetrics, echo_mismatches));
+}
+
+void metrics_count_error(uint8_t opcode) {
+    count_event(opcode, offsetof(OpcodeMetrics, errors));
+}
+
+static void write_histogram_json(FILE *out, const char *name, const MetricsHistogram *hist) {
+    fprintf(out, "\"%s\":{\"count\":%llu,\"mean\":%.1f,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"p999\":%llu,\"max\":%llu}",
+            name, (unsigned long long)hist->count,
+            hist->count ? (double)hist->total_us / hist->count : 0.0,
+            (unsigned long long)metrics_percentile_us(hist, 50),
+            (unsigned long long)metrics_percentile_us(hist, 90),
+            (unsigned long long)metrics_percentile_us(hist, 99),
+            (unsigned long long)metrics_percentile_us(hist, 99.9),
+            (unsigned long long)hist->max_us);
+}
+
+void metrics_write_json(FILE *out) {
+    MetricsShard total;
+    metrics_snapshot(&total);
+    fprintf(out, "{\"unit\":\"us\",\"opcodes\":[");
+    int first = 1;
+    for (int op = 0; op < 256; op++) {
+        const OpcodeMetrics *m = total.ops[op];
+        if (!m) {
+            continue;
+        }
+        fprintf(out, "%s\n  {\"opcode\":\"0x%02X\",\"commands\":%llu,\"bytes_out\":%llu,\"bytes_in\":%llu,"
+                     "\"timeouts\":%llu,\"echo_mismatches\":%llu,\"errors\":%llu,",
+                first ? "" : ",", op, (unsigned long long)m->send.count,
+                (unsigned long long)m->bytes_out, (unsigned long long)m->bytes_in,
+                (unsigned long long)m->timeouts, (unsigned long long)m->echo_mismatches,
+                (unsigned long long)m->errors);
+        write_histogram_json(out, "send_us", &m->send);
+        fprintf(out, ",");
+        write_histogram_json(out, "response_us", &m->response);
+        fprintf(out, "}");
+        first = 0;
+    }
+    fprintf(out, "\n]}\n");
+    shard_free_ops(&total);
+}
+
+static void write_counter_family(FILE *out, const MetricsShard *total, const char *name, const char *help, size_t offset) {
+    fprintf(out, "# HELP %s %s\n# TYPE %s counter\n", name, help, name);
+    for (int op = 0; op < 256; op++) {
+        const OpcodeMetrics *m = total->ops[op];
+        if (m) {
+            fprintf(out, "%s{opcode=\"0x%02X\"} %llu\n", name, op,
+                    (unsigned long long)*(const uint64_t *)((const char *)m + offset));
+        }
+    }
+}
+
+// Buckets at every power of two up to the largest sample. le is inclusive,
+// so the histogram bucket that starts at the bound counts in full: a bound
+// may include samples up to one sub-bucket (~6%) above it.
+static void write_histogram_family(FILE *out, const MetricsShard *total, const char *name, const char *help, size_t offset) {
+    fprintf(out, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    for (int op = 0; op < 256; op++) {
+        const OpcodeMetrics *m = total->ops[op];
+        if (!m) {
+            continue;
+        }
+        const MetricsHistogram *hist = (const MetricsHistogram *)((const char *)m + offset);
+        uint64_t cumulative = 0;
+        int b = 0;
+        for (int k = 0; k < METRICS_MAX_MAGNITUDE; k++) {
+            uint64_t bound = 1ull << k;
+            for (; b < METRICS_BUCKETS && bucket_lower_us(b) <= bound; b++) {
+                cumulative += hist->buckets[b];
+            }
+            fprintf(out, "%s_bucket{opcode=\"0x%02X\",le=\"%g\"} %llu\n", name, op, bound / 1e6,
+                    (unsigned long long)cumulative);
+            if (bound >= hist->max_us) {
+                break;
+            }
+        }
+        fprintf(out, "%s_bucket{opcode=\"0x%02X\",le=\"+Inf\"} %llu\n", name, op, (unsigned long long)hist->count);
+        fprintf(out, "%s_sum{opcode=\"0x%02X\"} %g\n", name, op, hist->total_us / 1e6);
+        fprintf(out, "%s_count{opcode=\"0x%02X\"} %llu\n", name, op, (unsigned long long)hist->count);
+    }
+}
+
+void metrics_write_prometheus(FILE *out) {
+    MetricsShard total;
+    metrics_snapshot(&total);
+    write_counter_family(out, &total, "croco_bytes_out_total", "Bytes sent to the cartridge.", offsetof(OpcodeMetrics, bytes_out));
+    write_counter_family(out, &total, "croco_bytes_in_total", "Bytes received from the cartridge.", offsetof(OpcodeMetrics, bytes_in));
+    write_counter_family(out, &total, "croco_timeouts_total", "Responses that never arrived.", offsetof(OpcodeMetrics, timeouts));
+    write_counter_family(out, &total, "croco_echo_mismatches_total", "Responses echoing another command.", offsetof(OpcodeMetrics, echo_mismatches));
+    write_counter_family(out, &total, "croco_errors_total", "USB errors on send or receive.", offsetof(OpcodeMetrics, errors));
+    write_histogram_family(out, &total, "croco_send_seconds", "Bulk OUT time per command.", offsetof(OpcodeMetrics, send));
+    write_histogram_family(out, &total, "croco_response_seconds", "Time from queueing the IN transfer to the response.", offsetof(OpcodeMetrics, response));
+    shard_free_ops(&total);
+}
+
+int metrics_dump(const char *path) {
+    if (strcmp(path, "-") == 0) {
+        metrics_write_json(stdout);
+        return 0;
+    }
+
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "Failed to write metrics to %s\n", path);
+        return -1;
+    }
+    size_t len = strlen(path);
+    if (len > 5 && strcmp(path + len - 5, ".prom") == 0) {
+        metrics_write_prometheus(f);
+    } else {
+        metrics_write_json(f);
+    }
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+static void dump_at_exit(void) {
+    metrics_dump(dump_path);
+}
+
+static void on_dump_signal(int sig) {
+    (void)sig;
+    dump_requested = 1;
+}
+
+void metrics_enable(void) {
+    metrics_enabled = 1;
+}
+
+void metrics_init_from_env(void) {
+    const char *path = getenv("CROCO_METRICS");
+    if (!path || !*path) {
+        return;
+    }
+    snprintf(dump_path, sizeof(dump_path), "%s", path);
+    metrics_enable();
+    atexit(dump_at_exit);
+
+    // The dump itself happens on the next command, outside the handler
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_dump_signal;
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &sa, NULL);
+}
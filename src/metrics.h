@@ -0,0 +1,53 @@
+#ifndef CROCO_METRICS_H
+#define CROCO_METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Log-linear histogram in microseconds, as in HdrHistogram: values below 16
+// are exact, above that each power of two is split into 16 steps (~6%).
+#define METRICS_SUB_BUCKETS 16
+#define METRICS_MAX_MAGNITUDE 34    // values below 2^34 us, far past any USB timeout
+#define METRICS_BUCKETS ((METRICS_MAX_MAGNITUDE - 3) * METRICS_SUB_BUCKETS)
+
+typedef struct {
+    uint64_t count;
+    uint64_t total_us;
+    uint64_t max_us;
+    uint32_t buckets[METRICS_BUCKETS];
+} MetricsHistogram;
+
+typedef struct {
+    uint64_t bytes_out;
+    uint64_t bytes_in;
+    uint64_t timeouts;
+    uint64_t echo_mismatches;
+    uint64_t errors;
+    MetricsHistogram send;          // bulk OUT submit to completion, one sample per command
+    MetricsHistogram response;      // command sent to response received
+} OpcodeMetrics;
+
+// Every recording site checks this first, so disabled metrics cost one branch
+extern int metrics_enabled;
+
+// CROCO_METRICS=<path> enables recording and writes the metrics at exit;
+// SIGUSR1 writes them on demand. A .prom path selects Prometheus text, anything else JSON.
+void metrics_init_from_env(void);
+void metrics_enable(void);
+// Writes the metrics if SIGUSR1 asked for them. Every send polls; loops that
+// can sit idle without sending, like the daemon's, poll as well.
+void metrics_poll(void);
+
+void metrics_record_send(uint8_t opcode, uint64_t ns, int bytes);
+void metrics_record_response(uint8_t opcode, uint64_t ns, int bytes);
+void metrics_count_timeout(uint8_t opcode);
+void metrics_count_echo_mismatch(uint8_t opcode);
+void metrics_count_error(uint8_t opcode);
+
+uint64_t metrics_percentile_us(const MetricsHistogram *hist, double pct);
+void metrics_write_json(FILE *out);
+void metrics_write_prometheus(FILE *out);
+// "-" writes JSON to stdout
+int metrics_dump(const char *path);
+
+#endif
@@ -0,0 +1,259 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "metrics.h"
+#include "pipeline.h"
+#include "response.h"
+#include "transport.h"
+
+// Windowed chunk transport on top of the async transfer API.
+//
+// Every chunk gets its own OUT transfer (command + payload) and IN transfer
+// (2-byte ack, or the chunk itself on a read stream). Acks carry no bank/chunk tag, so they are matched to chunks
+// purely by order: IN transfers on one endpoint complete in the order they
+// were submitted, and we always submit them in chunk order.
+//
+// The slots live in a ring owned by the device and allocated once, so a
+// stream costs no allocation and each chunk is framed straight into the
+// buffer its OUT transfer sends from.
+
+typedef struct Pipeline Pipeline;
+
+typedef struct {
+    Pipeline *pipe;
+    CrocoTransfer out;
+    CrocoTransfer in;
+    uint8_t out_buf[1 + CHUNK_PAYLOAD_SIZE];
+    uint8_t in_buf[64];
+    uint32_t seq;
+    int out_pending;
+    int in_pending;
+} PipelineSlot;
+
+struct PipelineRing {
+    PipelineSlot slots[PIPELINE_MAX_WINDOW];
+};
+
+struct Pipeline {
+    CrocoDevice *device;
+    PipelineJob *job;
+    PipelineSlot *slots;
+    uint32_t next_seq;  // next chunk to submit
+    uint32_t acked;     // chunks acknowledged so far
+    int in_flight;      // transfers currently owned by the transport
+    int error;
+};
+
+static void pipeline_fail(Pipeline *pipe, uint32_t seq, int status) {
+    if (pipe->error) {
+        return;
+    }
+    pipe->error = 1;
+    pipe->job->failed_seq = seq;
+    pipe->job->failed_status = status;
+
+    // Reap everything still queued so the event loop can drain
+    for (int i = 0; i < pipe->job->window; i++) {
+        PipelineSlot *slot = &pipe->slots[i];
+        if (slot->out_pending) {
+            transfer_cancel(&slot->out);
+        }
+        if (slot->in_pending) {
+            transfer_cancel(&slot->in);
+        }
+    }
+}
+
+static void pipeline_submit_ready(Pipeline *pipe);
+
+static void pipeline_out_cb(CrocoTransfer *transfer) {
+    PipelineSlot *slot = transfer->user_data;
+    Pipeline *pipe = slot->pipe;
+
+    slot->out_pending = 0;
+    pipe->in_flight--;
+
+    if (transfer->status != XFER_COMPLETED) {
+        if (metrics_enabled) {
+            metrics_count_error(pipe->job->command);
+        }
+        pipeline_fail(pipe, slot->seq, PIPELINE_LINK_ERROR);
+        return;
+    }
+    if (metrics_enabled) {
+        metrics_record_send(pipe->job->command, monotonic_ns() - transfer->submit_ns, transfer->actual_length);
+    }
+    pipeline_submit_ready(pipe);
+}
+
+static void pipeline_in_cb(CrocoTransfer *transfer) {
+    PipelineSlot *slot = transfer->user_data;
+    Pipeline *pipe = slot->pipe;
+
+    slot->in_pending = 0;
+    pipe->in_flight--;
+
+    if (transfer->status != XFER_COMPLETED || transfer->actual_length < (pipe->job->receive ? 1 : 2)) {
+        if (metrics_enabled) {
+            if (transfer->status == XFER_TIMED_OUT) {
+                metrics_count_timeout(pipe->job->command);
+            } else if (transfer->status != XFER_CANCELLED) {
+                metrics_count_error(pipe->job->command);
+            }
+        }
+        pipeline_fail(pipe, slot->seq, PIPELINE_LINK_ERROR);
+        return;
+    }
+    if (slot->seq != pipe->acked || (!pipe->job->receive && slot->in_buf[0] != pipe->job->command)) {
+        if (metrics_enabled) {
+            metrics_count_echo_mismatch(pipe->job->command);
+        }
+        fprintf(stderr, "Chunk ack out of order: expected 0x%02x for chunk %u, got 0x%02x for chunk %u\n",
+                pipe->job->command, pipe->acked, slot->in_buf[0], slot->seq);
+        pipeline_fail(pipe, pipe->acked, PIPELINE_ACK_MISMATCH);
+        return;
+    }
+    if (pipe->job->receive) {
+        int status = pipe->job->receive(pipe->job->user, slot->seq, slot->in_buf, transfer->actual_length);
+        if (status != 0) {
+            pipeline_fail(pipe, slot->seq, status);
+            return;
+        }
+    } else if (slot->in_buf[1] != 0) {
+        pipeline_fail(pipe, slot->seq, slot->in_buf[1]);
+        return;
+    }
+
+    uint64_t latency_ns = monotonic_ns() - slot->out.submit_ns;
+    latency_record(pipe->job->command, latency_ns, 0);
+    if (metrics_enabled) {
+        metrics_record_response(pipe->job->command, latency_ns, transfer->actual_length);
+    }
+
+    pipe->acked++;
+    if (pipe->job->progress) {
+        pipe->job->progress(pipe->job->user, pipe->acked);
+    }
+    pipeline_submit_ready(pipe);
+}
+
+// Returns 0 or the PIPELINE_* status the job fails with
+static int pipeline_submit_slot(Pipeline *pipe, PipelineSlot *slot) {
+    CrocoDevice *device = pipe->device;
+    PipelineJob *job = pipe->job;
+
+    slot->seq = pipe->next_seq++;
+    slot->out_buf[0] = job->command;
+    int out_len = 1;
+    if (job->fill) {
+        if (job->fill(job->user, slot->seq, slot->out_buf + 1) != 0) {
+            return PIPELINE_FILL_ERROR;
+        }
+        out_len = sizeof(slot->out_buf);
+    }
+
+    transfer_fill(&slot->out, device, XFER_OUT, slot->out_buf, out_len,
+                  pipeline_out_cb, slot, TIMEOUT_MS);
+    transfer_fill(&slot->in, device, XFER_IN, slot->in_buf, sizeof(slot->in_buf),
+                  pipeline_in_cb, slot, TIMEOUT_MS);
+
+    if (transfer_submit(&slot->out) != 0) {
+        fprintf(stderr, "Failed to submit chunk %u\n", slot->seq);
+        return PIPELINE_LINK_ERROR;
+    }
+    slot->out_pending = 1;
+    pipe->in_flight++;
+
+    if (transfer_submit(&slot->in) != 0) {
+        fprintf(stderr, "Failed to submit ack read %u\n", slot->seq);
+        return PIPELINE_LINK_ERROR;
+    }
+    slot->in_pending = 1;
+    pipe->in_flight++;
+
+    return 0;
+}
+
+// Refill slots strictly in chunk order so IN submissions stay aligned with acks
+static void pipeline_submit_ready(Pipeline *pipe) {
+    PipelineJob *job = pipe->job;
+
+    while (!pipe->error && pipe->next_seq < job->total_chunks) {
+        PipelineSlot *slot = &pipe->slots[pipe->next_seq % job->window];
+        if (slot->out_pending || slot->in_pending) {
+            break;
+        }
+        int status = pipeline_submit_slot(pipe, slot);
+        if (status != 0) {
+            pipeline_fail(pipe, slot->seq, status);
+            break;
+        }
+    }
+}
+
+int pipeline_send_chunks(CrocoDevice *device, PipelineJob *job) {
+    if (job->window < 1) {
+        job->window = 1;
+    }
+    if (job->window > PIPELINE_MAX_WINDOW) {
+        job->window = PIPELINE_MAX_WINDOW;
+    }
+    job->acked = job->start_seq;
+    job->failed_seq = 0;
+    job->failed_status = 0;
+
+    if (!device->ring && !(device->ring = calloc(1, sizeof(PipelineRing)))) {
+        return -1;
+    }
+
+    Pipeline pipe = {0};
+    pipe.device = device;
+    pipe.job = job;
+    pipe.next_seq = job->start_seq;
+    pipe.acked = job->start_seq;
+    pipe.slots = device->ring->slots;
+    for (int i = 0; i < job->window; i++) {
+        pipe.slots[i].pipe = &pipe;
+    }
+
+    pipeline_submit_ready(&pipe);
+
+    while (pipe.in_flight > 0) {
+        if (transport_handle_events(device, 1000000000ull, NULL) != 0) {
+            pipeline_fail(&pipe, pipe.acked, PIPELINE_LINK_ERROR);
+        }
+    }
+
+    job->acked = pipe.acked;
+    int ret = 0;
+    if (pipe.error || pipe.acked != job->total_chunks) {
+        if (!pipe.error) {
+            job->failed_seq = pipe.acked;
+            job->failed_status = PIPELINE_LINK_ERROR;
+        }
+        ret = -1;
+    }
+    return ret;
+}
+
+void pipeline_release(CrocoDevice *device) {
+    free(device->ring);
+    device->ring = NULL;
+}
+
+void pipeline_frame_chunk(uint8_t *payload, uint16_t bank, uint16_t chunk, const uint8_t *data, long avail) {
+    payload[0] = (uint8_t)(bank >> 8);
+    payload[1] = (uint8_t)bank;
+    payload[2] = (uint8_t)(chunk >> 8);
+    payload[3] = (uint8_t)chunk;
+    if (avail >= CHUNK_DATA_SIZE) {
+        memcpy(payload + 4, data, CHUNK_DATA_SIZE);
+        return;
+    }
+    // Only the last chunk of a short image takes this path
+    long n = avail > 0 ? avail : 0;
+    if (n > 0) {
+        memcpy(payload + 4, data, n);
+    }
+    memset(payload + 4 + n, 0, CHUNK_DATA_SIZE - n);
+}
@@ -0,0 +1,48 @@
+#ifndef CROCO_PIPELINE_H
+#define CROCO_PIPELINE_H
+
+#include "croco.h"
+
+#define CHUNK_PAYLOAD_SIZE (4 + CHUNK_DATA_SIZE)  // 2 (bank) + 2 (chunk) + 32 (data)
+#define PIPELINE_DEFAULT_WINDOW 16
+#define PIPELINE_MAX_WINDOW 64
+
+// Fills the 36-byte payload for the seq-th chunk of the stream. payload is
+// the slot's transfer buffer itself, so the chunk is framed exactly once.
+// Returns 0, or non-zero if the data is gone, which fails the job at this chunk.
+typedef int (*pipeline_fill_fn)(void *user, uint32_t seq, uint8_t *payload);
+
+// Read streams (0x07) send the bare command and hand the raw reply, echo byte
+// included, to the callback, which validates it. Returns 0 to go on or a
+// non-zero status that fails the job at this chunk.
+typedef int (*pipeline_recv_fn)(void *user, uint32_t seq, const uint8_t *response, int len);
+
+// Called after every acknowledged chunk with the number of chunks acked so far.
+typedef void (*pipeline_progress_fn)(void *user, uint32_t acked);
+
+typedef struct {
+    uint8_t command;              // 0x03 or 0x09, or 0x07 for a read stream
+    uint32_t total_chunks;
+    uint32_t start_seq;           // first chunk to send, for resumed streams
+    int window;                   // chunks in flight, 1..PIPELINE_MAX_WINDOW
+    pipeline_fill_fn fill;        // write streams
+    pipeline_recv_fn receive;     // read streams
+    pipeline_progress_fn progress;
+    void *user;
+    uint32_t acked;               // chunks acknowledged, counting from 0
+    uint32_t failed_seq;          // set on error: first chunk that was not acked
+    int failed_status;            // status byte of the failing ack, or one of the codes below
+} PipelineJob;
+
+#define PIPELINE_LINK_ERROR (-1)      // transfer failed or timed out
+#define PIPELINE_ACK_MISMATCH (-2)    // an ack arrived for the wrong chunk or command
+#define PIPELINE_FILL_ERROR (-3)      // the fill callback had no data for the chunk; nothing was sent
+
+int pipeline_send_chunks(CrocoDevice *device, PipelineJob *job);
+// Frees the device's transfer ring; cleanup() calls it
+void pipeline_release(CrocoDevice *device);
+
+// Bank and chunk big-endian, then 32 bytes of image starting at data; past avail they are zero
+void pipeline_frame_chunk(uint8_t *payload, uint16_t bank, uint16_t chunk, const uint8_t *data, long avail);
+
+#endif
@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "planner.h"
+#include "romcache.h"
+#include "romheader.h"
+#include "romimage.h"
+
+// Priority always outweighs SRAM: no set of ROMs needs this many SRAM banks
+#define PLAN_RAM_WEIGHT (MANIFEST_MAX_ENTRIES * 16 + 1)
+
+// Opened the way the flash opens it, so plain ROMs are not copied to the heap
+// and .crlz files are counted on the image that will be sent
+static void measure_item(PlanItem *item) {
+    RomImage image;
+    if (rom_image_open(item->entry->path, &image) != 0) {
+        return;
+    }
+
+    // Same bank count as the upload request, not the one the header declares
+    long banks = (image.size + ROM_BANK_SIZE - 1) / ROM_BANK_SIZE;
+    if (banks <= 0xFFFF && image.has_header) {
+        item->banks = (uint16_t)banks;
+        item->ram_banks = image.header.ram_banks;
+        item->cart_type = image.header.cart_type;
+        item->ok = !check_rom_header || romheader_verify(&image.header, image.size, 0) == 0;
+    } else if (banks <= 0xFFFF && !check_rom_header) {
+        item->banks = (uint16_t)banks;
+        item->ok = 1;
+    }
+    rom_image_close(&image);
+}
+
+// 0/1 knapsack over the free banks, one keep bit per item and capacity
+static int select_items(CapacityPlan *plan) {
+    int cap = plan->used_banks < plan->max_banks ? plan->max_banks - plan->used_banks : 0;
+    long long *best = calloc(cap + 1, sizeof(long long));
+    uint8_t *keep = calloc((size_t)plan->count * (cap + 1), 1);
+    if (!best || !keep) {
+        free(best);
+        free(keep);
+        return -1;
+    }
+
+    for (int i = 0; i < plan->count; i++) {
+        const PlanItem *item = &plan->items[i];
+        if (!item->ok || item->banks > cap) {
+            continue;
+        }
+        long long value = (long long)item->entry->priority * PLAN_RAM_WEIGHT - item->ram_banks;
+        for (int c = cap; c >= item->banks; c--) {
+            long long with = best[c - item->banks] + value;
+            if (with > best[c]) {
+                best[c] = with;
+                keep[(size_t)i * (cap + 1) + c] = 1;
+            }
+        }
+    }
+
+    int c = cap;
+    for (int i = plan->count - 1; i >= 0; i--) {
+        PlanItem *item = &plan->items[i];
+        if (keep[(size_t)i * (cap + 1) + c]) {
+            item->selected = 1;
+            c -= item->banks;
+            plan->selected++;
+            plan->banks_selected += item->banks;
+            plan->ram_selected += item->ram_banks;
+            plan->priority_selected += item->entry->priority;
+        }
+    }
+    free(best);
+    free(keep);
+    return 0;
+}
+
+int planner_build(const Manifest *manifest, uint16_t used_banks, uint16_t max_banks, CapacityPlan *plan) {
+    memset(plan, 0, sizeof(*plan));
+    plan->items = calloc(manifest->count, sizeof(PlanItem));
+    if (!plan->items) {
+        return -1;
+    }
+    plan->count = manifest->count;
+    plan->used_banks = used_banks;
+    plan->max_banks = max_banks;
+
+    for (int i = 0; i < plan->count; i++) {
+        plan->items[i].entry = &manifest->entries[i];
+        measure_item(&plan->items[i]);
+        plan->priority_total += manifest->entries[i].priority;
+    }
+    if (select_items(plan) != 0) {
+        planner_free(plan);
+        return -1;
+    }
+    return 0;
+}
+
+void planner_print(const CapacityPlan *plan, const char *title) {
+    int free_banks = plan->used_banks < plan->max_banks ? plan->max_banks - plan->used_banks : 0;
+
+    printf("\n   \x1b[1;34m[>] Capacity plan: %s\x1b[0m\n", title);
+    printf("   \x1b[1;33m+-------------------------------------------------------------+\x1b[0m\n");
+    printf("     Cartridge: [\x1b[1;32m%u/%u Banks\x1b[0m] used, %d free\n", plan->used_banks, plan->max_banks, free_banks);
+    printf("   \x1b[1;33m+-------------------------------------------------------------+\x1b[0m\n\n");
+
+    printf(" \x1b[1;37m    PRI  NAME              | BANKS | RAM | MBC              | FIT\x1b[0m\n");
+    printf(" \x1b[90m  ------ ----------------- | ----- | --- | ---------------- | ---\x1b[0m\n");
+    for (int i = 0; i < plan->count; i++) {
+        const PlanItem *item = &plan->items[i];
+        const char *name = item->entry->name;
+        if (strcmp(name, "-") == 0) {
+            name = strrchr(item->entry->path, '/') ? strrchr(item->entry->path, '/') + 1 : item->entry->path;
+        }
+        if (!item->ok) {
+            printf("   %6d  \x1b[1;36m%-17.17s\x1b[0m | \x1b[1;31minvalid or unreadable: %s\x1b[0m\n",
+                   item->entry->priority, name, item->entry->path);
+            continue;
+        }
+        printf("   %6d  \x1b[1;36m%-17.17s\x1b[0m | %5u | %3u | %-16.16s | %s\n",
+               item->entry->priority, name, item->banks, item->ram_banks, romheader_mbc_name(item->cart_type),
+               item->selected ? "\x1b[1;32myes\x1b[0m" : "\x1b[1;31mno\x1b[0m");
+    }
+    printf(" \x1b[90m  -------------------------------------------------------------\x1b[0m\n");
+
+    printf("     Selected: \x1b[1;32m%d of %d ROMs\x1b[0m, %d banks, %d SRAM banks\n",
+           plan->selected, plan->count, plan->banks_selected, plan->ram_selected);
+    printf("     After:    %d/%u banks used, %d free\n",
+           plan->used_banks + plan->banks_selected, plan->max_banks, free_banks - plan->banks_selected);
+    printf("     Priority: %ld of %ld\n", plan->priority_selected, plan->priority_total);
+}
+
+void planner_free(CapacityPlan *plan) {
+    free(plan->items);
+    plan->items = NULL;
+    plan->count = 0;
+}
+
+int plan_cartridge(CrocoDevice *device, const char *manifest_file) {
+    Manifest manifest;
+    if (manifest_load(manifest_file, &manifest) != 0) {
+        return -1;
+    }
+
+    RomTable *table;
+    CapacityPlan plan;
+    if (romcache_read_table(device, &table) != 0) {
+        fprintf(stderr, "\x1b[1;31m[!] Error: Failed to retrieve ROM utilization\x1b[0m\n");
+        manifest_free(&manifest);
+        return -1;
+    }
+    if (planner_build(&manifest, table->used_raw, table->max_banks, &plan) != 0) {
+        manifest_free(&manifest);
+        return -1;
+    }
+
+    planner_print(&plan, manifest_file);
+    planner_free(&plan);
+    manifest_free(&manifest);
+    return 0;
+}
+
+int planner_check(CrocoDevice *device, const Manifest *manifest) {
+    RomTable *table;
+    CapacityPlan plan;
+    if (romcache_read_table(device, &table) != 0 ||
+        planner_build(manifest, table->used_raw, table->max_banks, &plan) != 0) {
+        return -1;
+    }
+
+    // ROMs with a bad header are refused by the flash itself, without sending anything
+    int fits = 1;
+    for (int i = 0; i < plan.count; i++) {
+        if (plan.items[i].ok && !plan.items[i].selected) {
+            fits = 0;
+        }
+    }
+    if (!fits) {
+        printf("\x1b[1;31m[!] These ROMs do not all fit on the cartridge; nothing was sent.\x1b[0m\n");
+        planner_print(&plan, "flash operations");
+    }
+    planner_free(&plan);
+    return fits ? 0 : -1;
+}
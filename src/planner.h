@@ -0,0 +1,41 @@
+#ifndef CROCO_PLANNER_H
+#define CROCO_PLANNER_H
+
+#include "croco.h"
+#include "manifest.h"
+
+// Fits a candidate ROM set into the flash left on a cartridge. Sizes are the
+// 16 KiB banks the upload request will ask for and SRAM needs come from the
+// headers; the subset kept is the one with the highest total priority, ties
+// going to the one that needs fewer SRAM banks.
+typedef struct {
+    const ManifestEntry *entry;
+    uint16_t banks;
+    uint8_t ram_banks;
+    uint8_t cart_type;
+    int ok;                     // readable and, unless --force, a header that matches the file
+    int selected;
+} PlanItem;
+
+typedef struct {
+    PlanItem *items;
+    int count;
+    uint16_t used_banks;
+    uint16_t max_banks;
+    int selected;
+    int banks_selected;
+    int ram_selected;
+    long priority_selected;
+    long priority_total;
+} CapacityPlan;
+
+int planner_build(const Manifest *manifest, uint16_t used_banks, uint16_t max_banks, CapacityPlan *plan);
+void planner_print(const CapacityPlan *plan, const char *title);
+void planner_free(CapacityPlan *plan);
+
+// Batch operation: plan <manifest> against the attached cartridge
+int plan_cartridge(CrocoDevice *device, const char *manifest_file);
+// Checks that every ROM in the manifest fits before the first one is sent; prints the plan and returns -1 if not
+int planner_check(CrocoDevice *device, const Manifest *manifest);
+
+#endif
@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "metrics.h"
+#include "response.h"
+
+// Event-driven response waiting.
+//
+// The IN transfer is queued before the command is sent and we sleep inside
+// the transport event loop, so execute_command returns as soon as the ack is on
+// the wire. Wait slices start at a multiple of the latency learned for that
+// opcode and only double when the firmware is actually slower than usual.
+
+// Shared by every cartridge session; the firmware latency is the same on each
+static OpcodeLatency latency_table[256];
+static pthread_mutex_t latency_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int latency_bucket(uint32_t us) {
+    int bucket = 0;
+    while (us > 0 && bucket < LATENCY_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static latency_sample_fn sample_hook;
+static void *sample_hook_user;
+
+void latency_set_hook(latency_sample_fn hook, void *user) {
+    sample_hook = hook;
+    sample_hook_user = user;
+}
+
+void latency_record(uint8_t opcode, uint64_t latency_ns, uint64_t slack_ns) {
+    OpcodeLatency *lat = &latency_table[opcode];
+    uint32_t us = (uint32_t)(latency_ns / 1000);
+    uint32_t slack_us = (uint32_t)(slack_ns / 1000);
+
+    pthread_mutex_lock(&latency_lock);
+    lat->count++;
+    lat->total_us += us;
+    if (us > lat->max_us) {
+        lat->max_us = us;
+    }
+    if (slack_us > lat->max_slack_us) {
+        lat->max_slack_us = slack_us;
+    }
+    lat->ewma_us = lat->ewma_us ? (lat->ewma_us * 7 + us) / 8 : us;
+    lat->buckets[latency_bucket(us)]++;
+    pthread_mutex_unlock(&latency_lock);
+
+    if (sample_hook) {
+        sample_hook(sample_hook_user, opcode, latency_ns);
+    }
+}
+
+// Backoffs and timeouts come from every session thread too
+static void latency_count(uint32_t *counter) {
+    pthread_mutex_lock(&latency_lock);
+    (*counter)++;
+    pthread_mutex_unlock(&latency_lock);
+}
+
+const OpcodeLatency *latency_get(uint8_t opcode) {
+    return &latency_table[opcode];
+}
+
+uint32_t latency_budget_us(uint8_t opcode) {
+    pthread_mutex_lock(&latency_lock);
+    uint64_t budget = (uint64_t)latency_table[opcode].ewma_us * RESPONSE_BUDGET_FACTOR;
+    pthread_mutex_unlock(&latency_lock);
+
+    if (budget < RESPONSE_MIN_BUDGET_US) {
+        budget = RESPONSE_MIN_BUDGET_US;
+    }
+    if (budget > TIMEOUT_MS * 1000ull) {
+        budget = TIMEOUT_MS * 1000ull;
+    }
+    return (uint32_t)budget;
+}
+
+static void response_cb(CrocoTransfer *transfer) {
+    ResponseWait *wait = transfer->user_data;
+    wait->done_ns = monotonic_ns();
+    wait->completed = 1;
+}
+
+int response_submit(CrocoDevice *device, ResponseWait *wait, uint8_t opcode, uint8_t *buffer, int max_len) {
+    memset(wait, 0, sizeof(*wait));
+    wait->opcode = opcode;
+
+    transfer_fill(&wait->transfer, device, XFER_IN, buffer, max_len, response_cb, wait, TIMEOUT_MS);
+    if (transfer_submit(&wait->transfer) != 0) {
+        fprintf(stderr, "Failed to read response: could not queue IN transfer\n");
+        return -1;
+    }
+
+    wait->submitted = 1;
+    wait->start_ns = monotonic_ns();
+    return 0;
+}
+
+void response_cancel(ResponseWait *wait) {
+    if (!wait->submitted) {
+        return;
+    }
+    // The wait and the buffer usually sit in the caller's frame, which must
+    // outlive the callback however long a vanished device takes to report it
+    transfer_reap(&wait->transfer, &wait->completed);
+    wait->submitted = 0;
+}
+
+int response_wait(ResponseWait *wait) {
+    OpcodeLatency *lat = &latency_table[wait->opcode];
+    uint64_t budget_ns = (uint64_t)latency_budget_us(wait->opcode) * 1000;
+
+    // The transfer carries its own TIMEOUT_MS, so this loop always terminates
+    while (!wait->completed) {
+        uint64_t slice_end = monotonic_ns() + budget_ns;
+
+        if (transport_handle_events(wait->transfer.device, budget_ns, &wait->completed) != 0) {
+            if (metrics_enabled) {
+                metrics_count_error(wait->opcode);
+            }
+            response_cancel(wait);
+            return -1;
+        }
+
+        if (!wait->completed && monotonic_ns() >= slice_end) {
+            latency_count(&lat->backoffs);
+            if (budget_ns < TIMEOUT_MS * 1000000ull) {
+                budget_ns *= 2;
+            }
+        }
+    }
+    wait->submitted = 0;
+
+    int status = wait->transfer.status;
+    int transferred = wait->transfer.actual_length;
+
+    if (status == XFER_TIMED_OUT) {
+        latency_count(&lat->timeouts);
+        if (metrics_enabled) {
+            metrics_count_timeout(wait->opcode);
+        }
+        return transferred;
+    }
+    if (status != XFER_COMPLETED) {
+        if (metrics_enabled) {
+            metrics_count_error(wait->opcode);
+        }
+        fprintf(stderr, "Failed to read response: %s\n", transfer_status_name(status));
+        return -1;
+    }
+
+    uint64_t latency_ns = wait->done_ns > wait->start_ns ? wait->done_ns - wait->start_ns : 0;
+    latency_record(wait->opcode, latency_ns, monotonic_ns() - wait->done_ns);
+    if (metrics_enabled) {
+        metrics_record_response(wait->opcode, latency_ns, transferred);
+    }
+
+    return transferred;
+}
+
+void latency_print(FILE *out) {
+    fprintf(out, "\n   \x1b[1;37mRESPONSE LATENCY PER OPCODE\x1b[0m\n");
+    fprintf(out, "   \x1b[90m=============================================================\x1b[0m\n");
+    fprintf(out, "    \x1b[1mOP     COUNT   AVG us  LEARNED  MAX us  SLACK us  BACKOFF  T/O\x1b[0m\n");
+
+    int any = 0;
+    for (int op = 0; op < 256; op++) {
+        OpcodeLatency copy;
+        pthread_mutex_lock(&latency_lock);
+        copy = latency_table[op];
+        pthread_mutex_unlock(&latency_lock);
+        const OpcodeLatency *lat = &copy;
+        if (lat->count == 0 && lat->timeouts == 0) {
+            continue;
+        }
+        any = 1;
+
+        fprintf(out, "    \x1b[1;36m0x%02X\x1b[0m %7llu %8llu %8u %7u %9u %8u %4u\n",
+                op,
+                (unsigned long long)lat->count,
+                (unsigned long long)(lat->count ? lat->total_us / lat->count : 0),
+                lat->ewma_us, lat->max_us, lat->max_slack_us, lat->backoffs, lat->timeouts);
+
+        uint32_t peak = 0;
+        for (int b = 0; b < LATENCY_BUCKETS; b++) {
+            if (lat->buckets[b] > peak) {
+                peak = lat->buckets[b];
+            }
+        }
+        for (int b = 0; b < LATENCY_BUCKETS; b++) {
+            if (lat->buckets[b] == 0) {
+                continue;
+            }
+            int bar = (int)((uint64_t)lat->buckets[b] * 30 / peak);
+            fprintf(out, "      \x1b[90m%s %7u us\x1b[0m |\x1b[32m%.*s\x1b[0m %u\n",
+                    b == LATENCY_BUCKETS - 1 ? ">=" : "< ",
+                    b == LATENCY_BUCKETS - 1 ? 1u << (b - 1) : 1u << b,
+                    bar > 0 ? bar : 1, "##############################", lat->buckets[b]);
+        }
+    }
+
+    if (!any) {
+        fprintf(out, "     \x1b[90m(No commands issued yet)\x1b[0m\n");
+    }
+    fprintf(out, "   \x1b[90m=============================================================\x1b[0m\n");
+}
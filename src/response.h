@@ -0,0 +1,48 @@
+#ifndef CROCO_RESPONSE_H
+#define CROCO_RESPONSE_H
+
+#include <stdio.h>
+#include "croco.h"
+#include "transport.h"
+
+#define LATENCY_BUCKETS 24          // log2 microsecond buckets, last one is open-ended
+#define RESPONSE_MIN_BUDGET_US 1000
+#define RESPONSE_BUDGET_FACTOR 4    // first wait slice = factor * learned latency
+
+typedef struct {
+    uint64_t count;
+    uint64_t total_us;
+    uint32_t max_us;
+    uint32_t ewma_us;               // learned latency, 0 until the first sample
+    uint32_t max_slack_us;          // worst delay between ack arrival and return
+    uint32_t backoffs;              // wait slices that expired before the ack
+    uint32_t timeouts;
+    uint32_t buckets[LATENCY_BUCKETS];
+} OpcodeLatency;
+
+typedef struct {
+    CrocoTransfer transfer;
+    int submitted;
+    uint8_t opcode;
+    int completed;
+    uint64_t start_ns;
+    uint64_t done_ns;
+} ResponseWait;
+
+// Queue the IN transfer before the command goes out so the ack is picked up the moment it lands
+int response_submit(CrocoDevice *device, ResponseWait *wait, uint8_t opcode, uint8_t *buffer, int max_len);
+// Returns bytes received, 0 on timeout, -1 on USB error
+int response_wait(ResponseWait *wait);
+// Returns once the IN transfer has completed, after which wait and buffer may go
+void response_cancel(ResponseWait *wait);
+
+// Optional observer for every latency sample, e.g. for exact percentiles in benchmarks
+typedef void (*latency_sample_fn)(void *user, uint8_t opcode, uint64_t latency_ns);
+
+void latency_record(uint8_t opcode, uint64_t latency_ns, uint64_t slack_ns);
+void latency_set_hook(latency_sample_fn hook, void *user);
+const OpcodeLatency *latency_get(uint8_t opcode);
+uint32_t latency_budget_us(uint8_t opcode);
+void latency_print(FILE *out);
+
+#endif
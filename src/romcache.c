@@ -0,0 +1,316 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "romcache.h"
+
+// On-disk layout (little endian):
+//   "CRTB" | version u8 | serial[8] | num_roms u8 | used_raw u16
+//   num_roms x { name[17] | num_ram_banks u8 | mbc u8 | num_rom_banks u16 }
+#define ROMCACHE_MAGIC "CRTB"
+#define ROMCACHE_VERSION 2
+#define ROMCACHE_RECORD 21
+
+int romcache_dir(char *buf, size_t len) {
+    const char *dir = getenv("CROCO_CACHE_DIR");
+    if (dir && *dir) {
+        snprintf(buf, len, "%s", dir);
+    } else if ((dir = getenv("XDG_CACHE_HOME")) && *dir) {
+        snprintf(buf, len, "%s/croco", dir);
+    } else if ((dir = getenv("HOME")) && *dir) {
+        snprintf(buf, len, "%s/.cache/croco", dir);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+int romcache_file(const uint8_t *serial, const char *suffix, char *buf, size_t len) {
+    char dir[200];
+    if (romcache_dir(dir, sizeof(dir)) != 0) {
+        return -1;
+    }
+    snprintf(buf, len, "%s/%02X%02X%02X%02X%02X%02X%02X%02X.%s", dir,
+             serial[0], serial[1], serial[2], serial[3], serial[4], serial[5], serial[6], serial[7], suffix);
+    return 0;
+}
+
+static int romcache_path(const uint8_t *serial, char *buf, size_t len) {
+    return romcache_file(serial, "romtable", buf, len);
+}
+
+static int mkdir_parents(const char *path) {
+    char tmp[256];
+    snprintf(tmp, sizeof(tmp), "%s", path);
+    for (char *p = tmp + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            if (mkdir(tmp, 0755) != 0 && errno != EEXIST) {
+                return -1;
+            }
+            *p = '/';
+        }
+    }
+    return (mkdir(tmp, 0755) != 0 && errno != EEXIST) ? -1 : 0;
+}
+
+static int romcache_load_file(RomTable *table, const uint8_t *serial) {
+    char path[256];
+    if (romcache_path(serial, path, sizeof(path)) != 0) {
+        return -1;
+    }
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return -1;
+    }
+
+    uint8_t header[16];
+    int ret = -1;
+    if (fread(header, 1, sizeof(header), f) == sizeof(header) &&
+        memcmp(header, ROMCACHE_MAGIC, 4) == 0 && header[4] == ROMCACHE_VERSION &&
+        memcmp(header + 5, serial, 8) == 0) {
+        memcpy(table->serial, serial, 8);
+        table->num_roms = header[13];
+        table->used_raw = (uint16_t)(header[14] | (header[15] << 8));
+        ret = 0;
+
+        for (int i = 0; i < table->num_roms; i++) {
+            uint8_t rec[ROMCACHE_RECORD];
+            if (fread(rec, 1, sizeof(rec), f) != sizeof(rec)) {
+                ret = -1;
+                break;
+            }
+            RomInfo *info = &table->roms[i];
+            info->rom_id = (uint8_t)i;
+            memcpy(info->name, rec, 17);
+            info->name[17] = '\0';
+            info->num_ram_banks = rec[17];
+            info->mbc = rec[18];
+            info->num_rom_banks = (uint16_t)(rec[19] | (rec[20] << 8));
+        }
+    }
+
+    fclose(f);
+    return ret;
+}
+
+int romcache_mkdir(void) {
+    char dir[200];
+    if (romcache_dir(dir, sizeof(dir)) != 0) {
+        return -1;
+    }
+    return mkdir_parents(dir);
+}
+
+static void romcache_store(const RomTable *table) {
+    char dir[200], path[256], tmp[264];
+    if (romcache_dir(dir, sizeof(dir)) != 0 || mkdir_parents(dir) != 0 ||
+        romcache_path(table->serial, path, sizeof(path)) != 0) {
+        return;
+    }
+
+    // Write to a temp file and rename so a crash never leaves a torn table
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "wb");
+    if (!f) {
+        return;
+    }
+
+    uint8_t header[16];
+    memcpy(header, ROMCACHE_MAGIC, 4);
+    header[4] = ROMCACHE_VERSION;
+    memcpy(header + 5, table->serial, 8);
+    header[13] = table->num_roms;
+    header[14] = table->used_raw & 0xFF;
+    header[15] = table->used_raw >> 8;
+    int ok = fwrite(header, 1, sizeof(header), f) == sizeof(header);
+
+    for (int i = 0; ok && i < table->num_roms; i++) {
+        const RomInfo *info = &table->roms[i];
+        uint8_t rec[ROMCACHE_RECORD];
+        memcpy(rec, info->name, 17);
+        rec[17] = info->num_ram_banks;
+        rec[18] = info->mbc;
+        rec[19] = info->num_rom_banks & 0xFF;
+        rec[20] = info->num_rom_banks >> 8;
+        ok = fwrite(rec, 1, sizeof(rec), f) == sizeof(rec);
+    }
+
+    if (fclose(f) != 0 || !ok || rename(tmp, path) != 0) {
+        remove(tmp);
+    }
+}
+
+static void romcache_invalidate(const uint8_t *serial) {
+    char path[256];
+    if (romcache_path(serial, path, sizeof(path)) == 0) {
+        remove(path);
+    }
+}
+
+int romcache_read_summary(CrocoDevice *device, uint8_t *num_roms, uint16_t *used_raw, uint16_t *max_banks) {
+    uint8_t response[10];
+    if (execute_command(device, 0x01, NULL, 0, response, sizeof(response)) < 5) {
+        return -1;
+    }
+    *num_roms = response[0];
+    *used_raw = (uint16_t)((response[1] << 8) | response[2]);
+    if (max_banks) {
+        *max_banks = (uint16_t)((response[3] << 8) | response[4]);
+    }
+    return 0;
+}
+
+static int query_rom_info(CrocoDevice *device, uint8_t rom_id, RomInfo *info) {
+    uint8_t response[25];
+    int bytes = execute_command(device, 0x04, &rom_id, 1, response, sizeof(response));
+    if (bytes < 18) {
+        return -1;
+    }
+
+    info->rom_id = rom_id;
+    memcpy(info->name, response, 17);
+    info->name[17] = '\0';
+    info->num_ram_banks = response[17];
+    info->mbc = (bytes > 18) ? response[18] : 0xFF;
+    info->num_rom_banks = 0;
+    if (bytes > 20) {
+        info->num_rom_banks = (uint16_t)((response[19] << 8) | response[20]);  // big endian on the wire
+    }
+    return 0;
+}
+
+static RomTable *session_table(CrocoDevice *device) {
+    if (!device->rom_table) {
+        device->rom_table = calloc(1, sizeof(RomTable));
+    }
+    return device->rom_table;
+}
+
+int romcache_read_table(CrocoDevice *device, RomTable **out) {
+    uint8_t num_roms;
+    uint16_t used_raw;
+    uint16_t max_banks;
+
+    if (romcache_read_summary(device, &num_roms, &used_raw, &max_banks) != 0) {
+        return -1;
+    }
+
+    RomTable *table = session_table(device);
+    if (!table) {
+        return -1;
+    }
+
+    int have_serial = (read_serial(device) == 0);
+    int cached = have_serial && memcmp(table->serial, device->serial, 8) == 0;
+    if (!cached && have_serial) {
+        cached = (romcache_load_file(table, device->serial) == 0);
+    }
+
+    if (cached && table->num_roms == num_roms && table->used_raw == used_raw) {
+        table->max_banks = max_banks ? max_banks : CROCO_MAX_ROM_BANKS;
+        *out = table;
+        return 0;
+    }
+
+    // Miss: walk every slot once and persist the result
+    memset(table, 0, sizeof(*table));
+    table->num_roms = num_roms;
+    table->used_raw = used_raw;
+    table->max_banks = max_banks ? max_banks : CROCO_MAX_ROM_BANKS;
+
+    int complete = 1;
+    for (int i = 0; i < num_roms; i++) {
+        if (query_rom_info(device, (uint8_t)i, &table->roms[i]) != 0) {
+            fprintf(stderr, "  \x1b[31m[!] Error reading slot %u\x1b[0m\n", i);
+            table->roms[i].rom_id = (uint8_t)i;
+            snprintf(table->roms[i].name, sizeof(table->roms[i].name), "?");
+            complete = 0;
+        }
+    }
+
+    if (have_serial && complete) {
+        memcpy(table->serial, device->serial, 8);
+        romcache_store(table);
+    }
+    *out = table;
+    return 0;
+}
+
+static int table_is_current(CrocoDevice *device) {
+    return device->rom_table && device->has_serial &&
+           memcmp(device->rom_table->serial, device->serial, 8) == 0;
+}
+
+int romcache_get_info(CrocoDevice *device, uint8_t rom_id, RomInfo *info) {
+    if (table_is_current(device) && rom_id < device->rom_table->num_roms) {
+        *info = device->rom_table->roms[rom_id];
+        return 0;
+    }
+    return query_rom_info(device, rom_id, info);
+}
+
+void romcache_after_upload(CrocoDevice *device) {
+    romcache_after_uploads(device, 1);
+}
+
+void romcache_after_uploads(CrocoDevice *device, int count) {
+    if (!table_is_current(device) || device->rom_table->num_roms + count > ROM_TABLE_MAX) {
+        if (read_serial(device) == 0) {
+            romcache_invalidate(device->serial);
+        }
+        return;
+    }
+
+    // New ROMs land in the next slots; the firmware derives RAM/MBC from their headers
+    RomTable *table = device->rom_table;
+    uint8_t num_roms;
+    uint16_t used_raw;
+    int ok = romcache_read_summary(device, &num_roms, &used_raw, NULL) == 0 && num_roms == table->num_roms + count;
+    for (int i = table->num_roms; ok && i < num_roms; i++) {
+        ok = query_rom_info(device, (uint8_t)i, &table->roms[i]) == 0;
+    }
+    if (!ok) {
+        memset(table->serial, 0, sizeof(table->serial));
+        romcache_invalidate(device->serial);
+        return;
+    }
+
+    table->num_roms = num_roms;
+    table->used_raw = used_raw;
+    romcache_store(table);
+}
+
+void romcache_after_delete(CrocoDevice *device, uint8_t rom_id) {
+    if (!table_is_current(device) || rom_id >= device->rom_table->num_roms) {
+        if (read_serial(device) == 0) {
+            romcache_invalidate(device->serial);
+        }
+        return;
+    }
+
+    RomTable *table = device->rom_table;
+    uint8_t num_roms;
+    uint16_t used_raw;
+    if (romcache_read_summary(device, &num_roms, &used_raw, NULL) != 0 || num_roms + 1 != table->num_roms) {
+        memset(table->serial, 0, sizeof(table->serial));
+        romcache_invalidate(device->serial);
+        return;
+    }
+
+    // Slots above the deleted one shift down by one
+    memmove(&table->roms[rom_id], &table->roms[rom_id + 1],
+            (table->num_roms - rom_id - 1) * sizeof(RomInfo));
+    table->num_roms = num_roms;
+    for (int i = rom_id; i < num_roms; i++) {
+        table->roms[i].rom_id = (uint8_t)i;
+    }
+    table->used_raw = used_raw;
+    romcache_store(table);
+}
+
+void romcache_free(CrocoDevice *device) {
+    free(device->rom_table);
+    device->rom_table = NULL;
+}
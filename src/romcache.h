@@ -0,0 +1,38 @@
+#ifndef CROCO_ROMCACHE_H
+#define CROCO_ROMCACHE_H
+
+#include "croco.h"
+
+#define ROM_TABLE_MAX 256
+
+// Cached copy of the cartridge's ROM table. The 0x01 summary (num_roms plus
+// the raw usedBanks word) is the validity key: if it still matches, the table
+// is served without a single 0x04 round trip.
+struct RomTable {
+    uint8_t serial[8];
+    uint8_t num_roms;
+    uint16_t used_raw;
+    uint16_t max_banks;         // flash capacity from the same summary; not part of the cache file
+    RomInfo roms[ROM_TABLE_MAX];
+};
+
+// The 0x01 summary straight from the cartridge; max_banks may be NULL
+int romcache_read_summary(CrocoDevice *device, uint8_t *num_roms, uint16_t *used_raw, uint16_t *max_banks);
+// Fills *table from the session cache, the on-disk cache or the cartridge, in that order
+int romcache_read_table(CrocoDevice *device, RomTable **table);
+// Info for one slot; answered from a validated table when one is loaded
+int romcache_get_info(CrocoDevice *device, uint8_t rom_id, RomInfo *info);
+
+// Keep the cache in step with changes made through this tool
+void romcache_after_upload(CrocoDevice *device);
+// After several uploads in a row; one summary and one 0x04 per new slot
+void romcache_after_uploads(CrocoDevice *device, int count);
+void romcache_after_delete(CrocoDevice *device, uint8_t rom_id);
+void romcache_free(CrocoDevice *device);
+
+int romcache_dir(char *buf, size_t len);
+// Per-cartridge files in the cache directory: <dir>/<SERIAL>.<suffix>
+int romcache_file(const uint8_t *serial, const char *suffix, char *buf, size_t len);
+int romcache_mkdir(void);
+
+#endif
@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <string.h>
+#include "croco.h"
+#include "romheader.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Pre-flight check of the cartridge header, so a truncated or corrupt file
+// is refused before the upload request instead of after the last bank. The
+// boot ROM itself only checks the header checksum; the global checksum is
+// what catches damage anywhere else in the image.
+
+uint16_t romheader_byte_sum(const uint8_t *data, long size) {
+    uint64_t sum = 0;
+    long i = 0;
+
+#if defined(__SSE2__)
+    // psadbw against zero sums 8 bytes into each 64-bit lane
+    __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+    for (; i + 16 <= size; i += 16) {
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(data + i)), zero));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    sum = lanes[0] + lanes[1];
+#elif defined(__ARM_NEON)
+    uint64x2_t acc = vdupq_n_u64(0);
+    for (; i + 16 <= size; i += 16) {
+        acc = vpadalq_u32(acc, vpaddlq_u16(vpaddlq_u8(vld1q_u8(data + i))));
+    }
+    sum = vgetq_lane_u64(acc, 0) + vgetq_lane_u64(acc, 1);
+#endif
+
+    for (; i < size; i++) {
+        sum += data[i];
+    }
+    return (uint16_t)sum;
+}
+
+static uint16_t rom_banks_for_code(uint8_t code) {
+    if (code <= 0x08) {
+        return (uint16_t)(2u << code);
+    }
+    switch (code) {
+        case 0x52: return 72;
+        case 0x53: return 80;
+        case 0x54: return 96;
+    }
+    return 0;
+}
+
+static uint8_t ram_banks_for(uint8_t cart_type, uint8_t code) {
+    // MBC2 has 512 nibbles of RAM on the chip and declares none
+    if (cart_type == 0x06) {
+        return 1;
+    }
+    switch (code) {
+        case 0x01:
+        case 0x02: return 1;
+        case 0x03: return 4;
+        case 0x04: return 16;
+        case 0x05: return 8;
+    }
+    return 0;
+}
+
+const char *romheader_mbc_name(uint8_t cart_type) {
+    switch (cart_type) {
+        case 0x00: return "ROM ONLY";
+        case 0x01: return "MBC1";
+        case 0x02: return "MBC1+RAM";
+        case 0x03: return "MBC1+RAM+BATTERY";
+        case 0x05: return "MBC2";
+        case 0x06: return "MBC2+BATTERY";
+        case 0x08: return "ROM+RAM";
+        case 0x09: return "ROM+RAM+BATTERY";
+        case 0x0B: return "MMM01";
+        case 0x0C: return "MMM01+RAM";
+        case 0x0D: return "MMM01+RAM+BATTERY";
+        case 0x0F: return "MBC3+TIMER+BATTERY";
+        case 0x10: return "MBC3+TIMER+RAM+BATTERY";
+        case 0x11: return "MBC3";
+        case 0x12: return "MBC3+RAM";
+        case 0x13: return "MBC3+RAM+BATTERY";
+        case 0x19: return "MBC5";
+        case 0x1A: return "MBC5+RAM";
+        case 0x1B: return "MBC5+RAM+BATTERY";
+        case 0x1C: return "MBC5+RUMBLE";
+        case 0x1D: return "MBC5+RUMBLE+RAM";
+        case 0x1E: return "MBC5+RUMBLE+RAM+BATTERY";
+        case 0x20: return "MBC6";
+        case 0x22: return "MBC7+SENSOR+RUMBLE+RAM+BATTERY";
+        case 0xFC: return "POCKET CAMERA";
+        case 0xFD: return "BANDAI TAMA5";
+        case 0xFE: return "HuC3";
+        case 0xFF: return "HuC1+RAM+BATTERY";
+    }
+    return "UNKNOWN";
+}
+
+int romheader_parse(const uint8_t *data, long size, RomHeader *header) {
+    if (size < ROM_HEADER_END) {
+        memset(header, 0, sizeof(*header));
+        return -1;
+    }
+    return romheader_parse_sum(data, size, romheader_byte_sum(data, size), header);
+}
+
+int romheader_parse_sum(const uint8_t *data, long size, uint16_t byte_sum, RomHeader *header) {
+    memset(header, 0, sizeof(*header));
+    if (size < ROM_HEADER_END) {
+        return -1;
+    }
+
+    // 16 title bytes on DMG carts; CGB carts reuse the last one as the CGB flag
+    header->cgb_flag = data[0x143];
+    int title_len = (header->cgb_flag & 0x80) ? 15 : 16;
+    int n = 0;
+    while (n < title_len && data[0x134 + n] >= 0x20 && data[0x134 + n] < 0x7F) {
+        header->title[n] = (char)data[0x134 + n];
+        n++;
+    }
+    while (n > 0 && header->title[n - 1] == ' ') {
+        n--;
+    }
+    header->title[n] = '\0';
+
+    header->cart_type = data[0x147];
+    header->rom_size_code = data[0x148];
+    header->ram_size_code = data[0x149];
+    header->rom_banks = rom_banks_for_code(header->rom_size_code);
+    header->ram_banks = ram_banks_for(header->cart_type, header->ram_size_code);
+
+    uint8_t x = 0;
+    for (int i = 0x134; i <= 0x14C; i++) {
+        x = x - data[i] - 1;
+    }
+    header->header_checksum = data[0x14D];
+    header->header_computed = x;
+
+    header->global_checksum = (uint16_t)((data[0x14E] << 8) | data[0x14F]);
+    header->global_computed = byte_sum - data[0x14E] - data[0x14F];
+    return 0;
+}
+
+int romheader_verify(const RomHeader *header, long size, int verbose) {
+    long expected = (long)header->rom_banks * ROM_BANK_SIZE;
+
+    if (header->header_computed != header->header_checksum) {
+        if (verbose) {
+            printf("\x1b[1;31m[!] Header checksum mismatch: stored 0x%02X, computed 0x%02X\x1b[0m\n",
+                   header->header_checksum, header->header_computed);
+        }
+        return -1;
+    }
+    if (header->rom_banks == 0) {
+        if (verbose) {
+            printf("\x1b[1;31m[!] Unknown ROM size code 0x%02X in the header\x1b[0m\n", header->rom_size_code);
+        }
+        return -1;
+    }
+    if (size != expected) {
+        if (verbose) {
+            printf("\x1b[1;31m[!] File is %ld bytes but the header declares %ld (%u banks)%s\x1b[0m\n",
+                   size, expected, header->rom_banks, size < expected ? ", the ROM is truncated" : "");
+        }
+        return -1;
+    }
+    if (header->global_computed != header->global_checksum) {
+        if (verbose) {
+            printf("\x1b[1;31m[!] Global checksum mismatch: stored 0x%04X, computed 0x%04X\x1b[0m\n",
+                   header->global_checksum, header->global_computed);
+        }
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef CROCO_ROMHEADER_H
+#define CROCO_ROMHEADER_H
+
+#include <stdint.h>
+
+// Cartridge header at 0x100-0x14F of every Game Boy ROM
+#define ROM_HEADER_END 0x150
+
+typedef struct {
+    char title[17];
+    uint8_t cgb_flag;
+    uint8_t cart_type;          // 0x147, selects the MBC
+    uint8_t rom_size_code;      // 0x148
+    uint8_t ram_size_code;      // 0x149
+    uint16_t rom_banks;         // 16 KiB banks the size code declares, 0 if unknown
+    uint8_t ram_banks;          // 8 KiB SRAM banks the cartridge needs
+    uint8_t header_checksum;    // 0x14D as stored
+    uint8_t header_computed;
+    uint16_t global_checksum;   // 0x14E-0x14F as stored
+    uint16_t global_computed;
+} RomHeader;
+
+// Returns -1 if the image is too small to hold a header
+int romheader_parse(const uint8_t *data, long size, RomHeader *header);
+// The same from the first ROM_HEADER_END bytes and the byte sum of the whole image, for streamed files
+int romheader_parse_sum(const uint8_t *data, long size, uint16_t byte_sum, RomHeader *header);
+// Checks the header against the image; returns -1 and, if verbose, prints what is wrong
+int romheader_verify(const RomHeader *header, long size, int verbose);
+const char *romheader_mbc_name(uint8_t cart_type);
+// 16-bit sum of every byte, SIMD where the target has it
+uint16_t romheader_byte_sum(const uint8_t *data, long size);
+
+#endif
@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "romimage.h"
+
+// Moves the trailing run past one more piece of the image, which starts at offset
+static void tail_update(RomImage *image, const uint8_t *data, long offset, long len) {
+    uint8_t value = data[len - 1];
+    long i = len - 1;
+    while (i > 0 && data[i - 1] == value) {
+        i--;
+    }
+    if (i > 0 || offset == 0 || value != image->tail_value) {
+        image->tail_start = offset + i;
+    }
+    image->tail_value = value;
+}
+
+static int open_mapped(RomImage *image) {
+    int fd = open(image->path, O_RDONLY);
+    if (fd < 0) {
+        printf("\x1b[1;31m[!] CRITICAL ERROR: Could not open ROM file: %s\x1b[0m\n", image->path);
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        printf("\x1b[1;31m[!] CRITICAL ERROR: ROM file is empty or unreadable: %s\x1b[0m\n", image->path);
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        printf("\x1b[1;31m[!] CRITICAL ERROR: Could not map ROM file: %s\x1b[0m\n", image->path);
+        return -1;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    image->map = map;
+    image->size = st.st_size;
+    image->has_header = romheader_parse(image->map, image->size, &image->header) == 0;
+    tail_update(image, image->map, 0, image->size);
+    return 0;
+}
+
+// One pass over every block: damaged files fail here, before 0x02
+static int scan_packed(RomImage *image) {
+    uint64_t raw_size = lzpack_raw_size(image->reader);
+    if (raw_size == 0 || raw_size > (uint64_t)CROCO_MAX_ROM_BANKS * ROM_BANK_SIZE) {
+        printf("\x1b[1;31m[!] CRITICAL ERROR: ROM file is empty or unreadable: %s\x1b[0m\n", image->path);
+        return -1;
+    }
+    image->size = (long)raw_size;
+
+    uint8_t head[ROM_HEADER_END];
+    uint16_t sum = 0;
+    long offset = 0;
+    long got;
+    while (offset < image->size && (got = lzpack_read(image->reader, image->window[0], LZPACK_BLOCK_SIZE)) > 0) {
+        if (offset == 0) {
+            memcpy(head, image->window[0], got < ROM_HEADER_END ? (size_t)got : ROM_HEADER_END);
+        }
+        sum += romheader_byte_sum(image->window[0], got);
+        tail_update(image, image->window[0], offset, got);
+        image->window_start[0] = offset;
+        image->window_len[0] = got;
+        offset += got;
+    }
+    uint8_t extra;
+    if (offset != image->size || lzpack_read(image->reader, &extra, 1) != 0) {
+        printf("\x1b[1;31m[!] CRITICAL ERROR: Packed ROM file is damaged: %s\x1b[0m\n", image->path);
+        return -1;
+    }
+    image->reader_pos = offset;
+
+    image->has_header = image->size >= ROM_HEADER_END && romheader_parse_sum(head, image->size, sum, &image->header) == 0;
+    return 0;
+}
+
+int rom_image_open(const char *path, RomImage *image) {
+    memset(image, 0, sizeof(*image));
+    snprintf(image->path, sizeof(image->path), "%s", path);
+    for (int i = 0; i < ROM_IMAGE_WINDOWS; i++) {
+        image->window_start[i] = -1;
+    }
+
+    uint8_t magic[LZPACK_HEADER_SIZE];
+    FILE *f = fopen(path, "rb");
+    int packed = f && fread(magic, 1, sizeof(magic), f) == sizeof(magic) && lzpack_is_packed(magic, sizeof(magic));
+    if (f) {
+        fclose(f);
+    }
+    if (!packed) {
+        return open_mapped(image);
+    }
+
+    image->reader = lzpack_open(path);
+    for (int i = 0; i < ROM_IMAGE_WINDOWS; i++) {
+        image->window[i] = malloc(LZPACK_BLOCK_SIZE);
+    }
+    if (!image->reader || !image->window[0] || !image->window[1]) {
+        printf("\x1b[1;31m[!] CRITICAL ERROR: ROM file is empty or unreadable: %s\x1b[0m\n", path);
+        rom_image_close(image);
+        return -1;
+    }
+    if (scan_packed(image) != 0) {
+        rom_image_close(image);
+        return -1;
+    }
+    return 0;
+}
+
+void rom_image_close(RomImage *image) {
+    if (image->map) {
+        munmap((void *)image->map, image->size);
+    }
+    if (image->reader) {
+        lzpack_close_reader(image->reader);
+    }
+    for (int i = 0; i < ROM_IMAGE_WINDOWS; i++) {
+        free(image->window[i]);
+    }
+    memset(image, 0, sizeof(*image));
+}
+
+// Decodes the block at start into the window further behind the stream. A
+// failed read leaves the reader anywhere, so the next load starts over.
+static int load_block(RomImage *image, long start) {
+    int slot = image->window_start[0] <= image->window_start[1] ? 0 : 1;
+    image->window_start[slot] = -1;
+    long pos = image->reader_pos;
+    image->reader_pos = image->size + 1;
+
+    if (start < pos) {
+        lzpack_close_reader(image->reader);
+        image->reader = lzpack_open(image->path);
+        pos = 0;
+        if (!image->reader) {
+            return -1;
+        }
+    }
+    long got;
+    while (pos < start) {
+        if ((got = lzpack_read(image->reader, image->window[slot], LZPACK_BLOCK_SIZE)) <= 0) {
+            return -1;
+        }
+        pos += got;
+    }
+    if ((got = lzpack_read(image->reader, image->window[slot], LZPACK_BLOCK_SIZE)) <= 0) {
+        return -1;
+    }
+    image->reader_pos = pos + got;
+    image->window_start[slot] = start;
+    image->window_len[slot] = got;
+    return slot;
+}
+
+const uint8_t *rom_image_at(RomImage *image, long offset, long *avail) {
+    if (offset < 0 || offset >= image->size) {
+        return NULL;
+    }
+    if (image->map) {
+        *avail = image->size - offset;
+        return image->map + offset;
+    }
+
+    long start = offset - offset % LZPACK_BLOCK_SIZE;
+    int slot = -1;
+    for (int i = 0; i < ROM_IMAGE_WINDOWS; i++) {
+        if (image->window_start[i] == start) {
+            slot = i;
+        }
+    }
+    if (slot < 0 && (!image->reader || (slot = load_block(image, start)) < 0)) {
+        fprintf(stderr, "\x1b[1;31m[!] Packed ROM file changed or was damaged while flashing: %s\x1b[0m\n", image->path);
+        return NULL;
+    }
+    if (offset - start >= image->window_len[slot]) {
+        return NULL;
+    }
+    *avail = image->window_len[slot] - (offset - start);
+    return image->window[slot] + (offset - start);
+}
+
+void rom_image_advance(RomImage *image, uint32_t bank) {
+    if (!image->map) {
+        return;
+    }
+    long start = (long)bank * ROM_BANK_SIZE;
+    // Clamp to the mapping: DONTNEED past its end would zero whatever is mapped next
+    if (bank > 0 && start - ROM_BANK_SIZE < image->size) {
+        long len = image->size - (start - ROM_BANK_SIZE);
+        madvise((void *)(image->map + start - ROM_BANK_SIZE), len < ROM_BANK_SIZE ? len : ROM_BANK_SIZE, MADV_DONTNEED);
+    }
+    if (start + ROM_BANK_SIZE < image->size) {
+        long len = image->size - start - ROM_BANK_SIZE;
+        madvise((void *)(image->map + start + ROM_BANK_SIZE), len < ROM_BANK_SIZE ? len : ROM_BANK_SIZE, MADV_WILLNEED);
+    }
+}
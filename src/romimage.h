@@ -0,0 +1,44 @@
+#ifndef CROCO_ROMIMAGE_H
+#define CROCO_ROMIMAGE_H
+
+#include "croco.h"
+#include "lzpack.h"
+
+// A ROM file as the flash path reads it. A plain file is mapped and the
+// kernel pages it in as chunks are framed. A .crlz file is never held whole:
+// rom_image_open makes one streaming pass for the header, the byte sum and
+// the trailing fill run, and the stream later decodes the file again one
+// 64 KiB block at a time as chunks reach it. The window keeps the block
+// before the current one, which the bank journal and resent chunks still
+// read; anything further back decodes again from the start of the file.
+
+#define ROM_IMAGE_WINDOWS 2
+
+struct RomImage {
+    char path[512];
+    long size;
+    const uint8_t *map;                     // plain file; NULL for .crlz
+    LzReader *reader;                       // .crlz, reader_pos bytes in
+    long reader_pos;
+    uint8_t *window[ROM_IMAGE_WINDOWS];     // decoded blocks
+    long window_start[ROM_IMAGE_WINDOWS];   // -1 while empty
+    long window_len[ROM_IMAGE_WINDOWS];
+    RomHeader header;
+    int has_header;                         // 0 if the image is too small to hold one
+    uint8_t tail_value;                     // the image ends in a run of this byte
+    long tail_start;                        // from this offset on
+};
+
+// Prints why a file cannot be used, like the flash commands do
+int rom_image_open(const char *path, RomImage *image);
+void rom_image_close(RomImage *image);
+
+// The image from offset up to the end of what is in memory, *avail bytes.
+// NULL past the end or if a .crlz block no longer decodes.
+const uint8_t *rom_image_at(RomImage *image, long offset, long *avail);
+
+// The stream reached this bank: a plain mapping drops the bank before it and
+// reads ahead the next, so resident memory stays at about two banks
+void rom_image_advance(RomImage *image, uint32_t bank);
+
+#endif
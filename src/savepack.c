@@ -0,0 +1,44 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "savepack.h"
+#include "lzpack.h"
+
+int savepack_load(const char *path, uint8_t **data, long *size) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return -1;
+    }
+
+    uint8_t magic[LZPACK_HEADER_SIZE];
+    size_t got = fread(magic, 1, sizeof(magic), f);
+    if (lzpack_is_packed(magic, got)) {
+        fclose(f);
+        if (lzpack_load(path, SAVEPACK_MAX_SIZE, data, size) != 0) {
+            fprintf(stderr, "Corrupt packed save file: %s\n", path);
+            return -1;
+        }
+        return 0;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long file_size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (file_size < 0 || file_size > SAVEPACK_MAX_SIZE) {
+        fprintf(stderr, "Save file is larger than 255 SRAM banks: %s\n", path);
+        fclose(f);
+        return -1;
+    }
+
+    uint8_t *file_data = malloc(file_size > 0 ? file_size : 1);
+    if (!file_data || fread(file_data, 1, file_size, f) != (size_t)file_size) {
+        free(file_data);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+
+    *data = file_data;
+    *size = file_size;
+    return 0;
+}
@@ -0,0 +1,15 @@
+#ifndef CROCO_SAVEPACK_H
+#define CROCO_SAVEPACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Save files come raw or as .crlz, which goes through lzpack_load like every
+// other packed file. Either way no more than SAVEPACK_MAX_SIZE is read.
+
+#define SAVEPACK_MAX_SIZE (255L * 8192)  // 255 SRAM banks, the most a ROM entry can declare
+
+// Reads a save file, unpacking it if needed. The caller frees *data.
+int savepack_load(const char *path, uint8_t **data, long *size);
+
+#endif
@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "savesync.h"
+#include "backup.h"
+#include "romcache.h"
+#include "savepack.h"
+#include "timeline.h"
+#include "transport.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+int savesync_trust_shadow = 0;
+int savesync_keep_history = 1;
+
+uint32_t savesync_diff(const uint8_t *a, const uint8_t *b, uint32_t chunks, uint8_t *changed) {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < chunks; i++) {
+        const uint8_t *x = a + (size_t)i * CHUNK_DATA_SIZE;
+        const uint8_t *y = b + (size_t)i * CHUNK_DATA_SIZE;
+#if defined(__SSE2__)
+        __m128i lo = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)x), _mm_loadu_si128((const __m128i *)y));
+        __m128i hi = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(x + 16)), _mm_loadu_si128((const __m128i *)(y + 16)));
+        changed[i] = _mm_movemask_epi8(_mm_and_si128(lo, hi)) != 0xFFFF;
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        uint8x16_t eq = vandq_u8(vceqq_u8(vld1q_u8(x), vld1q_u8(y)), vceqq_u8(vld1q_u8(x + 16), vld1q_u8(y + 16)));
+        changed[i] = vminvq_u8(eq) != 0xFF;
+#else
+        changed[i] = memcmp(x, y, CHUNK_DATA_SIZE) != 0;
+#endif
+        count += changed[i];
+    }
+    return count;
+}
+
+static int shadow_path(CrocoDevice *device, uint8_t rom_id, char *buf, size_t len) {
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), "%03u.sram", rom_id);
+    if (read_serial(device) != 0) {
+        return -1;
+    }
+    return romcache_file(device->serial, suffix, buf, len);
+}
+
+// The shadow image, if there is one for this slot with the same ROM and size
+static uint8_t *shadow_load(CrocoDevice *device, const RomInfo *info) {
+    char path[256];
+    if (shadow_path(device, info->rom_id, path, sizeof(path)) != 0) {
+        return NULL;
+    }
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return NULL;
+    }
+
+    size_t size = (size_t)info->num_ram_banks * SRAM_BANK_SIZE;
+    uint8_t header[SAVESYNC_HEADER_SIZE];
+    uint8_t *data = malloc(size);
+    int ok = data && fread(header, 1, sizeof(header), f) == sizeof(header) &&
+             memcmp(header, SAVESYNC_MAGIC, 4) == 0 && header[4] == SAVESYNC_VERSION &&
+             header[5] == info->rom_id && header[6] == info->num_ram_banks &&
+             strncmp((const char *)header + 8, info->name, 17) == 0 &&
+             fread(data, 1, size, f) == size;
+    fclose(f);
+    if (!ok) {
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+// The file is left alone if it already matches
+static void shadow_store(CrocoDevice *device, const RomInfo *info, const uint8_t *data) {
+    char path[256];
+    if (shadow_path(device, info->rom_id, path, sizeof(path)) != 0) {
+        return;
+    }
+
+    // Unchanged saves cost no write, so repeated backups leave the disk alone
+    size_t size = (size_t)info->num_ram_banks * SRAM_BANK_SIZE;
+    uint8_t *old = shadow_load(device, info);
+    int same = old && memcmp(old, data, size) == 0;
+    free(old);
+    if (same) {
+        return;
+    }
+
+    uint8_t *buf = calloc(1, SAVESYNC_HEADER_SIZE + size);
+    if (!buf) {
+        return;
+    }
+    memcpy(buf, SAVESYNC_MAGIC, 4);
+    buf[4] = SAVESYNC_VERSION;
+    buf[5] = info->rom_id;
+    buf[6] = info->num_ram_banks;
+    memcpy(buf + 8, info->name, 17);
+    memcpy(buf + SAVESYNC_HEADER_SIZE, data, size);
+    if (romcache_mkdir() == 0) {
+        write_durable(path, buf, SAVESYNC_HEADER_SIZE + size);
+    }
+    free(buf);
+}
+
+void savesync_record(CrocoDevice *device, const RomInfo *info, const uint8_t *data) {
+    if (!savesync_keep_history || !device->has_serial || info->num_ram_banks == 0) {
+        return;
+    }
+    shadow_store(device, info, data);
+    timeline_record(device, info, data);
+}
+
+void savesync_record_slot(CrocoDevice *device, uint8_t rom_id, uint8_t num_ram_banks, const uint8_t *data, long size) {
+    RomInfo info;
+    if (!savesync_keep_history || read_serial(device) != 0 ||
+        romcache_get_info(device, rom_id, &info) != 0 || info.num_ram_banks != num_ram_banks) {
+        return;
+    }
+    uint32_t total = (uint32_t)num_ram_banks * SRAM_BANK_SIZE;
+    uint8_t *image = calloc(1, total);
+    if (image) {
+        memcpy(image, data, size < (long)total ? (size_t)size : total);
+        savesync_record(device, &info, image);
+        free(image);
+    }
+}
+
+void savesync_forget(CrocoDevice *device, uint8_t rom_id) {
+    char path[256];
+    if (shadow_path(device, rom_id, path, sizeof(path)) == 0) {
+        unlink(path);
+    }
+}
+
+// 0x09 for the changed chunks only, pipelined like a full upload. The stream
+// ends at the last chunk, so that one always goes.
+static int send_changed_chunks(CrocoDevice *device, uint8_t rom_id, uint8_t num_ram_banks, const uint8_t *data,
+                               const uint8_t *changed, uint32_t chunks, uint32_t *sent) {
+    uint32_t *list = malloc((size_t)chunks * sizeof(uint32_t));
+    if (!list) {
+        return -1;
+    }
+    *sent = 0;
+    for (uint32_t seq = 0; seq < chunks; seq++) {
+        if (changed[seq] || seq == chunks - 1) {
+            list[(*sent)++] = seq;
+        }
+    }
+
+    uint8_t resp;
+    int ret = -1;
+    if (execute_command(device, 0x08, &rom_id, 1, &resp, 1) < 0 || resp != 0) {
+        printf("\x1b[1;31m[!] Upload request rejected by cartridge (Code: %d)\x1b[0m\n", resp);
+    } else {
+        ret = send_save_chunks(device, num_ram_banks, data, (long)chunks * CHUNK_DATA_SIZE, list, *sent);
+    }
+    free(list);
+    return ret;
+}
+
+int savesync_upload(CrocoDevice *device, uint8_t rom_id, const char *file_path) {
+    RomInfo info;
+    if (romcache_get_info(device, rom_id, &info) != 0) {
+        fprintf(stderr, "\x1b[1;31m   [!] Error: Could not retrieve info for ID %u\x1b[0m\n", rom_id);
+        return -1;
+    }
+    if (info.num_ram_banks == 0) {
+        fprintf(stderr, "\x1b[1;33m   [!] ROM %u has no RAM banks (no save).\x1b[0m\n", rom_id);
+        return -1;
+    }
+
+    uint8_t *file_data;
+    long file_size;
+    if (savepack_load(file_path, &file_data, &file_size) != 0) {
+        printf("\x1b[1;31m[!] ERROR: Could not open save file: %s\x1b[0m\n", file_path);
+        return -1;
+    }
+
+    // The same zero padding a full upload would send
+    uint32_t size = (uint32_t)info.num_ram_banks * SRAM_BANK_SIZE;
+    uint8_t *image = calloc(1, size);
+    if (!image) {
+        free(file_data);
+        return -1;
+    }
+    memcpy(image, file_data, file_size < (long)size ? (size_t)file_size : size);
+    free(file_data);
+
+    printf("\n\x1b[1;34m   [>] Syncing save to ROM %u (%s)...\x1b[0m\n", rom_id, info.name);
+
+    // The shadow misses anything the game wrote since the last read or write
+    // made here, so it is only used when asked for. Reading the save back
+    // instead would cost as much as sending all of it.
+    uint8_t *shadow = savesync_trust_shadow ? shadow_load(device, &info) : NULL;
+    if (!shadow) {
+        printf(savesync_trust_shadow ? "       No shadow of this save yet, sending all of it\n"
+                                     : "       Sending all of it (--trust-shadow diffs against the last known save)\n");
+        int ret = write_save(device, rom_id, info.num_ram_banks, image, size);
+        if (ret == 0) {
+            savesync_record(device, &info, image);
+        }
+        free(image);
+        return ret;
+    }
+
+    uint32_t chunks = size / CHUNK_DATA_SIZE;
+    uint8_t *changed = malloc(chunks);
+    if (!changed) {
+        free(shadow);
+        free(image);
+        return -1;
+    }
+    uint32_t differ = savesync_diff(image, shadow, chunks, changed);
+    free(shadow);
+
+    int ret = 0;
+    if (differ == 0) {
+        printf("       \x1b[1;32mThe shadow already matches this save; nothing sent\x1b[0m\n");
+    } else if (!(device->caps & CROCO_CAP_SPARSE_SAVE)) {
+        printf("       %u of %u chunks changed; this firmware needs the whole save\n", differ, chunks);
+        ret = write_save(device, rom_id, info.num_ram_banks, image, size);
+        if (ret == 0) {
+            savesync_record(device, &info, image);
+        }
+    } else {
+        uint32_t sent = 0;
+        uint64_t start_ns = monotonic_ns();
+        ret = send_changed_chunks(device, rom_id, info.num_ram_banks, image, changed, chunks, &sent);
+        if (ret == 0) {
+            savesync_record(device, &info, image);
+            printf("       \x1b[1;32m%u of %u chunks changed, %u sent in %.1f ms\x1b[0m\n",
+                   differ, chunks, sent, (monotonic_ns() - start_ns) / 1e6);
+        } else {
+            // Part of the chunks may have landed; a full upload leaves no mix behind
+            printf("\x1b[1;33m[!] Sparse upload failed, sending the whole save\x1b[0m\n");
+            savesync_forget(device, rom_id);
+            uint8_t stale[64];
+            while (drain_response(device, stale, sizeof(stale)) > 0) {
+            }
+            ret = write_save(device, rom_id, info.num_ram_banks, image, size);
+            if (ret == 0) {
+                savesync_record(device, &info, image);
+            }
+        }
+    }
+    free(changed);
+    free(image);
+    return ret;
+}
@@ -0,0 +1,39 @@
+#ifndef CROCO_SAVESYNC_H
+#define CROCO_SAVESYNC_H
+
+#include "croco.h"
+
+// Incremental save upload. Every save read or written through this tool is
+// kept as a shadow in the cache directory (<SERIAL>.<id>.sram). With
+// --trust-shadow sync diffs the new image against it in 32-byte chunks and
+// sends only the chunks that changed, or nothing when none did; that is only
+// right if the game has not been played since the last read or write made
+// here. Otherwise, and on firmware without CROCO_CAP_SPARSE_SAVE, sync
+// uploads the whole save like restore does.
+
+#define SAVESYNC_MAGIC "CRSH"
+#define SAVESYNC_VERSION 1
+#define SAVESYNC_HEADER_SIZE 28     // magic | version u8 | rom id u8 | banks u8 | reserved u8 | name[17] | 3 reserved
+
+extern int savesync_trust_shadow;
+extern int savesync_keep_history;   // 0 leaves shadows and timelines alone, for the benchmark
+
+// Marks changed[i] for every 32-byte chunk i that differs; returns how many did. SIMD where the target has it.
+uint32_t savesync_diff(const uint8_t *a, const uint8_t *b, uint32_t chunks, uint8_t *changed);
+
+// Keeps the shadow and a timeline point of what info's slot now holds, after
+// backup, archive, restore or sync moved the whole save. Needs the serial
+// already read and touches only the cache directory, so the backup writer
+// thread calls it off the USB thread.
+void savesync_record(CrocoDevice *device, const RomInfo *info, const uint8_t *data);
+
+// The same for a slot looked up by ID on the USB thread; a short image is zero padded like an upload
+void savesync_record_slot(CrocoDevice *device, uint8_t rom_id, uint8_t num_ram_banks, const uint8_t *data, long size);
+
+// After a failed write the cartridge holds neither image
+void savesync_forget(CrocoDevice *device, uint8_t rom_id);
+
+// Batch operation: sync <id> <sav>
+int savesync_upload(CrocoDevice *device, uint8_t rom_id, const char *file_path);
+
+#endif
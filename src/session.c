@@ -0,0 +1,287 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "session.h"
+#include "romcache.h"
+#include "transport.h"
+#include "log.h"
+
+// Concurrent sessions for a hub full of cartridges. Each cartridge has its
+// own claimed interface, ROM table cache and flash journal (both keyed by
+// serial), so a session is just a thread running the batch plan on its
+// device. Every device has its own libusb context, so a session thread only
+// ever runs the completions of its own transfers.
+
+static void lane_progress(void *user, const char *stage, uint32_t done, uint32_t total) {
+    CrocoSession *session = user;
+    pthread_mutex_lock(&session->lock);
+    snprintf(session->stage, sizeof(session->stage), "%s", stage);
+    session->done = done;
+    session->total = total;
+    pthread_mutex_unlock(&session->lock);
+}
+
+static void session_flush_line(CrocoSession *session, int level) {
+    session->line[session->line_len] = '\0';
+    fprintf(level == CROCO_LOG_ERROR ? stderr : stdout, "[%s] %s\n", session->label, session->line);
+    session->line_len = 0;
+}
+
+// Only the session's own thread logs under it, so the line buffer needs no lock;
+// each line goes out in one call so lines of different sessions never interleave
+void session_log(CrocoSession *session, int level, const char *text) {
+    for (; *text; text++) {
+        if (*text != '\n') {
+            session->line[session->line_len++] = *text;
+        }
+        if (*text == '\n' || session->line_len == sizeof(session->line) - 1) {
+            session_flush_line(session, level);
+        }
+    }
+}
+
+static void *session_main(void *arg) {
+    CrocoSession *session = arg;
+    const BatchPlan *plan = session->plan;
+    int failures = 0;
+    int ran = 0;
+    croco_log_set_source(session);
+    session->device->allow_foreign_saves = plan->allow_foreign;
+
+    for (int i = 0; i < plan->count; i++) {
+        pthread_mutex_lock(&session->lock);
+        session->op = i;
+        session->stage[0] = '\0';
+        session->total = 0;
+        pthread_mutex_unlock(&session->lock);
+
+        // Every cartridge backs up into its own subdirectory
+        BatchOp op = plan->ops[i];
+        char dir[512];
+        if (op.kind == BATCH_BACKUP_ALL) {
+            mkdir(op.arg[0], 0755);
+            snprintf(dir, sizeof(dir), "%s/%s", op.arg[0], session->label);
+            op.arg[0] = dir;
+        }
+
+        ran++;
+        if (batch_run_op(session->device, &op) != 0) {
+            failures++;
+            if (!plan->keep_going) {
+                break;
+            }
+        }
+    }
+
+    if (session->line_len) {
+        session_flush_line(session, CROCO_LOG_INFO);
+    }
+    croco_log_set_source(NULL);
+
+    pthread_mutex_lock(&session->lock);
+    session->failures = failures;
+    session->ran = ran;
+    session->finished = 1;
+    session->end_ns = monotonic_ns();
+    pthread_mutex_unlock(&session->lock);
+    return NULL;
+}
+
+void session_draw_lane(FILE *term, CrocoSession *session) {
+    pthread_mutex_lock(&session->lock);
+    CrocoSession lane = *session;
+    pthread_mutex_unlock(&session->lock);
+
+    fprintf(term, "\x1b[2K   [\x1b[1;36m%s\x1b[0m] ", lane.label);
+    if (lane.finished) {
+        double seconds = (lane.end_ns - lane.start_ns) / 1e9;
+        if (lane.failures) {
+            fprintf(term, "\x1b[1;31mFAILED\x1b[0m %d of %d operation(s), %.1f s\n", lane.failures, lane.ran, seconds);
+        } else {
+            fprintf(term, "\x1b[1;32mdone\x1b[0m %d operation(s), %.1f s\n", lane.ran, seconds);
+        }
+    } else if (lane.op < 0) {
+        fprintf(term, "\x1b[90mwaiting\x1b[0m\n");
+    } else {
+        fprintf(term, "\x1b[1;34m%-10s\x1b[0m", batch_op_name(lane.plan->ops[lane.op].kind));
+        if (lane.total) {
+            fprintf(term, " \x1b[1;33m%s:\x1b[0m [\x1b[1;32m%u\x1b[0m/\x1b[1;32m%u\x1b[0m]", lane.stage, lane.done, lane.total);
+        }
+        fprintf(term, "\n");
+    }
+}
+
+int session_finished(CrocoSession *session) {
+    pthread_mutex_lock(&session->lock);
+    int finished = session->finished;
+    pthread_mutex_unlock(&session->lock);
+    return finished;
+}
+
+static int sessions_finished(CrocoSession *sessions, int count) {
+    int finished = 0;
+    for (int i = 0; i < count; i++) {
+        finished += session_finished(&sessions[i]);
+    }
+    return finished;
+}
+
+void session_init(CrocoSession *session, CrocoDevice *device, const BatchPlan *plan, int index) {
+    memset(session, 0, sizeof(*session));
+    session->device = device;
+    session->plan = plan;
+    session->op = -1;
+    pthread_mutex_init(&session->lock, NULL);
+    if (read_serial(device) == 0) {
+        const uint8_t *s = device->serial;
+        snprintf(session->label, sizeof(session->label), "%02X%02X%02X%02X%02X%02X%02X%02X",
+                 s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7]);
+    } else {
+        snprintf(session->label, sizeof(session->label), "cart-%d", index);
+    }
+    device->progress = lane_progress;
+    device->progress_user = session;
+}
+
+int session_start(CrocoSession *session) {
+    session->start_ns = monotonic_ns();
+    if (pthread_create(&session->thread, NULL, session_main, session) != 0) {
+        session->finished = 1;
+        session->failures = 1;
+        session->end_ns = session->start_ns;
+        return -1;
+    }
+    session->started = 1;
+    return 0;
+}
+
+void session_join(CrocoSession *session) {
+    if (session->started) {
+        pthread_join(session->thread, NULL);
+        session->started = 0;
+    }
+}
+
+// Points stdout at the session log and returns a stream on the real terminal
+FILE *session_capture_stdout(char *log_path, size_t len) {
+    fflush(stdout);
+    int term_fd = dup(STDOUT_FILENO);
+    FILE *term = (term_fd >= 0) ? fdopen(term_fd, "w") : NULL;
+    if (!term) {
+        return NULL;
+    }
+
+    char dir[200];
+    int log_fd = -1;
+    if (romcache_mkdir() == 0 && romcache_dir(dir, sizeof(dir)) == 0) {
+        snprintf(log_path, len, "%s/sessions.log", dir);
+        log_fd = open(log_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (log_fd < 0) {
+        snprintf(log_path, len, "/dev/null");
+        log_fd = open(log_path, O_WRONLY);
+    }
+    dup2(log_fd, STDOUT_FILENO);
+    close(log_fd);
+    return term;
+}
+
+void session_restore_stdout(FILE *term) {
+    fflush(stdout);
+    fflush(term);
+    dup2(fileno(term), STDOUT_FILENO);
+    fclose(term);
+}
+
+int session_run_all(const BatchPlan *plan) {
+    CrocoDevice *devices = calloc(SESSION_MAX, sizeof(CrocoDevice));
+    CrocoSession *sessions = calloc(SESSION_MAX, sizeof(CrocoSession));
+    if (!devices || !sessions) {
+        free(devices);
+        free(sessions);
+        return -1;
+    }
+
+    int count = open_all_devices(devices, SESSION_MAX);
+    if (count <= 0) {
+        free(devices);
+        free(sessions);
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        session_init(&sessions[i], &devices[i], plan, i);
+    }
+
+    printf("\n\x1b[1;34m   [>] Running %d operation(s) on %d cartridge(s)...\x1b[0m\n\n", plan->count, count);
+
+    char log_path[256];
+    FILE *term = session_capture_stdout(log_path, sizeof(log_path));
+    if (!term) {
+        fprintf(stderr, "\x1b[1;31m[!] Error: Could not capture session output\x1b[0m\n");
+        for (int i = 0; i < count; i++) {
+            pthread_mutex_destroy(&sessions[i].lock);
+            cleanup(&devices[i]);
+        }
+        free(devices);
+        free(sessions);
+        return -1;
+    }
+    int lanes = isatty(fileno(term));
+
+    uint64_t start_ns = monotonic_ns();
+    for (int i = 0; i < count; i++) {
+        session_start(&sessions[i]);
+    }
+
+    if (lanes) {
+        for (int i = 0; i < count; i++) {
+            session_draw_lane(term, &sessions[i]);
+        }
+        while (sessions_finished(sessions, count) < count) {
+            struct timespec ts = { 0, SESSION_REDRAW_MS * 1000000L };
+            nanosleep(&ts, NULL);
+            fprintf(term, "\x1b[%dA", count);
+            for (int i = 0; i < count; i++) {
+                session_draw_lane(term, &sessions[i]);
+            }
+            fflush(term);
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        session_join(&sessions[i]);
+    }
+    double seconds = (monotonic_ns() - start_ns) / 1e9;
+
+    if (lanes) {
+        fprintf(term, "\x1b[%dA", count);
+    }
+    for (int i = 0; i < count; i++) {
+        session_draw_lane(term, &sessions[i]);
+    }
+    session_restore_stdout(term);
+
+    int failed = 0;
+    for (int i = 0; i < count; i++) {
+        failed += (sessions[i].failures != 0);
+        pthread_mutex_destroy(&sessions[i].lock);
+        cleanup(&devices[i]);
+    }
+
+    printf("\n   \x1b[1;32m[+] %d of %d cartridge(s) finished in %.1f s\x1b[0m", count - failed, count, seconds);
+    if (failed) {
+        printf(", \x1b[1;31m%d failed\x1b[0m", failed);
+    }
+    printf("\n       Session output: %s\n", log_path);
+
+    free(devices);
+    free(sessions);
+    return failed;
+}
@@ -0,0 +1,53 @@
+#ifndef CROCO_SESSION_H
+#define CROCO_SESSION_H
+
+#include <pthread.h>
+#include "batch.h"
+
+#define SESSION_MAX 16              // cartridges driven at once
+#define SESSION_REDRAW_MS 100
+
+typedef struct {
+    CrocoDevice *device;
+    const BatchPlan *plan;
+    char label[17];             // serial ID in hex
+    pthread_t thread;
+    int started;
+
+    pthread_mutex_t lock;       // guards the lane below
+    int op;                     // operation being run, -1 before the first
+    char stage[24];
+    uint32_t done;
+    uint32_t total;
+    int finished;
+    int failures;
+    int ran;
+    uint64_t start_ns;
+    uint64_t end_ns;
+
+    char line[256];             // log text of the session thread up to the next newline
+    size_t line_len;
+} CrocoSession;
+
+// Reads the serial that names the session and hooks the device progress into its lane
+void session_init(CrocoSession *session, CrocoDevice *device, const BatchPlan *plan, int index);
+// Runs the plan on a thread of its own
+int session_start(CrocoSession *session);
+int session_finished(CrocoSession *session);
+void session_join(CrocoSession *session);
+void session_draw_lane(FILE *term, CrocoSession *session);
+// For the log sink: text from a session thread, written a line at a time with the serial in front
+void session_log(CrocoSession *session, int level, const char *text);
+
+// Points stdout at sessions.log in the cache directory and returns a stream on the terminal
+FILE *session_capture_stdout(char *log_path, size_t len);
+void session_restore_stdout(FILE *term);
+
+// Opens every attached cartridge and runs the plan on each one in its own
+// thread. The command chatter goes to sessions.log in the cache directory,
+// each line prefixed with the serial of its cartridge;
+// the terminal gets one progress lane per cartridge and a final report.
+// Returns the number of cartridges with a failed operation, or -1.
+int session_run_all(const BatchPlan *plan);
+
+#endif
@@ -0,0 +1,653 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+#include "sim.h"
+
+// Software stand-in for the Croco cartridge.
+//
+// Implements the firmware side of the USB protocol (0x01-0x09, 0x0C, 0xFD, 0xFE)
+// on top of an in-memory flash of SIM_MAX_BANKS ROM banks plus per-ROM SRAM.
+// Timing is simulated in real time: every transfer occupies the bus for
+// packet_us per 64-byte packet, and the firmware handles one command at a
+// time, taking latency_us[opcode] for each. Responses queue up on the device
+// until IN transfers collect them, and OUT transfers stall (like a NAK) once
+// rx_depth responses are waiting. drop=N loses one OUT transfer on the wire
+// and dup=N answers one twice, to exercise the host's recovery paths; fill=0
+// refuses 0x0C like firmware that was opted into the capability but lacks it.
+
+typedef struct {
+    char name[17];
+    uint8_t mbc;
+    uint8_t num_ram_banks;
+    uint16_t num_rom_banks;
+    uint8_t *rom;
+    uint8_t *sram;
+} SimRom;
+
+typedef struct {
+    uint64_t ready_ns;
+    int len;
+    uint8_t data[64];
+} SimResponse;
+
+typedef enum {
+    SIM_IDLE,
+    SIM_ROM_UPLOAD,
+    SIM_SAVE_DOWNLOAD,
+    SIM_SAVE_UPLOAD,
+} SimState;
+
+typedef struct {
+    SimConfig config;
+
+    SimRom roms[SIM_MAX_ROMS];
+    int num_roms;
+    uint16_t used_banks;
+
+    SimState state;
+    SimRom pending;         // ROM being uploaded
+    int target;             // ROM id of the save transfer in progress
+    uint32_t next_chunk;    // expected (bank * chunks_per_bank + chunk)
+
+    SimResponse responses[SIM_RESPONSE_QUEUE];
+    int resp_head;
+    int resp_count;
+
+    CrocoTransfer *out_head, *out_tail;
+    CrocoTransfer *in_head, *in_tail;
+    CrocoTransfer *done_head, *done_tail;  // cancelled, waiting for their callback
+
+    uint64_t wire_free_ns;
+    uint64_t device_free_ns;
+    uint32_t out_count;     // OUT transfers seen, for fault injection
+} SimCart;
+
+static uint8_t sim_ram_banks(uint8_t cart_type, uint8_t ram_code) {
+    // MBC2 has 512x4 bits of built-in RAM
+    if (cart_type == 0x05 || cart_type == 0x06) {
+        return 1;
+    }
+    switch (ram_code) {
+        case 0x02: return 1;
+        case 0x03: return 4;
+        case 0x04: return 16;
+        case 0x05: return 8;
+        default: return 0;
+    }
+}
+
+static void sim_free_rom(SimRom *rom) {
+    free(rom->rom);
+    free(rom->sram);
+    memset(rom, 0, sizeof(*rom));
+}
+
+static void sim_put_be16(uint8_t *p, uint16_t v) {
+    p[0] = v >> 8;
+    p[1] = v & 0xFF;
+}
+
+static uint16_t sim_get_be16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+// Commits the pending ROM once its last chunk is in
+static void sim_finish_upload(SimCart *sim) {
+    if (sim->next_chunk != (uint32_t)sim->pending.num_rom_banks * ROM_CHUNKS_PER_BANK) {
+        return;
+    }
+    SimRom *rom = &sim->pending;
+    rom->mbc = rom->rom[0x147];
+    rom->num_ram_banks = sim_ram_banks(rom->rom[0x147], rom->rom[0x149]);
+    if (rom->num_ram_banks) {
+        rom->sram = malloc((size_t)rom->num_ram_banks * SIM_SRAM_BANK_SIZE);
+        if (rom->sram) {
+            memset(rom->sram, 0xFF, (size_t)rom->num_ram_banks * SIM_SRAM_BANK_SIZE);
+        }
+    }
+    sim->roms[sim->num_roms++] = *rom;
+    sim->used_banks += rom->num_rom_banks;
+    memset(rom, 0, sizeof(*rom));
+    sim->state = SIM_IDLE;
+}
+
+// Run one command through the firmware model. Returns the response length
+// (including the echo byte), or 0 if the firmware stays silent.
+static int sim_execute(SimCart *sim, const uint8_t *cmd, int len, uint8_t *resp) {
+    uint8_t op = cmd[0];
+    const uint8_t *arg = cmd + 1;
+    int arg_len = len - 1;
+
+    resp[0] = op;
+
+    switch (op) {
+        case 0x01:
+            resp[1] = (uint8_t)sim->num_roms;
+            sim_put_be16(resp + 2, sim->used_banks);
+            sim_put_be16(resp + 4, SIM_MAX_BANKS);
+            return 6;
+
+        case 0x02: {
+            if (arg_len < 21 || sim->state != SIM_IDLE) {
+                resp[1] = 2;
+                return 2;
+            }
+            uint16_t banks = sim_get_be16(arg);
+            if (banks == 0 || sim->num_roms >= SIM_MAX_ROMS || sim->used_banks + banks > SIM_MAX_BANKS) {
+                resp[1] = 1;
+                return 2;
+            }
+            memset(&sim->pending, 0, sizeof(sim->pending));
+            memcpy(sim->pending.name, arg + 2, 17);
+            sim->pending.num_rom_banks = banks;
+            sim->pending.rom = calloc(banks, ROM_BANK_SIZE);
+            if (!sim->pending.rom) {
+                resp[1] = 1;
+                return 2;
+            }
+            sim->state = SIM_ROM_UPLOAD;
+            sim->next_chunk = 0;
+            resp[1] = 0;
+            return 2;
+        }
+
+        case 0x03: {
+            if (arg_len < 4 + CHUNK_DATA_SIZE || sim->state != SIM_ROM_UPLOAD) {
+                resp[1] = 2;
+                return 2;
+            }
+            uint32_t seq = (uint32_t)sim_get_be16(arg) * ROM_CHUNKS_PER_BANK + sim_get_be16(arg + 2);
+            // Flash is programmed a bank at a time, so the open bank can be restarted from chunk 0
+            if (sim_get_be16(arg + 2) == 0 && seq == sim->next_chunk - sim->next_chunk % ROM_CHUNKS_PER_BANK) {
+                sim->next_chunk = seq;
+            }
+            if (sim_get_be16(arg + 2) >= ROM_CHUNKS_PER_BANK || seq != sim->next_chunk) {
+                resp[1] = 3;
+                return 2;
+            }
+            memcpy(sim->pending.rom + seq * CHUNK_DATA_SIZE, arg + 4, CHUNK_DATA_SIZE);
+            sim->next_chunk++;
+            sim_finish_upload(sim);
+            resp[1] = 0;
+            return 2;
+        }
+
+        case 0x0C: {
+            // Fill the rest of the open bank with one byte value: [bank, chunk, value]
+            if (sim->config.no_fill) {
+                resp[1] = 1;
+                return 2;
+            }
+            if (arg_len < 5 || sim->state != SIM_ROM_UPLOAD) {
+                resp[1] = 2;
+                return 2;
+            }
+            uint32_t seq = (uint32_t)sim_get_be16(arg) * ROM_CHUNKS_PER_BANK + sim_get_be16(arg + 2);
+            if (sim_get_be16(arg + 2) >= ROM_CHUNKS_PER_BANK || seq != sim->next_chunk) {
+                resp[1] = 3;
+                return 2;
+            }
+            uint32_t bank_end = seq - seq % ROM_CHUNKS_PER_BANK + ROM_CHUNKS_PER_BANK;
+            memset(sim->pending.rom + seq * CHUNK_DATA_SIZE, arg[4], (bank_end - seq) * CHUNK_DATA_SIZE);
+            sim->next_chunk = bank_end;
+            sim_finish_upload(sim);
+            resp[1] = 0;
+            return 2;
+        }
+
+        case 0x04: {
+            if (arg_len < 1 || arg[0] >= sim->num_roms) {
+                resp[1] = 1;
+                return 2;
+            }
+            SimRom *rom = &sim->roms[arg[0]];
+            memcpy(resp + 1, rom->name, 17);
+            resp[18] = rom->num_ram_banks;
+            resp[19] = rom->mbc;
+            sim_put_be16(resp + 20, rom->num_rom_banks);
+            return 22;
+        }
+
+        case 0x05: {
+            if (arg_len < 1 || arg[0] >= sim->num_roms || sim->state != SIM_IDLE) {
+                resp[1] = 1;
+                return 2;
+            }
+            int id = arg[0];
+            sim->used_banks -= sim->roms[id].num_rom_banks;
+            sim_free_rom(&sim->roms[id]);
+            memmove(&sim->roms[id], &sim->roms[id + 1], (sim->num_roms - id - 1) * sizeof(SimRom));
+            sim->num_roms--;
+            memset(&sim->roms[sim->num_roms], 0, sizeof(SimRom));
+            resp[1] = 0;
+            return 2;
+        }
+
+        case 0x06:
+        case 0x08:
+            if (arg_len < 1 || arg[0] >= sim->num_roms || sim->state != SIM_IDLE ||
+                sim->roms[arg[0]].num_ram_banks == 0 || !sim->roms[arg[0]].sram) {
+                resp[1] = 1;
+                return 2;
+            }
+            sim->state = (op == 0x06) ? SIM_SAVE_DOWNLOAD : SIM_SAVE_UPLOAD;
+            sim->target = arg[0];
+            sim->next_chunk = 0;
+            resp[1] = 0;
+            return 2;
+
+        case 0x07: {
+            if (sim->state != SIM_SAVE_DOWNLOAD) {
+                resp[1] = 1;
+                return 2;
+            }
+            SimRom *rom = &sim->roms[sim->target];
+            uint32_t per_bank = SIM_SRAM_BANK_SIZE / CHUNK_DATA_SIZE;
+            sim_put_be16(resp + 1, (uint16_t)(sim->next_chunk / per_bank));
+            sim_put_be16(resp + 3, (uint16_t)(sim->next_chunk % per_bank));
+            memcpy(resp + 5, rom->sram + sim->next_chunk * CHUNK_DATA_SIZE, CHUNK_DATA_SIZE);
+            if (++sim->next_chunk == rom->num_ram_banks * per_bank) {
+                sim->state = SIM_IDLE;
+            }
+            return 5 + CHUNK_DATA_SIZE;
+        }
+
+        case 0x09: {
+            if (arg_len < 4 + CHUNK_DATA_SIZE || sim->state != SIM_SAVE_UPLOAD) {
+                resp[1] = 2;
+                return 2;
+            }
+            SimRom *rom = &sim->roms[sim->target];
+            uint32_t per_bank = SIM_SRAM_BANK_SIZE / CHUNK_DATA_SIZE;
+            uint32_t seq = sim_get_be16(arg) * per_bank + sim_get_be16(arg + 2);
+            // CROCO_CAP_SPARSE_SAVE: chunks may skip forward, never back
+            if (sim_get_be16(arg + 2) >= per_bank || seq < sim->next_chunk || seq >= rom->num_ram_banks * per_bank) {
+                resp[1] = 3;
+                return 2;
+            }
+            memcpy(rom->sram + seq * CHUNK_DATA_SIZE, arg + 4, CHUNK_DATA_SIZE);
+            sim->next_chunk = seq;
+            if (++sim->next_chunk == rom->num_ram_banks * per_bank) {
+                sim->state = SIM_IDLE;
+            }
+            resp[1] = 0;
+            return 2;
+        }
+
+        case 0xFD:
+            memcpy(resp + 1, sim->config.serial, 8);
+            return 9;
+
+        case 0xFE:
+            resp[1] = 1;      // feature step, as released firmware reports
+            resp[2] = 1;      // hw revision
+            resp[3] = 1;      // sw major
+            resp[4] = 0;      // sw minor
+            resp[5] = 0;      // sw patch
+            resp[6] = 'S';    // build type: simulator
+            memset(resp + 7, 0, 4);
+            resp[11] = 0;     // git dirty
+            return 12;
+
+        default:
+            // The firmware ignores commands it doesn't know
+            return 0;
+    }
+}
+
+static uint64_t sim_packet_ns(const SimCart *sim, int len) {
+    int packets = (len + 63) / 64;
+    if (packets < 1) {
+        packets = 1;
+    }
+    return (uint64_t)packets * sim->config.packet_us * 1000;
+}
+
+static void sim_queue_push(CrocoTransfer **head, CrocoTransfer **tail, CrocoTransfer *transfer) {
+    transfer->next = NULL;
+    if (*tail) {
+        (*tail)->next = transfer;
+    } else {
+        *head = transfer;
+    }
+    *tail = transfer;
+}
+
+static CrocoTransfer *sim_queue_pop(CrocoTransfer **head, CrocoTransfer **tail) {
+    CrocoTransfer *transfer = *head;
+    if (transfer) {
+        *head = transfer->next;
+        if (!*head) {
+            *tail = NULL;
+        }
+        transfer->next = NULL;
+    }
+    return transfer;
+}
+
+static int sim_queue_remove(CrocoTransfer **head, CrocoTransfer **tail, CrocoTransfer *transfer) {
+    CrocoTransfer *prev = NULL;
+    for (CrocoTransfer *it = *head; it; prev = it, it = it->next) {
+        if (it != transfer) {
+            continue;
+        }
+        if (prev) {
+            prev->next = it->next;
+        } else {
+            *head = it->next;
+        }
+        if (*tail == it) {
+            *tail = prev;
+        }
+        it->next = NULL;
+        return 0;
+    }
+    return -1;
+}
+
+static void sim_complete(CrocoTransfer *transfer, int status) {
+    transfer->status = status;
+    transfer->backend = NULL;
+    transfer_complete(transfer);
+}
+
+static uint64_t sim_deadline(const CrocoTransfer *transfer) {
+    if (transfer->timeout_ms == 0) {
+        return UINT64_MAX;
+    }
+    return transfer->submit_ns + (uint64_t)transfer->timeout_ms * 1000000ull;
+}
+
+static uint64_t sim_max(uint64_t a, uint64_t b) {
+    return a > b ? a : b;
+}
+
+// Fire every bus event that is due by `now`, earliest first. Returns how many
+// transfers completed and stores the time of the next pending event.
+static int sim_step(SimCart *sim, uint64_t now, uint64_t *next_due) {
+    int fired = 0;
+
+    for (;;) {
+        uint64_t out_due = UINT64_MAX;
+        uint64_t in_due = UINT64_MAX;
+        CrocoTransfer *out = sim->out_head;
+        CrocoTransfer *in = sim->in_head;
+
+        if (out && sim->resp_count < sim->config.rx_depth) {
+            out_due = sim_max(out->submit_ns, sim->wire_free_ns) + sim_packet_ns(sim, out->length);
+        }
+        if (in && sim->resp_count > 0) {
+            SimResponse *r = &sim->responses[sim->resp_head];
+            in_due = sim_max(sim_max(r->ready_ns, in->submit_ns), sim->wire_free_ns) + sim_packet_ns(sim, r->len);
+        }
+
+        uint64_t due = out_due < in_due ? out_due : in_due;
+        uint64_t out_expiry = out ? sim_deadline(out) : UINT64_MAX;
+        uint64_t in_expiry = in ? sim_deadline(in) : UINT64_MAX;
+
+        if (due <= now && due == out_due && out_due <= out_expiry) {
+            sim_queue_pop(&sim->out_head, &sim->out_tail);
+            sim->wire_free_ns = out_due;
+
+            if (++sim->out_count == sim->config.drop_out) {
+                sim_complete(out, XFER_ERROR);
+                fired++;
+                continue;
+            }
+
+            uint8_t resp[64];
+            int resp_len = sim_execute(sim, out->buffer, out->length, resp);
+            uint64_t start = sim_max(out_due, sim->device_free_ns);
+            sim->device_free_ns = start + (uint64_t)sim->config.latency_us[out->buffer[0]] * 1000;
+
+            int copies = (sim->out_count == sim->config.dup_out) ? 2 : 1;
+            for (int i = 0; i < copies && resp_len > 0 && sim->resp_count < SIM_RESPONSE_QUEUE; i++) {
+                SimResponse *r = &sim->responses[(sim->resp_head + sim->resp_count) % SIM_RESPONSE_QUEUE];
+                r->ready_ns = sim->device_free_ns;
+                r->len = resp_len;
+                memcpy(r->data, resp, resp_len);
+                sim->resp_count++;
+            }
+
+            out->actual_length = out->length;
+            sim_complete(out, XFER_COMPLETED);
+            fired++;
+            continue;
+        }
+
+        if (due <= now && due == in_due && in_due <= in_expiry) {
+            SimResponse *r = &sim->responses[sim->resp_head];
+            sim_queue_pop(&sim->in_head, &sim->in_tail);
+            sim->wire_free_ns = in_due;
+
+            int len = r->len < in->length ? r->len : in->length;
+            memcpy(in->buffer, r->data, len);
+            in->actual_length = len;
+            sim->resp_head = (sim->resp_head + 1) % SIM_RESPONSE_QUEUE;
+            sim->resp_count--;
+
+            sim_complete(in, XFER_COMPLETED);
+            fired++;
+            continue;
+        }
+
+        if (out_expiry <= now) {
+            sim_queue_pop(&sim->out_head, &sim->out_tail);
+            sim_complete(out, XFER_TIMED_OUT);
+            fired++;
+            continue;
+        }
+        if (in_expiry <= now) {
+            sim_queue_pop(&sim->in_head, &sim->in_tail);
+            sim_complete(in, XFER_TIMED_OUT);
+            fired++;
+            continue;
+        }
+
+        uint64_t next = due;
+        if (out_expiry < next) {
+            next = out_expiry;
+        }
+        if (in_expiry < next) {
+            next = in_expiry;
+        }
+        *next_due = next;
+        return fired;
+    }
+}
+
+static int sim_submit(CrocoTransfer *transfer) {
+    SimCart *sim = transfer->device->backend;
+
+    transfer->backend = sim;
+    if (transfer->direction == XFER_OUT) {
+        if (transfer->length < 1) {
+            transfer->backend = NULL;
+            return -1;
+        }
+        sim_queue_push(&sim->out_head, &sim->out_tail, transfer);
+    } else {
+        sim_queue_push(&sim->in_head, &sim->in_tail, transfer);
+    }
+    return 0;
+}
+
+static int sim_cancel(CrocoTransfer *transfer) {
+    SimCart *sim = transfer->device->backend;
+
+    if (!transfer->backend) {
+        return -1;
+    }
+    int ret = (transfer->direction == XFER_OUT)
+        ? sim_queue_remove(&sim->out_head, &sim->out_tail, transfer)
+        : sim_queue_remove(&sim->in_head, &sim->in_tail, transfer);
+    if (ret != 0) {
+        return -1;
+    }
+
+    // Like libusb, the cancellation is reported from the event loop
+    sim_queue_push(&sim->done_head, &sim->done_tail, transfer);
+    return 0;
+}
+
+static int sim_handle_events(CrocoDevice *device, uint64_t timeout_ns, int *completed) {
+    SimCart *sim = device->backend;
+    uint64_t deadline = monotonic_ns() + timeout_ns;
+
+    for (;;) {
+        int fired = 0;
+        CrocoTransfer *transfer;
+        while ((transfer = sim_queue_pop(&sim->done_head, &sim->done_tail)) != NULL) {
+            sim_complete(transfer, XFER_CANCELLED);
+            fired++;
+        }
+
+        uint64_t now = monotonic_ns();
+        uint64_t next_due = UINT64_MAX;
+        fired += sim_step(sim, now, &next_due);
+
+        if (fired > 0 || (completed && *completed) || now >= deadline) {
+            return 0;
+        }
+
+        uint64_t wake = next_due < deadline ? next_due : deadline;
+        uint64_t sleep_ns = wake - now;
+        struct timespec ts = { sleep_ns / 1000000000ull, sleep_ns % 1000000000ull };
+        nanosleep(&ts, NULL);
+    }
+}
+
+static void sim_close(CrocoDevice *device) {
+    SimCart *sim = device->backend;
+    if (!sim) {
+        return;
+    }
+    for (int i = 0; i < sim->num_roms; i++) {
+        sim_free_rom(&sim->roms[i]);
+    }
+    sim_free_rom(&sim->pending);
+    free(sim);
+    device->backend = NULL;
+}
+
+const CrocoTransport sim_transport = {
+    "sim",
+    sim_submit,
+    sim_cancel,
+    sim_handle_events,
+    sim_close,
+};
+
+void sim_config_default(SimConfig *config) {
+    memset(config, 0, sizeof(*config));
+
+    // Rough figures for the RP2040 firmware on a full-speed link
+    for (int op = 0; op < 256; op++) {
+        config->latency_us[op] = 20;
+    }
+    config->latency_us[0x02] = 2000;   // flash allocation
+    config->latency_us[0x03] = 60;
+    config->latency_us[0x05] = 5000;   // flash erase
+    config->latency_us[0x07] = 30;
+    config->latency_us[0x09] = 40;
+    config->packet_us = 20;
+    config->rx_depth = 32;
+    config->carts = 1;
+
+    static const uint8_t serial[8] = { 0xE6, 0x60, 0x58, 0x38, 0x83, 0x2A, 0x5C, 0x2D };
+    memcpy(config->serial, serial, sizeof(serial));
+}
+
+int sim_config_parse(SimConfig *config, const char *spec) {
+    char buf[256];
+    strncpy(buf, spec, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+
+    char *save = NULL;
+    for (char *tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        char *eq = strchr(tok, '=');
+        if (!eq) {
+            // A bare "1" or "on" just enables the simulator
+            continue;
+        }
+        *eq = '\0';
+        const char *key = tok;
+        char *end;
+        unsigned long value = strtoul(eq + 1, &end, 0);
+
+        if (strcmp(key, "serial") == 0) {
+            unsigned long long serial = strtoull(eq + 1, &end, 16);
+            for (int i = 0; i < 8; i++) {
+                config->serial[i] = (uint8_t)(serial >> (56 - i * 8));
+            }
+        } else if (*end != '\0') {
+            fprintf(stderr, "Invalid simulator value for %s: %s\n", key, eq + 1);
+            return -1;
+        } else if (strcmp(key, "latency") == 0) {
+            for (int op = 0; op < 256; op++) {
+                config->latency_us[op] = (uint32_t)value;
+            }
+        } else if (strncmp(key, "op", 2) == 0 && strlen(key) == 4) {
+            config->latency_us[strtoul(key + 2, NULL, 16) & 0xFF] = (uint32_t)value;
+        } else if (strcmp(key, "packet") == 0) {
+            config->packet_us = (uint32_t)value;
+        } else if (strcmp(key, "drop") == 0) {
+            config->drop_out = (uint32_t)value;
+        } else if (strcmp(key, "dup") == 0) {
+            config->dup_out = (uint32_t)value;
+        } else if (strcmp(key, "carts") == 0) {
+            config->carts = (value < 1) ? 1 : (value > SIM_MAX_CARTS ? SIM_MAX_CARTS : (int)value);
+        } else if (strcmp(key, "serials") == 0) {
+            config->serials = (int)value;
+        } else if (strcmp(key, "fill") == 0) {
+            config->no_fill = (value == 0);
+        } else if (strcmp(key, "plug") == 0) {
+            config->plug_ms = (uint32_t)value;
+        } else if (strcmp(key, "depth") == 0) {
+            config->rx_depth = (value < 1) ? 1 : (value > SIM_RESPONSE_QUEUE ? SIM_RESPONSE_QUEUE : (int)value);
+        } else {
+            fprintf(stderr, "Unknown simulator option: %s\n", key);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int sim_open(CrocoDevice *device, const SimConfig *config) {
+    SimCart *sim = calloc(1, sizeof(SimCart));
+    if (!sim) {
+        return -1;
+    }
+    sim->config = *config;
+
+    device->dev = NULL;
+    device->vendor_id = CROCO_VENDOR_ID;
+    device->product_id = CROCO_PRODUCT_ID;
+    device->out_ep = 0x01;
+    device->in_ep = 0x81;
+    device->if_num = 0;
+    device->transport = &sim_transport;
+    device->backend = sim;
+    device->caps = SIM_CAPS;
+
+#ifdef __linux__
+    // The default 50 us timer slack would swamp the simulated bus timing
+    prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+#endif
+
+    printf("Found device: %04x:%04x (simulated)\n", device->vendor_id, device->product_id);
+    return 0;
+}
+
+int sim_open_cart(CrocoDevice *device, const SimConfig *config, int index) {
+    SimConfig cart = *config;
+    if (config->serials > 0) {
+        index %= config->serials;
+    }
+    cart.serial[7] = (uint8_t)(cart.serial[7] + index);
+    return sim_open(device, &cart);
+}
@@ -0,0 +1,36 @@
+#ifndef CROCO_SIM_H
+#define CROCO_SIM_H
+
+#include "croco.h"
+#include "transport.h"
+
+#define SIM_MAX_BANKS 888
+#define SIM_MAX_ROMS 128
+#define SIM_SRAM_BANK_SIZE 8192
+#define SIM_RESPONSE_QUEUE 256
+#define SIM_MAX_CARTS 16
+#define SIM_CAPS (CROCO_CAP_FILL_BANK | CROCO_CAP_SPARSE_SAVE)  // the protocol extensions it implements
+
+typedef struct {
+    uint32_t latency_us[256];   // firmware processing time per opcode
+    uint32_t packet_us;         // bus time per 64-byte USB packet
+    int rx_depth;               // unread responses the device holds before it NAKs OUT
+    uint8_t serial[8];
+    uint32_t drop_out;          // lose the n-th OUT transfer on the wire (0 = never)
+    uint32_t dup_out;           // answer the n-th OUT transfer twice, leaving a stale packet
+    int carts;                  // cartridges on the simulated hub, for open_all_devices
+    uint32_t plug_ms;           // with --watch, a cart is plugged in every plug_ms
+    int serials;                // distinct serials on the hub, so later carts are replugs (0 = carts)
+    int no_fill;                // refuse 0x0C although SIM_CAPS declares it
+} SimConfig;
+
+extern const CrocoTransport sim_transport;
+
+void sim_config_default(SimConfig *config);
+// spec is a comma separated list such as "latency=50,op03=120,packet=20,depth=32"
+int sim_config_parse(SimConfig *config, const char *spec);
+int sim_open(CrocoDevice *device, const SimConfig *config);
+// Cart number index on the simulated hub; serial IDs count up from config->serial
+int sim_open_cart(CrocoDevice *device, const SimConfig *config, int index);
+
+#endif
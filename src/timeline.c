@@ -0,0 +1,447 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "timeline.h"
+#include "hash.h"
+#include "lzpack.h"
+#include "romcache.h"
+#include "savesync.h"
+
+#define TIMELINE_STAMP_LEN 16       // 20261016T120000Z
+
+static void put_le32(uint8_t *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = (v >> (i * 8)) & 0xFF;
+    }
+}
+
+static void put_le64(uint8_t *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+        p[i] = (v >> (i * 8)) & 0xFF;
+    }
+}
+
+static uint32_t get_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get_le64(const uint8_t *p) {
+    return (uint64_t)get_le32(p) | ((uint64_t)get_le32(p + 4) << 32);
+}
+
+static int make_dir(const char *path) {
+    return (mkdir(path, 0755) == 0 || errno == EEXIST) ? 0 : -1;
+}
+
+static int timeline_dir(const uint8_t *serial, char *buf, size_t len) {
+    char dir[200];
+    if (romcache_dir(dir, sizeof(dir)) != 0) {
+        return -1;
+    }
+    snprintf(buf, len, "%s/timeline/%02X%02X%02X%02X%02X%02X%02X%02X", dir,
+             serial[0], serial[1], serial[2], serial[3], serial[4], serial[5], serial[6], serial[7]);
+    return 0;
+}
+
+static int timeline_mkdir(const char *dir) {
+    char parent[300];
+    snprintf(parent, sizeof(parent), "%.*s", (int)(strrchr(dir, '/') - dir), dir);
+    return (romcache_mkdir() == 0 && make_dir(parent) == 0 && make_dir(dir) == 0) ? 0 : -1;
+}
+
+static void stamp_of(int64_t time, char *buf, size_t len) {
+    time_t t = (time_t)time;
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(buf, len, "%Y%m%dT%H%M%SZ", &tm);
+}
+
+// Entries of one slot, oldest first. 0 with no timeline yet; a torn last entry is left out.
+static int index_load(const char *path, uint8_t rom_id, TimelineEntry **entries) {
+    *entries = NULL;
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return errno == ENOENT ? 0 : -1;
+    }
+
+    uint8_t header[TIMELINE_HEADER_SIZE];
+    struct stat st;
+    if (fread(header, 1, sizeof(header), f) != sizeof(header) || fstat(fileno(f), &st) != 0) {
+        fclose(f);
+        return 0;
+    }
+    if (memcmp(header, TIMELINE_MAGIC, 4) != 0 || header[4] != TIMELINE_VERSION || header[5] != rom_id) {
+        fclose(f);
+        return -1;
+    }
+
+    int count = (int)((st.st_size - TIMELINE_HEADER_SIZE) / TIMELINE_ENTRY_SIZE);
+    *entries = calloc(count ? count : 1, sizeof(TimelineEntry));
+    if (!*entries) {
+        fclose(f);
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        uint8_t rec[TIMELINE_ENTRY_SIZE];
+        if (fread(rec, 1, sizeof(rec), f) != sizeof(rec)) {
+            count = i;
+            break;
+        }
+        TimelineEntry *e = &(*entries)[i];
+        e->time = (int64_t)get_le64(rec);
+        e->offset = get_le64(rec + 8);
+        e->stored = get_le32(rec + 16);
+        e->crc = get_le32(rec + 20);
+        e->kind = rec[24];
+        e->ram_banks = rec[25];
+        memcpy(e->name, rec + 28, 17);
+    }
+    fclose(f);
+    return count;
+}
+
+// Points at or after index count are dropped, which also cuts a torn entry off
+static int index_append(const char *path, uint8_t rom_id, int count, const TimelineEntry *e) {
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+
+    uint8_t header[TIMELINE_HEADER_SIZE] = {0};
+    memcpy(header, TIMELINE_MAGIC, 4);
+    header[4] = TIMELINE_VERSION;
+    header[5] = rom_id;
+
+    uint8_t rec[TIMELINE_ENTRY_SIZE] = {0};
+    put_le64(rec, (uint64_t)e->time);
+    put_le64(rec + 8, e->offset);
+    put_le32(rec + 16, e->stored);
+    put_le32(rec + 20, e->crc);
+    rec[24] = e->kind;
+    rec[25] = e->ram_banks;
+    memcpy(rec + 28, e->name, 17);
+
+    off_t at = TIMELINE_HEADER_SIZE + (off_t)count * TIMELINE_ENTRY_SIZE;
+    int ok = ftruncate(fd, at) == 0 &&
+             (count > 0 || pwrite(fd, header, sizeof(header), 0) == (ssize_t)sizeof(header)) &&
+             pwrite(fd, rec, sizeof(rec), at) == (ssize_t)sizeof(rec) && fsync(fd) == 0;
+    return (close(fd) == 0 && ok) ? 0 : -1;
+}
+
+// Rebuilds point index from the keyframe before it, checking the CRC of every step
+static int load_image(const char *data_path, const TimelineEntry *entries, int index, uint8_t *image) {
+    int key = index;
+    while (key > 0 && entries[key].kind != TIMELINE_KEYFRAME) {
+        key--;
+    }
+    size_t size = (size_t)entries[index].ram_banks * SRAM_BANK_SIZE;
+    if (entries[key].kind != TIMELINE_KEYFRAME) {
+        fprintf(stderr, "\x1b[1;31m[!] Timeline has no keyframe before point %d\x1b[0m\n", index + 1);
+        return -1;
+    }
+
+    FILE *f = fopen(data_path, "rb");
+    uint8_t *stored = malloc(size);
+    uint8_t *delta = malloc(size);
+    int ret = (f && stored && delta) ? 0 : -1;
+    for (int i = key; ret == 0 && i <= index; i++) {
+        const TimelineEntry *e = &entries[i];
+        uint8_t *out = i == key ? image : delta;
+        if (e->ram_banks != entries[index].ram_banks || e->stored > size ||
+            fseeko(f, (off_t)e->offset, SEEK_SET) != 0 || fread(stored, 1, e->stored, f) != e->stored) {
+            ret = -1;
+        } else if (e->stored == size) {
+            memcpy(out, stored, size);
+        } else if (lzpack_decompress(stored, e->stored, out, size) != 0) {
+            ret = -1;
+        }
+        if (ret == 0 && i != key) {
+            for (size_t k = 0; k < size; k++) {
+                image[k] ^= delta[k];
+            }
+        }
+        if (ret == 0 && crc32_update(0, image, size) != e->crc) {
+            ret = -1;
+        }
+        if (ret != 0) {
+            fprintf(stderr, "\x1b[1;31m[!] Timeline point %d is missing or damaged: %s\x1b[0m\n", i + 1, data_path);
+        }
+    }
+    if (f) {
+        fclose(f);
+    }
+    free(stored);
+    free(delta);
+    return ret;
+}
+
+static int append_record(const char *path, const uint8_t *data, size_t len, uint64_t *offset) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    off_t end = lseek(fd, 0, SEEK_END);
+    int ok = end >= 0 && write(fd, data, len) == (ssize_t)len && fsync(fd) == 0;
+    *offset = (uint64_t)end;
+    return (close(fd) == 0 && ok) ? 0 : -1;
+}
+
+static int record_point(const char *dir, const RomInfo *info, const uint8_t *data) {
+    char index_path[400], data_path[400];
+    snprintf(index_path, sizeof(index_path), "%s/%03u.tli", dir, info->rom_id);
+    snprintf(data_path, sizeof(data_path), "%s/%03u.tld", dir, info->rom_id);
+
+    TimelineEntry *entries;
+    int count = index_load(index_path, info->rom_id, &entries);
+    if (count < 0) {
+        return -1;
+    }
+
+    size_t size = (size_t)info->num_ram_banks * SRAM_BANK_SIZE;
+    uint8_t *prev = malloc(size);
+    uint8_t *raw = malloc(size);
+    uint8_t *packed = malloc(size);
+    if (!prev || !raw || !packed) {
+        free(entries);
+        free(prev);
+        free(raw);
+        free(packed);
+        return -1;
+    }
+
+    // Only a delta against the same ROM and size is of any use; past a damaged point start over
+    int since_key = 0;
+    while (since_key < count && entries[count - 1 - since_key].kind != TIMELINE_KEYFRAME) {
+        since_key++;
+    }
+    const TimelineEntry *last = count ? &entries[count - 1] : NULL;
+    int have_prev = last && last->ram_banks == info->num_ram_banks && strcmp(last->name, info->name) == 0 &&
+                    load_image(data_path, entries, count - 1, prev) == 0;
+    // A save identical to the newest point adds nothing
+    int ret = 0;
+    if (!have_prev || memcmp(prev, data, size) != 0) {
+        int kind = (have_prev && since_key + 1 < TIMELINE_KEYFRAME_INTERVAL) ? TIMELINE_DELTA : TIMELINE_KEYFRAME;
+        for (size_t k = 0; k < size; k++) {
+            raw[k] = kind == TIMELINE_DELTA ? data[k] ^ prev[k] : data[k];
+        }
+
+        TimelineEntry e = {0};
+        e.time = (int64_t)time(NULL);
+        e.kind = (uint8_t)kind;
+        e.ram_banks = info->num_ram_banks;
+        e.crc = crc32_update(0, data, size);
+        snprintf(e.name, sizeof(e.name), "%s", info->name);
+        size_t n = lzpack_compress(raw, size, packed, size - 1);
+        e.stored = n ? (uint32_t)n : (uint32_t)size;
+        ret = append_record(data_path, n ? packed : raw, e.stored, &e.offset);
+        if (ret == 0) {
+            ret = index_append(index_path, info->rom_id, count, &e);
+        }
+    }
+
+    free(entries);
+    free(prev);
+    free(raw);
+    free(packed);
+    return ret;
+}
+
+void timeline_record(CrocoDevice *device, const RomInfo *info, const uint8_t *data) {
+    char dir[300];
+    if (info->num_ram_banks == 0 || !device->has_serial || timeline_dir(device->serial, dir, sizeof(dir)) != 0) {
+        return;
+    }
+    if (timeline_mkdir(dir) != 0 || record_point(dir, info, data) != 0) {
+        fprintf(stderr, "\x1b[1;33m[!] WARNING: Could not add the save of ROM %u to its timeline in %s\x1b[0m\n", info->rom_id, dir);
+    }
+}
+
+// Moves a slot's timeline to another id, including the id in the index header
+static int move_slot(const char *dir, int from, int to) {
+    char from_index[400], to_index[400], from_data[400], to_data[400];
+    snprintf(from_index, sizeof(from_index), "%s/%03d.tli", dir, from);
+    snprintf(to_index, sizeof(to_index), "%s/%03d.tli", dir, to);
+    snprintf(from_data, sizeof(from_data), "%s/%03d.tld", dir, from);
+    snprintf(to_data, sizeof(to_data), "%s/%03d.tld", dir, to);
+    if (rename(from_index, to_index) != 0) {
+        return errno == ENOENT ? 0 : -1;
+    }
+    if (rename(from_data, to_data) != 0 && errno != ENOENT) {
+        return -1;
+    }
+
+    int fd = open(to_index, O_WRONLY);
+    uint8_t id = (uint8_t)to;
+    int ok = fd >= 0 && pwrite(fd, &id, 1, 5) == 1 && fsync(fd) == 0;
+    return (fd >= 0 && close(fd) == 0 && ok) ? 0 : -1;
+}
+
+void timeline_after_delete(CrocoDevice *device, uint8_t rom_id) {
+    char dir[300], path[400];
+    if (read_serial(device) != 0 || timeline_dir(device->serial, dir, sizeof(dir)) != 0) {
+        return;
+    }
+    snprintf(path, sizeof(path), "%s/%03u.tli", dir, rom_id);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/%03u.tld", dir, rom_id);
+    unlink(path);
+    for (int id = rom_id + 1; id < ROM_TABLE_MAX; id++) {
+        if (move_slot(dir, id, id - 1) != 0) {
+            fprintf(stderr, "\x1b[1;33m[!] WARNING: Could not move the timeline of ROM %d to ID %d in %s\x1b[0m\n", id, id - 1, dir);
+        }
+    }
+}
+
+// Digits where a stamp has them, and T and Z in their places
+static int stamp_prefix_valid(const char *when) {
+    static const char *shape = "DDDDDDDDTDDDDDDZ";
+    size_t len = strlen(when);
+    if (len == 0 || len > TIMELINE_STAMP_LEN) {
+        return 0;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (shape[i] == 'D' ? (when[i] < '0' || when[i] > '9') : when[i] != shape[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int find_point(const TimelineEntry *entries, int count, const char *when) {
+    if (count == 0) {
+        return -1;
+    }
+    if (strcmp(when, "latest") == 0) {
+        return count - 1;
+    }
+    if (when[0] == '@') {
+        char *end;
+        long n = strtol(when + 1, &end, 10);
+        return (end != when + 1 && *end == '\0' && n >= 1 && n <= count) ? (int)n - 1 : -1;
+    }
+    if (!stamp_prefix_valid(when)) {
+        return -1;
+    }
+    // Stamps sort by time, so comparing only the given digits takes the whole period they name
+    for (int i = count - 1; i >= 0; i--) {
+        char stamp[TIMELINE_STAMP_LEN + 1];
+        stamp_of(entries[i].time, stamp, sizeof(stamp));
+        if (strncmp(stamp, when, strlen(when)) <= 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int open_timeline(CrocoDevice *device, uint8_t rom_id, char *dir, size_t len, char *data_path, size_t data_len,
+                         TimelineEntry **entries) {
+    if (read_serial(device) != 0 || timeline_dir(device->serial, dir, len) != 0) {
+        fprintf(stderr, "\x1b[1;31m[!] Error: The timeline needs the cartridge serial ID\x1b[0m\n");
+        return -1;
+    }
+    char index_path[400];
+    snprintf(index_path, sizeof(index_path), "%s/%03u.tli", dir, rom_id);
+    snprintf(data_path, data_len, "%s/%03u.tld", dir, rom_id);
+    int count = index_load(index_path, rom_id, entries);
+    if (count < 0) {
+        fprintf(stderr, "\x1b[1;31m[!] Timeline index is not readable: %s\x1b[0m\n", index_path);
+    }
+    return count;
+}
+
+int timeline_list(CrocoDevice *device, uint8_t rom_id) {
+    char dir[300], data_path[400];
+    TimelineEntry *entries;
+    int count = open_timeline(device, rom_id, dir, sizeof(dir), data_path, sizeof(data_path), &entries);
+    if (count < 0) {
+        return -1;
+    }
+
+    printf("\n   \x1b[1;34m[>] Save timeline of ROM %u in %s\x1b[0m\n\n", rom_id, dir);
+    if (count == 0) {
+        printf("     \x1b[90m(No saves of this slot recorded yet)\x1b[0m\n");
+        free(entries);
+        return 0;
+    }
+
+    printf(" \x1b[1;37m  POINT  STAMP              | KIND  | STORED  | NAME\x1b[0m\n");
+    printf(" \x1b[90m  -----  ------------------ | ----- | ------- | -----------------\x1b[0m\n");
+    uint64_t stored = 0, raw = 0;
+    for (int i = 0; i < count; i++) {
+        char stamp[TIMELINE_STAMP_LEN + 1];
+        stamp_of(entries[i].time, stamp, sizeof(stamp));
+        printf("   \x1b[32m@%-4d\x1b[0m  %-18s | %s | %5.1fK | \x1b[1;36m%s\x1b[0m\n", i + 1, stamp,
+               entries[i].kind == TIMELINE_KEYFRAME ? "\x1b[1;33mkey\x1b[0m  " : "delta",
+               entries[i].stored / 1024.0, entries[i].name);
+        stored += entries[i].stored;
+        raw += (uint64_t)entries[i].ram_banks * SRAM_BANK_SIZE;
+    }
+    printf("\n       %d point(s), %.1f KiB on disk for %.1f KiB of saves\n", count, stored / 1024.0, raw / 1024.0);
+    free(entries);
+    return 0;
+}
+
+int timeline_restore(CrocoDevice *device, uint8_t rom_id, const char *when) {
+    char dir[300], data_path[400];
+    TimelineEntry *entries;
+    int count = open_timeline(device, rom_id, dir, sizeof(dir), data_path, sizeof(data_path), &entries);
+    if (count < 0) {
+        return -1;
+    }
+    int index = find_point(entries, count, when);
+    if (index < 0) {
+        fprintf(stderr, "\x1b[1;31m[!] No point in the timeline of ROM %u matches '%s'\x1b[0m\n", rom_id, when);
+        free(entries);
+        return -1;
+    }
+    TimelineEntry point = entries[index];
+
+    RomInfo info;
+    if (romcache_get_info(device, rom_id, &info) != 0) {
+        fprintf(stderr, "\x1b[1;31m   [!] Error: Could not retrieve info for ID %u\x1b[0m\n", rom_id);
+        free(entries);
+        return -1;
+    }
+    if (info.num_ram_banks != point.ram_banks) {
+        fprintf(stderr, "\x1b[1;31m[!] ROM %u has %u RAM banks, the timeline point %u\x1b[0m\n", rom_id, info.num_ram_banks, point.ram_banks);
+        free(entries);
+        return -1;
+    }
+    if (strcmp(info.name, point.name) != 0) {
+        if (!device->allow_foreign_saves) {
+            fprintf(stderr, "\x1b[1;31m[!] Point was recorded from '%s', slot %u now holds '%s' (--allow-foreign restores it anyway)\x1b[0m\n",
+                    point.name, rom_id, info.name);
+            free(entries);
+            return -1;
+        }
+        printf("\x1b[1;33m[!] WARNING: Point was recorded from '%s', slot %u now holds '%s'\x1b[0m\n", point.name, rom_id, info.name);
+    }
+
+    uint32_t size = (uint32_t)point.ram_banks * SRAM_BANK_SIZE;
+    uint8_t *data = malloc(size);
+    if (!data || load_image(data_path, entries, index, data) != 0) {
+        free(data);
+        free(entries);
+        return -1;
+    }
+    free(entries);
+
+    char stamp[TIMELINE_STAMP_LEN + 1];
+    stamp_of(point.time, stamp, sizeof(stamp));
+    printf("\n\x1b[1;34m   [>] Restoring timeline point @%d (%s)...\x1b[0m\n", index + 1, stamp);
+    printf("       Target ROM ID: \x1b[1;36m%u\x1b[0m (%s)\n", rom_id, point.name);
+    int ret = write_save(device, rom_id, point.ram_banks, data, size);
+    if (ret == 0) {
+        savesync_record(device, &info, data);
+    }
+    free(data);
+    if (ret == 0) {
+        printf("\n\n   \x1b[1;32m[+] Save restored from the timeline\x1b[0m\n");
+    }
+    return ret;
+}
@@ -0,0 +1,53 @@
+#ifndef CROCO_TIMELINE_H
+#define CROCO_TIMELINE_H
+
+#include "croco.h"
+
+// Save history per cartridge slot in <cache dir>/timeline/<SERIAL>. Every
+// save backed up, archived, restored or synced is appended to <id>.tld as either a
+// keyframe (the whole image) or a delta (XOR against the previous point,
+// which is almost all zeros), each LZ-compressed like a .crlz block. The
+// fixed-size index <id>.tli says where each point is and what it holds:
+//
+//   header  magic "CRTL" | version u8 | rom id u8 | 2 reserved
+//   entry   time s64 LE | offset u64 LE | stored len u32 LE | crc32 of the image u32 LE |
+//           kind u8 | banks u8 | 2 reserved | name[17] | 3 reserved
+//
+// A keyframe is taken every TIMELINE_KEYFRAME_INTERVAL points and whenever
+// the slot's ROM or save size changes, so rebuilding any point decodes at
+// most that many records however long the timeline gets.
+
+#define TIMELINE_MAGIC "CRTL"
+#define TIMELINE_VERSION 1
+#define TIMELINE_HEADER_SIZE 8
+#define TIMELINE_ENTRY_SIZE 48
+#define TIMELINE_KEYFRAME_INTERVAL 16
+
+#define TIMELINE_KEYFRAME 0
+#define TIMELINE_DELTA 1
+
+typedef struct {
+    int64_t time;               // Unix seconds
+    uint64_t offset;            // into <id>.tld
+    uint32_t stored;            // equal to the image size if kept uncompressed
+    uint32_t crc;               // of the rebuilt image
+    uint8_t kind;
+    uint8_t ram_banks;
+    char name[18];
+} TimelineEntry;
+
+// Appends the save info's slot now holds, unless it matches the newest point. Needs the
+// serial already read; does no USB I/O. Failures only warn.
+void timeline_record(CrocoDevice *device, const RomInfo *info, const uint8_t *data);
+
+// The slots above a deleted ROM move down one ID; their timelines move with them
+void timeline_after_delete(CrocoDevice *device, uint8_t rom_id);
+
+// Batch operations: timeline <id> and timeline-restore <id> <when>
+int timeline_list(CrocoDevice *device, uint8_t rom_id);
+// when is "latest", @<n> for point n of the list, or a stamp or stamp prefix:
+// the newest point at or before it, so 20261016T12 is the state as of 12:59:59.
+// Refuses a point recorded from another ROM name unless allow_foreign_saves is set.
+int timeline_restore(CrocoDevice *device, uint8_t rom_id, const char *when);
+
+#endif
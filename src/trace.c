@@ -0,0 +1,390 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "trace.h"
+
+// Capture and replay of the bus traffic. Every completion, from either
+// backend, passes through transfer_complete(), which appends it to the trace,
+// so the file holds exactly what the protocol code saw and in what order.
+//
+// Replay is a third backend. The protocol code only submits new transfers in
+// reaction to completions, so handing it the recorded completions in the
+// recorded order reproduces the session; an OUT that differs from the
+// recording, or a completion with no transfer waiting for it, is a divergence
+// and fails every pending transfer.
+
+static void put_le64(uint8_t *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+        p[i] = (v >> (i * 8)) & 0xFF;
+    }
+}
+
+static uint64_t get_le64(const uint8_t *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+int trace_open(CrocoDevice *device, const char *path) {
+    TraceWriter *trace = calloc(1, sizeof(TraceWriter));
+    if (!trace) {
+        return -1;
+    }
+    trace->file = fopen(path, "wb");
+    if (!trace->file) {
+        fprintf(stderr, "Failed to open trace file %s\n", path);
+        free(trace);
+        return -1;
+    }
+    setvbuf(trace->file, NULL, _IOFBF, 1 << 16);
+
+    uint8_t header[TRACE_HEADER_SIZE] = {0};
+    memcpy(header, TRACE_MAGIC, 4);
+    header[4] = TRACE_VERSION;
+    header[5] = device->caps;
+    fwrite(header, 1, sizeof(header), trace->file);
+
+    trace->start_ns = monotonic_ns();
+    device->trace = trace;
+    return 0;
+}
+
+void trace_record(TraceWriter *trace, const CrocoTransfer *transfer, uint64_t done_ns) {
+    int length = (transfer->direction == XFER_OUT) ? transfer->length : transfer->actual_length;
+    if (length < 0) {
+        length = 0;
+    }
+
+    uint8_t rec[TRACE_RECORD_SIZE];
+    rec[0] = (uint8_t)transfer->direction;
+    rec[1] = (uint8_t)transfer->status;
+    rec[2] = length & 0xFF;
+    rec[3] = (length >> 8) & 0xFF;
+    put_le64(rec + 4, transfer->submit_ns - trace->start_ns);
+    put_le64(rec + 12, done_ns - trace->start_ns);
+    fwrite(rec, 1, sizeof(rec), trace->file);
+    fwrite(transfer->buffer, 1, length, trace->file);
+    trace->records++;
+
+    // A failure is what the trace is for; don't leave it in the buffer if the process dies next
+    if (transfer->status != XFER_COMPLETED) {
+        fflush(trace->file);
+    }
+}
+
+void trace_close(CrocoDevice *device) {
+    TraceWriter *trace = device->trace;
+    if (!trace) {
+        return;
+    }
+    if (fclose(trace->file) != 0) {
+        fprintf(stderr, "Failed to write trace file\n");
+    }
+    free(trace);
+    device->trace = NULL;
+}
+
+// Replay backend
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t pos;                 // next record
+    uint64_t records;
+    uint64_t replayed;
+    int timed;
+    int diverged;
+    uint64_t start_ns;
+    CrocoTransfer *out_head;
+    CrocoTransfer *in_head;
+} Replay;
+
+typedef struct {
+    int direction;
+    int status;
+    int length;
+    uint64_t done_ns;
+    const uint8_t *data;
+} ReplayRecord;
+
+// backend values of a queued transfer
+static char replay_queued;
+static char replay_cancelled;
+
+static int replay_parse(const Replay *replay, size_t pos, ReplayRecord *rec) {
+    if (pos + TRACE_RECORD_SIZE > replay->size) {
+        return -1;
+    }
+    const uint8_t *p = replay->data + pos;
+    rec->direction = p[0];
+    rec->status = p[1];
+    rec->length = p[2] | (p[3] << 8);
+    rec->done_ns = get_le64(p + 12);
+    rec->data = p + TRACE_RECORD_SIZE;
+    if (rec->direction > XFER_IN || pos + TRACE_RECORD_SIZE + rec->length > replay->size) {
+        return -1;
+    }
+    return 0;
+}
+
+static void replay_queue_push(CrocoTransfer **head, CrocoTransfer *transfer) {
+    transfer->next = NULL;
+    while (*head) {
+        head = &(*head)->next;
+    }
+    *head = transfer;
+}
+
+static void replay_queue_unlink(CrocoTransfer **head, CrocoTransfer *transfer) {
+    for (; *head; head = &(*head)->next) {
+        if (*head == transfer) {
+            *head = transfer->next;
+            transfer->next = NULL;
+            return;
+        }
+    }
+}
+
+// The transfer a record completes: the first one the code cancelled for a
+// cancellation, otherwise the oldest one it did not
+static CrocoTransfer *replay_match(CrocoTransfer *queue, const ReplayRecord *rec) {
+    CrocoTransfer *fallback = NULL;
+    for (CrocoTransfer *it = queue; it; it = it->next) {
+        int cancelled = (it->backend == &replay_cancelled);
+        if (rec->direction == XFER_OUT &&
+            (it->length != rec->length || memcmp(it->buffer, rec->data, rec->length) != 0)) {
+            continue;
+        }
+        if (cancelled == (rec->status == XFER_CANCELLED)) {
+            return it;
+        }
+        if (!fallback) {
+            fallback = it;
+        }
+    }
+    return fallback;
+}
+
+static void replay_complete(CrocoTransfer *transfer, int status, int actual_length) {
+    transfer->status = status;
+    transfer->actual_length = actual_length;
+    transfer->backend = NULL;
+    transfer_complete(transfer);
+}
+
+static int replay_fail_pending(Replay *replay) {
+    int fired = 0;
+    CrocoTransfer *transfer;
+    while ((transfer = replay->out_head) != NULL || (transfer = replay->in_head) != NULL) {
+        replay_queue_unlink(transfer->direction == XFER_OUT ? &replay->out_head : &replay->in_head, transfer);
+        replay_complete(transfer, transfer->backend == &replay_cancelled ? XFER_CANCELLED : XFER_ERROR, 0);
+        fired++;
+    }
+    return fired;
+}
+
+static void replay_diverge(Replay *replay, const char *reason) {
+    if (!replay->diverged) {
+        fprintf(stderr, "\x1b[1;31m[!] Replay diverged at record %llu: %s\x1b[0m\n",
+                (unsigned long long)replay->replayed + 1, reason);
+        replay->diverged = 1;
+    }
+}
+
+// Deliver every recorded completion that is due. Returns how many transfers
+// completed and stores when the next one is due in timed mode.
+static int replay_step(Replay *replay, uint64_t now, uint64_t *next_due) {
+    int fired = 0;
+
+    while (!replay->diverged && (replay->out_head || replay->in_head)) {
+        ReplayRecord rec;
+        if (replay_parse(replay, replay->pos, &rec) != 0) {
+            replay_diverge(replay, "the trace ended with transfers still pending");
+            break;
+        }
+
+        CrocoTransfer **queue = (rec.direction == XFER_OUT) ? &replay->out_head : &replay->in_head;
+        CrocoTransfer *transfer = replay_match(*queue, &rec);
+        if (!transfer) {
+            replay_diverge(replay, (rec.direction == XFER_OUT && *queue)
+                                   ? "the command sent differs from the recording"
+                                   : "the recorded transfer was never submitted");
+            break;
+        }
+        if (rec.direction == XFER_IN && rec.length > transfer->length) {
+            replay_diverge(replay, "the recorded response does not fit the IN buffer");
+            break;
+        }
+
+        if (replay->timed && replay->start_ns + rec.done_ns > now) {
+            *next_due = replay->start_ns + rec.done_ns;
+            return fired;
+        }
+
+        replay_queue_unlink(queue, transfer);
+        replay->pos += TRACE_RECORD_SIZE + rec.length;
+        replay->replayed++;
+        int actual = 0;
+        if (rec.direction == XFER_IN) {
+            memcpy(transfer->buffer, rec.data, rec.length);
+            actual = rec.length;
+        } else if (rec.status == XFER_COMPLETED) {
+            actual = rec.length;
+        }
+        replay_complete(transfer, rec.status, actual);
+        fired++;
+    }
+
+    if (replay->diverged) {
+        fired += replay_fail_pending(replay);
+    }
+    return fired;
+}
+
+static int replay_submit(CrocoTransfer *transfer) {
+    Replay *replay = transfer->device->backend;
+    transfer->backend = &replay_queued;
+    replay_queue_push(transfer->direction == XFER_OUT ? &replay->out_head : &replay->in_head, transfer);
+    return 0;
+}
+
+static int replay_cancel(CrocoTransfer *transfer) {
+    // The recording says how the cancellation ended; it may still have completed
+    if (transfer->backend != &replay_queued) {
+        return -1;
+    }
+    transfer->backend = &replay_cancelled;
+    return 0;
+}
+
+static int replay_handle_events(CrocoDevice *device, uint64_t timeout_ns, int *completed) {
+    Replay *replay = device->backend;
+    uint64_t deadline = monotonic_ns() + timeout_ns;
+
+    for (;;) {
+        uint64_t now = monotonic_ns();
+        uint64_t next_due = UINT64_MAX;
+        int fired = replay_step(replay, now, &next_due);
+
+        if (fired > 0 || (completed && *completed) || now >= deadline) {
+            return 0;
+        }
+
+        uint64_t wake = next_due < deadline ? next_due : deadline;
+        uint64_t sleep_ns = wake - now;
+        struct timespec ts = { sleep_ns / 1000000000ull, sleep_ns % 1000000000ull };
+        nanosleep(&ts, NULL);
+    }
+}
+
+static void replay_close(CrocoDevice *device) {
+    Replay *replay = device->backend;
+    if (!replay) {
+        return;
+    }
+    if (replay->diverged) {
+        fprintf(stderr, "Replay: %llu of %llu record(s) replayed before diverging\n",
+                (unsigned long long)replay->replayed, (unsigned long long)replay->records);
+    } else if (replay->replayed < replay->records) {
+        fprintf(stderr, "Replay: session ended after %llu of %llu record(s)\n",
+                (unsigned long long)replay->replayed, (unsigned long long)replay->records);
+    } else {
+        fprintf(stderr, "Replay: all %llu record(s) replayed\n", (unsigned long long)replay->records);
+    }
+    free(replay->data);
+    free(replay);
+    device->backend = NULL;
+}
+
+const CrocoTransport replay_transport = {
+    "replay",
+    replay_submit,
+    replay_cancel,
+    replay_handle_events,
+    replay_close,
+};
+
+static int replay_load(Replay *replay, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "Failed to open trace file %s\n", path);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    replay->data = (size > 0) ? malloc(size) : NULL;
+    if (!replay->data || fread(replay->data, 1, size, f) != (size_t)size) {
+        fprintf(stderr, "Failed to read trace file %s\n", path);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    replay->size = size;
+
+    if (replay->size < TRACE_HEADER_SIZE || memcmp(replay->data, TRACE_MAGIC, 4) != 0 ||
+        replay->data[4] != TRACE_VERSION) {
+        fprintf(stderr, "%s is not a version %d trace file\n", path, TRACE_VERSION);
+        return -1;
+    }
+
+    // A capture cut short by a crash keeps every complete record
+    size_t pos = TRACE_HEADER_SIZE;
+    ReplayRecord rec;
+    while (replay_parse(replay, pos, &rec) == 0) {
+        pos += TRACE_RECORD_SIZE + rec.length;
+        replay->records++;
+    }
+    if (pos != replay->size) {
+        fprintf(stderr, "Trace file %s is truncated after %llu record(s)\n", path,
+                (unsigned long long)replay->records);
+        replay->size = pos;
+    }
+    replay->pos = TRACE_HEADER_SIZE;
+    return 0;
+}
+
+int replay_open(CrocoDevice *device, const char *spec) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s", spec);
+    char *opt = strchr(path, ',');
+    if (opt) {
+        *opt++ = '\0';
+    }
+
+    Replay *replay = calloc(1, sizeof(Replay));
+    if (!replay) {
+        return -1;
+    }
+    if (opt && strcmp(opt, "timed") == 0) {
+        replay->timed = 1;
+    } else if (opt) {
+        fprintf(stderr, "Unknown replay option: %s\n", opt);
+        free(replay);
+        return -1;
+    }
+    if (replay_load(replay, path) != 0) {
+        free(replay->data);
+        free(replay);
+        return -1;
+    }
+
+    device->dev = NULL;
+    device->vendor_id = CROCO_VENDOR_ID;
+    device->product_id = CROCO_PRODUCT_ID;
+    device->out_ep = 0x01;
+    device->in_ep = 0x81;
+    device->if_num = 0;
+    device->transport = &replay_transport;
+    device->backend = replay;
+    device->caps = replay->data[5];
+    replay->start_ns = monotonic_ns();
+
+    printf("Found device: %04x:%04x (replaying %llu record(s) from %s%s)\n", device->vendor_id, device->product_id,
+           (unsigned long long)replay->records, path, replay->timed ? ", timed" : "");
+    return 0;
+}
@@ -0,0 +1,36 @@
+#ifndef CROCO_TRACE_H
+#define CROCO_TRACE_H
+
+#include <stdio.h>
+#include "croco.h"
+#include "transport.h"
+
+// Trace file (little endian): "CRTR" | version u8 | caps u8 | 2 reserved, then one
+// record per completed transfer in completion order:
+//   dir u8 | status u8 | length u16 | submit_ns u64 | done_ns u64 | data[length]
+// Times are relative to the trace being opened. OUT records carry the whole
+// command, IN records the bytes received.
+#define TRACE_MAGIC "CRTR"
+#define TRACE_VERSION 1
+#define TRACE_HEADER_SIZE 8
+#define TRACE_RECORD_SIZE 20
+
+struct TraceWriter {
+    FILE *file;
+    uint64_t start_ns;
+    uint64_t records;
+};
+
+extern const CrocoTransport replay_transport;
+
+// CROCO_TRACE=<file>
+int trace_open(CrocoDevice *device, const char *path);
+void trace_record(TraceWriter *trace, const CrocoTransfer *transfer, uint64_t done_ns);
+void trace_close(CrocoDevice *device);
+
+// CROCO_REPLAY=<file>[,timed] answers every transfer from a trace instead of
+// a cartridge, with the capabilities of the captured one; timed also waits
+// out the recorded completion times
+int replay_open(CrocoDevice *device, const char *spec);
+
+#endif
@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include "transport.h"
+#include "trace.h"
+
+uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static const CrocoTransport *transport_of(CrocoDevice *device) {
+    return device->transport ? device->transport : &usb_transport;
+}
+
+void transfer_fill(CrocoTransfer *transfer, CrocoDevice *device, int direction, uint8_t *buffer,
+                   int length, croco_transfer_cb callback, void *user_data, unsigned int timeout_ms) {
+    memset(transfer, 0, sizeof(*transfer));
+    transfer->device = device;
+    transfer->direction = direction;
+    transfer->buffer = buffer;
+    transfer->length = length;
+    transfer->callback = callback;
+    transfer->user_data = user_data;
+    transfer->timeout_ms = timeout_ms;
+}
+
+int transfer_submit(CrocoTransfer *transfer) {
+    transfer->actual_length = 0;
+    transfer->status = XFER_ERROR;
+    transfer->submit_ns = monotonic_ns();
+    transfer->next = NULL;
+    return transport_of(transfer->device)->submit(transfer);
+}
+
+void transfer_complete(CrocoTransfer *transfer) {
+    if (transfer->device->trace) {
+        trace_record(transfer->device->trace, transfer, monotonic_ns());
+    }
+    transfer->callback(transfer);
+}
+
+int transfer_cancel(CrocoTransfer *transfer) {
+    return transport_of(transfer->device)->cancel(transfer);
+}
+
+int transport_handle_events(CrocoDevice *device, uint64_t timeout_ns, int *completed) {
+    return transport_of(device)->handle_events(device, timeout_ns, completed);
+}
+
+void transport_close(CrocoDevice *device) {
+    transport_of(device)->close(device);
+}
+
+void transfer_reap(CrocoTransfer *transfer, int *completed) {
+    if (!*completed) {
+        transfer_cancel(transfer);
+    }
+    while (!*completed) {
+        // A failing event loop returns at once; do not spin on it
+        if (transport_handle_events(transfer->device, 100000000ull, completed) != 0 && !*completed) {
+            struct timespec ts = { 0, 1000000L };
+            nanosleep(&ts, NULL);
+        }
+    }
+}
+
+static void sync_transfer_cb(CrocoTransfer *transfer) {
+    *(int *)transfer->user_data = 1;
+}
+
+int transport_transfer_sync(CrocoDevice *device, int direction, uint8_t *buffer, int length,
+                            int *transferred, unsigned int timeout_ms) {
+    CrocoTransfer transfer;
+    int done = 0;
+    transfer_fill(&transfer, device, direction, buffer, length, sync_transfer_cb, &done, timeout_ms);
+    if (transfer_submit(&transfer) != 0) {
+        return -1;
+    }
+
+    // Same shape as libusb's own sync wrapper: on event loop failure cancel and keep reaping.
+    // The transfer times out by itself; past its timeout plus a grace period it is cancelled.
+    uint64_t cancel_at = monotonic_ns() + (uint64_t)(timeout_ms + SYNC_GRACE_MS) * 1000000ull;
+    while (!done) {
+        if (transport_handle_events(device, 100000000ull, &done) != 0 || monotonic_ns() >= cancel_at) {
+            transfer_reap(&transfer, &done);
+        }
+    }
+
+    *transferred = transfer.actual_length;
+    return transfer.status;
+}
+
+const char *transfer_status_name(int status) {
+    switch (status) {
+        case XFER_COMPLETED: return "COMPLETED";
+        case XFER_TIMED_OUT: return "TIMED_OUT";
+        case XFER_CANCELLED: return "CANCELLED";
+        default: return "ERROR";
+    }
+}
+
+// libusb backend
+
+static void LIBUSB_CALL usb_transfer_cb(struct libusb_transfer *usb) {
+    CrocoTransfer *transfer = usb->user_data;
+
+    switch (usb->status) {
+        case LIBUSB_TRANSFER_COMPLETED: transfer->status = XFER_COMPLETED; break;
+        case LIBUSB_TRANSFER_TIMED_OUT: transfer->status = XFER_TIMED_OUT; break;
+        case LIBUSB_TRANSFER_CANCELLED: transfer->status = XFER_CANCELLED; break;
+        default: transfer->status = XFER_ERROR; break;
+    }
+    transfer->actual_length = usb->actual_length;
+    transfer->backend = NULL;
+    libusb_free_transfer(usb);
+
+    transfer_complete(transfer);
+}
+
+static int usb_submit(CrocoTransfer *transfer) {
+    CrocoDevice *device = transfer->device;
+    struct libusb_transfer *usb = libusb_alloc_transfer(0);
+    if (!usb) {
+        return -1;
+    }
+
+    uint8_t ep = (transfer->direction == XFER_IN) ? device->in_ep : device->out_ep;
+    libusb_fill_bulk_transfer(usb, device->dev, ep, transfer->buffer, transfer->length,
+                              usb_transfer_cb, transfer, transfer->timeout_ms);
+
+    int ret = libusb_submit_transfer(usb);
+    if (ret != 0) {
+        fprintf(stderr, "Failed to submit transfer: %s\n", libusb_error_name(ret));
+        libusb_free_transfer(usb);
+        return -1;
+    }
+
+    transfer->backend = usb;
+    return 0;
+}
+
+static int usb_cancel(CrocoTransfer *transfer) {
+    if (!transfer->backend) {
+        return -1;
+    }
+    return libusb_cancel_transfer(transfer->backend) == 0 ? 0 : -1;
+}
+
+static int usb_handle_events(CrocoDevice *device, uint64_t timeout_ns, int *completed) {
+    struct timeval tv = { timeout_ns / 1000000000ull, (timeout_ns % 1000000000ull) / 1000 };
+
+    int rc = libusb_handle_events_timeout_completed(device->usb_ctx, &tv, completed);
+    if (rc < 0 && rc != LIBUSB_ERROR_INTERRUPTED) {
+        fprintf(stderr, "USB event loop failed: %s\n", libusb_error_name(rc));
+        return -1;
+    }
+    return 0;
+}
+
+static void usb_close(CrocoDevice *device) {
+    if (device->dev) {
+        libusb_release_interface(device->dev, device->if_num);
+        libusb_close(device->dev);
+        device->dev = NULL;
+    }
+    if (device->usb_ctx) {
+        libusb_exit(device->usb_ctx);
+        device->usb_ctx = NULL;
+    }
+}
+
+const CrocoTransport usb_transport = {
+    "usb",
+    usb_submit,
+    usb_cancel,
+    usb_handle_events,
+    usb_close,
+};
@@ -0,0 +1,72 @@
+#ifndef CROCO_TRANSPORT_H
+#define CROCO_TRANSPORT_H
+
+#include "croco.h"
+
+#define XFER_OUT 0
+#define XFER_IN  1
+
+typedef enum {
+    XFER_COMPLETED = 0,
+    XFER_ERROR,
+    XFER_TIMED_OUT,
+    XFER_CANCELLED,
+} CrocoTransferStatus;
+
+typedef struct CrocoTransfer CrocoTransfer;
+typedef void (*croco_transfer_cb)(CrocoTransfer *transfer);
+
+// Backend-neutral bulk transfer, modelled on struct libusb_transfer
+struct CrocoTransfer {
+    CrocoDevice *device;
+    int direction;              // XFER_OUT or XFER_IN
+    uint8_t *buffer;
+    int length;
+    int actual_length;
+    int status;                 // CrocoTransferStatus, valid in the callback
+    unsigned int timeout_ms;
+    croco_transfer_cb callback;
+    void *user_data;
+
+    // Owned by the backend while the transfer is in flight
+    void *backend;
+    uint64_t submit_ns;
+    CrocoTransfer *next;
+};
+
+struct CrocoTransport {
+    const char *name;
+    int (*submit)(CrocoTransfer *transfer);
+    int (*cancel)(CrocoTransfer *transfer);
+    // Dispatch completions for at most timeout_ns; returns early once *completed is set
+    int (*handle_events)(CrocoDevice *device, uint64_t timeout_ns, int *completed);
+    void (*close)(CrocoDevice *device);
+};
+
+extern const CrocoTransport usb_transport;
+
+uint64_t monotonic_ns(void);
+
+void transfer_fill(CrocoTransfer *transfer, CrocoDevice *device, int direction, uint8_t *buffer,
+                   int length, croco_transfer_cb callback, void *user_data, unsigned int timeout_ms);
+int transfer_submit(CrocoTransfer *transfer);
+// Backends report every finished transfer through here, never the callback directly
+void transfer_complete(CrocoTransfer *transfer);
+int transfer_cancel(CrocoTransfer *transfer);
+// Cancels the transfer unless *completed is set and handles events until it is. Backends
+// complete every cancelled transfer, libusb even after a disconnect, so this returns, and
+// only then may the transfer and its buffer go away.
+void transfer_reap(CrocoTransfer *transfer, int *completed);
+int transport_handle_events(CrocoDevice *device, uint64_t timeout_ns, int *completed);
+void transport_close(CrocoDevice *device);
+
+#define SYNC_GRACE_MS 1000          // past its own timeout before a sync transfer is cancelled
+
+// Blocking transfer on top of the async primitives; returns a CrocoTransferStatus or -1.
+// Returns only once the transfer has completed, so buffer may live on the caller's stack.
+int transport_transfer_sync(CrocoDevice *device, int direction, uint8_t *buffer, int length,
+                            int *transferred, unsigned int timeout_ms);
+
+const char *transfer_status_name(int status);
+
+#endif
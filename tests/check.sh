@@ -0,0 +1,104 @@
+#!/bin/sh
+# Simulator scenarios for 'make check'. Each one runs build/croco_cli against
+# CROCO_SIM with an empty cache directory and greps the output for the result
+# it has to produce. Simulator state lasts one process, so every scenario is a
+# single command line.
+
+CLI=${CLI:-./build/croco_cli}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT INT TERM
+failed=0
+
+# A 64 KiB MBC1+RAM+BATTERY image with 4 SRAM banks; random data, so its
+# checksums are wrong and it is flashed with --force
+make_rom() {
+    head -c 65536 /dev/urandom > "$1"
+    printf 'CHECK' | dd of="$1" bs=1 seek=308 conv=notrunc 2>/dev/null
+    printf '\003\001\003' | dd of="$1" bs=1 seek=327 conv=notrunc 2>/dev/null
+}
+
+# Runs the CLI with CROCO_SIM=$1 and the remaining arguments, output in $WORK/out
+run() {
+    sim=$1
+    shift
+    rm -rf "$WORK/cache"
+    CROCO_SIM=$sim CROCO_CACHE_DIR="$WORK/cache" "$CLI" "$@" > "$WORK/out" 2>&1
+}
+
+pass() {
+    printf '  \033[1;32mok\033[0m    %s\n' "$1"
+}
+
+fail() {
+    printf '  \033[1;31mFAIL\033[0m  %s: %s\n' "$1" "$2"
+    sed 's/^/        /' "$WORK/out"
+    failed=$((failed + 1))
+}
+
+expect() {
+    if grep -qF -- "$2" "$WORK/out"; then
+        pass "$1"
+    else
+        fail "$1" "no \"$2\" in the output"
+    fi
+}
+
+refuse() {
+    if grep -qF -- "$2" "$WORK/out"; then
+        fail "$1" "unexpected \"$2\" in the output"
+    else
+        pass "$1"
+    fi
+}
+
+make_rom "$WORK/check.gb"
+# A half-empty image, so the tail goes out as 0x0C fills
+head -c 32768 "$WORK/check.gb" > "$WORK/pad.gb"
+head -c 32768 /dev/zero | tr '\000' '\377' >> "$WORK/pad.gb"
+head -c 32768 /dev/urandom > "$WORK/a.sav"
+cp "$WORK/a.sav" "$WORK/b.sav"
+printf 'x' | dd of="$WORK/b.sav" bs=1 seek=5000 conv=notrunc 2>/dev/null
+
+printf '\n\033[1;34m   [>] Simulator checks\033[0m\n'
+
+run 1 --force flash "$WORK/check.gb" Check restore 0 "$WORK/a.sav" backup 0 "$WORK/back.sav" list
+expect "flash" "SUCCESS: ROM flashed"
+expect "flash: listed" "  4 Banks"
+if cmp -s "$WORK/a.sav" "$WORK/back.sav"; then
+    pass "save readback"
+else
+    fail "save readback" "the backup differs from the restored save"
+fi
+
+run 1,fill=0 --force flash "$WORK/pad.gb" Pad list
+expect "fill=0: fallback" "Fill Bank not accepted"
+expect "fill=0: flash" "SUCCESS: ROM flashed"
+
+run 1,drop=300 --force --keep-going flash "$WORK/check.gb" Check resume "$WORK/check.gb" list
+expect "drop: interrupted" "Progress saved at"
+expect "drop: resumed" "Resuming Data Stream"
+expect "drop: flash" "SUCCESS: ROM flashed"
+refuse "drop: not restarted" "flashing again from Bank 0"
+expect "drop: listed" "1 Games Registered"
+
+run 1 --force --trust-shadow flash "$WORK/check.gb" Check restore 0 "$WORK/a.sav" sync 0 "$WORK/b.sav"
+expect "sync" "1 of 1024 chunks changed, 2 sent"
+
+run 1,carts=3,plug=20 --force --watch flash "$WORK/check.gb" Check
+expect "watch" "3 job(s) on 3 cartridge(s)"
+refuse "watch: no failures" "failed"
+
+rm -rf "$WORK/cache"
+CROCO_SIM=1 CROCO_TRACE="$WORK/flash.trace" CROCO_CACHE_DIR="$WORK/cache" \
+    "$CLI" --force flash "$WORK/check.gb" Check list > /dev/null 2>&1
+rm -rf "$WORK/cache"
+CROCO_REPLAY="$WORK/flash.trace" CROCO_CACHE_DIR="$WORK/cache" \
+    "$CLI" --force flash "$WORK/check.gb" Check list > "$WORK/out" 2>&1
+expect "replay" "Replay: all"
+refuse "replay: no divergence" "diverged"
+
+if [ "$failed" -ne 0 ]; then
+    printf '\n   \033[1;31m[!] %d check(s) failed\033[0m\n\n' "$failed"
+    exit 1
+fi
+printf '\n   \033[1;32m[+] All checks passed\033[0m\n\n'